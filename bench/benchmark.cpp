@@ -0,0 +1,515 @@
+// benchmark.cpp
+// Headless benchmark suite: tokenizer throughput, text encoder / UNet step /
+// VAE decode latency per resolution and provider, Renderer upload bandwidth,
+// VideoWriter frames per second per backend and end-to-end pipeline FPS. All
+// results go out as one JSON document, so runs can be diffed release over
+// release.
+//
+// --models= --tokenizer= --sizes=512x512,768x768 --providers=cpu,cuda,tensorrt
+// --iterations=<timed runs> --warmup=<untimed runs> --steps=<UNet steps per run>
+// --encoders=png,raw,software,nvenc,vaapi --writer_frames= --pipeline_frames=
+// --only=tokenizer,text_encoder,unet,vae,upload,writer,pipeline
+// --output=<file.json> (stdout otherwise; logging always goes to stderr);
+// every other --key=value goes to the provider config (see RunnerConfig.hpp),
+// which --providers overrides.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "client/Renderer.hpp"
+#include "client/VideoWriter.hpp"
+#include "client/VulkanContext.hpp"
+#include "pipeline/RunnerPool.hpp"
+#include "sd/ClipTokenizer.hpp"
+#include "sd/ONNXRunner.hpp"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const char *kPrompts[] = {
+    "um gato astronauta, painting, high detail",
+    "a lighthouse on a cliff at dusk, volumetric light, 35mm photo",
+    "isometric voxel city, neon signs, rain, night",
+    "portrait of an old fisherman, oil on canvas, rembrandt lighting",
+    "macro shot of a dew drop on a leaf, bokeh",
+    "watercolor map of an imaginary archipelago with tiny boats",
+    "a red fox running through fresh snow, motion blur, telephoto",
+    "retro futuristic kitchen, pastel colors, 1960s advertisement",
+};
+
+struct Options {
+    std::string models_dir = "models";
+    std::string tokenizer_json = "models/tokenizer.json";
+    std::vector<std::pair<int, int>> sizes{{512, 512}};
+    std::vector<ExecutionProvider> providers; // empty = the provider config's own
+    int iterations = 10;
+    int warmup = 2;
+    int steps = 4;
+    std::vector<EncoderBackend> encoders{EncoderBackend::Png, EncoderBackend::Raw};
+    int writer_frames = 60;
+    int pipeline_frames = 24;
+    std::vector<std::string> only; // empty = every benchmark
+    std::string output;
+
+    bool wants(const std::string &bench) const {
+        return only.empty() || std::find(only.begin(), only.end(), bench) != only.end();
+    }
+};
+
+// Comma separated items, each parsed by `parse`
+template <typename T, typename Parse>
+bool parse_list(const std::string &v, std::vector<T> &out, Parse parse) {
+    out.clear();
+    for (size_t pos = 0;;) {
+        const size_t comma = v.find(',', pos);
+        T item{};
+        if (!parse(v.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos), item)) return false;
+        out.push_back(item);
+        if (comma == std::string::npos) return true;
+        pos = comma + 1;
+    }
+}
+
+bool parse_int(const std::string &v, int &out) {
+    try {
+        size_t pos = 0;
+        out = std::stoi(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+// "512x768" -> width 512, height 768; multiples of 8 like the latents
+bool parse_size(const std::string &v, std::pair<int, int> &out) {
+    const size_t x = v.find('x');
+    return x != std::string::npos && parse_int(v.substr(0, x), out.first) && parse_int(v.substr(x + 1), out.second) &&
+           out.first > 0 && out.second > 0 && out.first % 8 == 0 && out.second % 8 == 0;
+}
+
+bool parse_encoder(const std::string &v, EncoderBackend &out) {
+    VideoWriterConfig cfg;
+    if (!applyVideoOption(cfg, "encoder", v)) return false;
+    out = cfg.backend;
+    return true;
+}
+
+bool apply_bench_option(Options &o, const std::string &key, const std::string &value, bool &ok) {
+    ok = true;
+    if (key == "models") o.models_dir = value;
+    else if (key == "tokenizer") o.tokenizer_json = value;
+    else if (key == "sizes") ok = parse_list(value, o.sizes, parse_size);
+    else if (key == "providers") ok = parse_list(value, o.providers, parse_provider);
+    else if (key == "iterations") ok = parse_int(value, o.iterations) && o.iterations > 0;
+    else if (key == "warmup") ok = parse_int(value, o.warmup) && o.warmup >= 0;
+    else if (key == "steps") ok = parse_int(value, o.steps) && o.steps > 0;
+    else if (key == "encoders") ok = parse_list(value, o.encoders, parse_encoder);
+    else if (key == "writer_frames") ok = parse_int(value, o.writer_frames) && o.writer_frames > 0;
+    else if (key == "pipeline_frames") ok = parse_int(value, o.pipeline_frames) && o.pipeline_frames > 0;
+    else if (key == "only") {
+        ok = parse_list(value, o.only, [](const std::string &s, std::string &out) {
+            out = s;
+            return !s.empty();
+        });
+    }
+    else if (key == "output") o.output = value;
+    else return false;
+    return true;
+}
+
+// ------------------------- Results -------------------------------------------
+// One JSON object per measurement: "bench" plus its parameters and metrics.
+// Values are kept already encoded, in insertion order.
+class Result {
+public:
+    explicit Result(const std::string &bench) { str("bench", bench); }
+
+    Result &str(const std::string &key, const std::string &value) {
+        fields_.emplace_back(key, quote(value));
+        return *this;
+    }
+    Result &num(const std::string &key, double value) {
+        std::ostringstream s;
+        s.precision(6);
+        s << value;
+        fields_.emplace_back(key, s.str());
+        return *this;
+    }
+    Result &size(int width, int height) { return num("width", width).num("height", height); }
+
+    void write(std::ostream &out) const {
+        out << "{";
+        for (size_t i = 0; i < fields_.size(); ++i)
+            out << (i ? ", " : "") << quote(fields_[i].first) << ": " << fields_[i].second;
+        out << "}";
+    }
+
+    static std::string quote(const std::string &s) {
+        std::string q = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') q += '\\';
+            if (c == '\n') q += "\\n";
+            else q += c;
+        }
+        return q + "\"";
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> fields_;
+};
+
+// Latencies of the timed runs, in ms
+struct Timing {
+    std::vector<double> ms;
+    bool ok = true;
+
+    Result &into(Result &r, double scale = 1.0) const {
+        std::vector<double> v = ms;
+        std::sort(v.begin(), v.end());
+        double sum = 0.0;
+        for (double x : v) sum += x;
+        auto pct = [&](double p) { return v[std::min(v.size() - 1, static_cast<size_t>(p * static_cast<double>(v.size())))]; };
+        return r.str("unit", "ms")
+            .num("iterations", static_cast<double>(v.size()))
+            .num("mean", sum / static_cast<double>(v.size()) * scale)
+            .num("p50", pct(0.50) * scale)
+            .num("p99", pct(0.99) * scale)
+            .num("min", v.front() * scale);
+    }
+};
+
+// Runs f() warmup + iterations times and times the last `iterations`; stops
+// at the first failure
+template <typename F>
+Timing time_runs(int warmup, int iterations, F &&f) {
+    Timing t;
+    for (int i = 0; i < warmup + iterations; ++i) {
+        const auto t0 = Clock::now();
+        if (!f()) {
+            t.ok = false;
+            return t;
+        }
+        if (i >= warmup) t.ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    return t;
+}
+
+Result failure(const std::string &bench, const std::string &error) {
+    Result r(bench);
+    r.str("error", error);
+    return r;
+}
+
+// ------------------------- Benchmarks ----------------------------------------
+
+void bench_tokenizer(const Options &o, std::vector<Result> &out) {
+    ClipTokenizer tokenizer;
+    if (!tokenizer.load(o.tokenizer_json)) {
+        out.push_back(failure("tokenizer", "cannot load " + o.tokenizer_json));
+        return;
+    }
+    constexpr size_t kMaxTokens = 77;
+    constexpr int kPromptsPerRun = 1000;
+    std::vector<int64_t> ids(kMaxTokens);
+    size_t tokens = 0;
+    Timing t = time_runs(o.warmup, o.iterations, [&] {
+        for (int i = 0; i < kPromptsPerRun; ++i)
+            tokens += tokenizer.encode(kPrompts[i % std::size(kPrompts)], ids.data(), ids.size());
+        return true;
+    });
+    double total_ms = 0.0;
+    for (double ms : t.ms) total_ms += ms;
+    const double runs = static_cast<double>(o.warmup + o.iterations);
+    Result r("tokenizer");
+    r.num("prompts_per_sec", kPromptsPerRun * static_cast<double>(o.iterations) / (total_ms / 1000.0))
+        .num("tokens_per_sec", static_cast<double>(tokens) / runs * static_cast<double>(o.iterations) / (total_ms / 1000.0));
+    t.into(r, 1.0 / kPromptsPerRun); // per prompt
+    out.push_back(r);
+}
+
+// Text encoder, one UNet step and the VAE for one provider and resolution,
+// each on the runner's stage API like the pipeline uses it
+void bench_models(const Options &o, const ProviderConfig &base, ExecutionProvider provider, int width, int height,
+                  std::vector<Result> &out) {
+    ProviderConfig cfg = base;
+    cfg.provider = provider;
+    cfg.shape_width = width;
+    cfg.shape_height = height;
+    const std::string name = provider_name(provider);
+
+    const auto t0 = Clock::now();
+    ONNXRunner runner(o.models_dir, cfg, o.tokenizer_json);
+    const double load_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    // The runner falls back to test images without models: nothing to measure
+    if (!runner.ready()) {
+        out.push_back(failure("models", "models not loaded from " + o.models_dir).str("provider", name).size(width, height));
+        return;
+    }
+    // A provider that is missing falls back to CPU; report what actually ran
+    const std::string used = provider_name(runner.provider());
+    out.push_back(Result("session_load").str("provider", used).size(width, height).str("unit", "ms").num("value", load_ms));
+
+    const auto w0 = Clock::now();
+    runner.warmup(width, height);
+    const double warmup_ms = std::chrono::duration<double, std::milli>(Clock::now() - w0).count();
+    out.push_back(Result("first_frame").str("provider", used).size(width, height).str("unit", "ms").num("value", warmup_ms));
+    if (!runner.prepare(width, height, 1)) {
+        out.push_back(failure("models", "prepare failed").str("provider", used).size(width, height));
+        return;
+    }
+
+    FrameJob job;
+    job.prompt = kPrompts[0];
+    job.width = width;
+    job.height = height;
+    job.steps = o.steps;
+    job.guidance_scale = 7.5f;
+
+    if (o.wants("text_encoder")) {
+        // Cache and job state cleared every run, so the encoder really runs (cond only)
+        job.guidance_scale = 1.f;
+        Timing t = time_runs(o.warmup, o.iterations, [&] {
+            runner.embedding_cache().clear();
+            job.encoded_prompt.clear();
+            job.ok = true;
+            return runner.run_encode(job);
+        });
+        Result r("text_encoder");
+        r.str("provider", used).size(width, height);
+        out.push_back(t.ok ? t.into(r) : failure("text_encoder", "run failed").str("provider", used).size(width, height));
+        job.guidance_scale = 7.5f;
+    }
+
+    job.ok = runner.run_encode(job);
+    if (o.wants("unet")) {
+        Timing t = time_runs(o.warmup, o.iterations, [&] { return runner.run_denoise(job); });
+        Result r("unet_step");
+        r.str("provider", used).size(width, height).num("cfg", 1).num("steps_per_run", o.steps);
+        out.push_back(t.ok ? t.into(r, 1.0 / o.steps) : failure("unet_step", "run failed").str("provider", used).size(width, height));
+    } else {
+        job.ok = runner.run_denoise(job);
+    }
+
+    if (o.wants("vae")) {
+        Timing t = time_runs(o.warmup, o.iterations, [&] { return runner.run_decode(job); });
+        Result r("vae_decode");
+        r.str("provider", used).size(width, height);
+        out.push_back(t.ok ? t.into(r) : failure("vae_decode", "run failed").str("provider", used).size(width, height));
+    }
+}
+
+void bench_upload(const Options &o, Renderer *renderer, std::vector<Result> &out) {
+    if (!renderer) {
+        out.push_back(failure("upload_rgba", "no Vulkan device"));
+        return;
+    }
+    std::mt19937 rng(1);
+    for (const auto &[width, height] : o.sizes) {
+        std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+        for (uint8_t &p : rgba) p = static_cast<uint8_t>(rng());
+        const uint32_t w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+        // Upload and wait, so each run covers the staging copy and the GPU transfer
+        Timing t = time_runs(o.warmup, o.iterations, [&] {
+            VkImage image = renderer->uploadImageRGBA(rgba.data(), w, h);
+            if (image == VK_NULL_HANDLE || !renderer->waitImage(image)) return false;
+            renderer->releaseImage(image);
+            return true;
+        });
+        if (!t.ok) {
+            out.push_back(failure("upload_rgba", "upload failed").size(width, height));
+            continue;
+        }
+        double sum = 0.0;
+        for (double ms : t.ms) sum += ms;
+        Result r("upload_rgba");
+        r.size(width, height).num("gb_per_sec", static_cast<double>(rgba.size()) * static_cast<double>(t.ms.size()) / (sum / 1000.0) / 1e9);
+        out.push_back(t.into(r));
+    }
+}
+
+void bench_writer(const Options &o, std::vector<Result> &out) {
+    const auto [width, height] = o.sizes.front();
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    std::mt19937 rng(2);
+    for (uint8_t &p : rgba) p = static_cast<uint8_t>(rng() & 0xf0); // compressible, like a real frame
+    const fs::path dir = fs::temp_directory_path() / "videogen_bench";
+
+    for (EncoderBackend backend : o.encoders) {
+        const std::string name = encoderBackendName(backend);
+        VideoWriterConfig cfg;
+        cfg.backend = backend;
+        cfg.output = (dir / (backend == EncoderBackend::Png ? name : name + (backend == EncoderBackend::Raw ? ".raw" : ".mp4"))).string();
+        fs::create_directories(dir);
+
+        // VideoWriter falls back to PNG when a backend cannot start; probe it
+        // first so that a missing encoder is reported instead of timed
+        {
+            std::unique_ptr<VideoEncoder> probe = VideoEncoder::create(cfg);
+            const bool available = probe->open(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+            if (available) probe->close();
+            if (!available) {
+                out.push_back(failure("writer", "encoder unavailable").str("encoder", name).size(width, height));
+                continue;
+            }
+        }
+
+        const auto t0 = Clock::now();
+        uint64_t failed = 0;
+        {
+            VideoWriter vw(cfg, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+            for (int i = 0; i < o.writer_frames; ++i) vw.writeFrame(rgba.data());
+            vw.flush();
+            failed = vw.failed();
+        } // includes finalizing the container
+        const double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+        out.push_back(Result("writer")
+                          .str("encoder", name)
+                          .size(width, height)
+                          .num("frames", o.writer_frames)
+                          .num("failed", static_cast<double>(failed))
+                          .num("frames_per_sec", o.writer_frames / seconds));
+    }
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+}
+
+// Every stage on its own thread, as in the application; frames are uploaded
+// when there is a Vulkan device and discarded instead of written
+void bench_pipeline(const Options &o, const ProviderConfig &base, ExecutionProvider provider, int width, int height,
+                    Renderer *renderer, std::vector<Result> &out) {
+    ProviderConfig cfg = base;
+    cfg.provider = provider;
+    cfg.shape_width = width;
+    cfg.shape_height = height;
+    RunnerPool pool(o.models_dir, cfg, {}, o.tokenizer_json, width, height);
+    const std::string used = provider_name(pool.runner(0).provider());
+    if (!pool.runner(0).ready()) {
+        out.push_back(failure("pipeline", "models not loaded from " + o.models_dir).str("provider", used).size(width, height));
+        return;
+    }
+    pool.warmup(width, height);
+    if (renderer) {
+        pool.set_upload([renderer, width, height](FrameJob &job) {
+            VkImage image = renderer->uploadImageRGBA(job.rgba.data(), static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+            if (image == VK_NULL_HANDLE) return false;
+            renderer->releaseImage(image);
+            return true;
+        });
+    }
+    pool.set_write([](const FrameJob &) { return true; });
+    if (!pool.start()) {
+        out.push_back(failure("pipeline", "start failed").str("provider", used).size(width, height));
+        return;
+    }
+    const auto t0 = Clock::now();
+    for (int frame = 0; frame < o.pipeline_frames; ++frame) {
+        FrameRequest req;
+        req.prompt = kPrompts[static_cast<size_t>(frame) % std::size(kPrompts)];
+        req.steps = o.steps;
+        req.seed = 1337 + frame;
+        pool.submit(req);
+    }
+    pool.finish();
+    const double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    out.push_back(Result("pipeline")
+                      .str("provider", used)
+                      .size(width, height)
+                      .num("steps", o.steps)
+                      .num("frames", o.pipeline_frames)
+                      .num("failed", static_cast<double>(pool.failed()))
+                      .num("fps", o.pipeline_frames / seconds));
+}
+
+std::string utc_now() {
+    const std::time_t now = std::time(nullptr);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buf;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+#ifndef _WIN32
+    // A dead ffmpeg pipe (VideoEncoder) must fail the write with EPIPE, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    Options o;
+    ProviderConfig provider_cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            std::cerr << "Ignoring argument '" << arg << "' (expected --key=value)" << std::endl;
+            continue;
+        }
+        std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        bool ok = true;
+        if (!apply_bench_option(o, key, value, ok))
+            ok = key == "config" ? load_provider_config(value, provider_cfg) : apply_provider_option(provider_cfg, key, value);
+        if (!ok) std::cerr << "Invalid option '" << arg << "'" << std::endl;
+    }
+    if (o.providers.empty()) o.providers.push_back(provider_cfg.provider);
+
+    // The runner, model cache, pipeline and encoders log to std::cout; send
+    // that to stderr while the benchmarks run so stdout carries only the JSON
+    std::streambuf *stdout_buf = std::cout.rdbuf(std::cerr.rdbuf());
+
+    // Headless: no window, no swapchain
+    VulkanContext vkctx;
+    std::unique_ptr<Renderer> renderer;
+    if ((o.wants("upload") || o.wants("pipeline")) && vkctx.init(false)) {
+        renderer = std::make_unique<Renderer>(&vkctx);
+        if (!renderer->init()) renderer.reset();
+    }
+
+    std::vector<Result> results;
+    if (o.wants("tokenizer")) bench_tokenizer(o, results);
+    if (o.wants("text_encoder") || o.wants("unet") || o.wants("vae")) {
+        for (ExecutionProvider p : o.providers)
+            for (const auto &[w, h] : o.sizes) bench_models(o, provider_cfg, p, w, h, results);
+    }
+    if (o.wants("upload")) bench_upload(o, renderer.get(), results);
+    if (o.wants("writer")) bench_writer(o, results);
+    if (o.wants("pipeline")) {
+        for (ExecutionProvider p : o.providers)
+            for (const auto &[w, h] : o.sizes) bench_pipeline(o, provider_cfg, p, w, h, renderer.get(), results);
+    }
+    renderer.reset();
+    vkctx.cleanup();
+    std::cout.rdbuf(stdout_buf);
+
+    std::ofstream file;
+    if (!o.output.empty()) {
+        file.open(o.output);
+        if (!file) {
+            std::cerr << "Cannot write " << o.output << std::endl;
+            return -1;
+        }
+    }
+    std::ostream &out = o.output.empty() ? std::cout : file;
+    out << "{\n  \"schema\": 1,\n  \"date\": " << Result::quote(utc_now())
+        << ",\n  \"threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << "    ";
+        results[i].write(out);
+        out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    if (!o.output.empty()) std::cout << results.size() << " results written to " << o.output << std::endl;
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "InteropBuffer.hpp"
+#include "VulkanContext.hpp"
+#include <cstring>
+#include <iostream>
+
+#ifdef USE_CUDA
+#include <cuda_runtime_api.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+constexpr VkExternalMemoryHandleTypeFlagBits kHandleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+#else
+constexpr VkExternalMemoryHandleTypeFlagBits kHandleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+#endif
+
+uint32_t findDeviceLocalType(VkPhysicalDevice gpu, uint32_t typeBits) {
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memProps);
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+} // namespace
+
+InteropBuffer::InteropBuffer(VulkanContext* ctx) : ctx_(ctx) {}
+
+InteropBuffer::~InteropBuffer() {
+    destroy();
+}
+
+bool InteropBuffer::supported(const VulkanContext* ctx, int cudaDevice) {
+#ifdef USE_CUDA
+    if (!ctx->hasExternalMemory()) return false;
+    // Both APIs must be talking to the same GPU
+    cudaDeviceProp prop{};
+    if (cudaGetDeviceProperties(&prop, cudaDevice) != cudaSuccess) return false;
+    return std::memcmp(prop.uuid.bytes, ctx->deviceUUID(), VK_UUID_SIZE) == 0;
+#else
+    (void)ctx; (void)cudaDevice;
+    return false;
+#endif
+}
+
+bool InteropBuffer::create(VkDeviceSize bytes, int cudaDevice) {
+    destroy();
+    if (!supported(ctx_, cudaDevice)) {
+        std::cerr << "InteropBuffer: CUDA/Vulkan memory sharing not available\n";
+        return false;
+    }
+#ifdef USE_CUDA
+    VkDevice device = ctx_->device();
+    size_ = bytes;
+
+    VkExternalMemoryBufferCreateInfo ext{};
+    ext.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    ext.handleTypes = kHandleType;
+
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.pNext = &ext;
+    bci.size = bytes;
+    bci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bci, nullptr, &buffer_) != VK_SUCCESS) {
+        destroy();
+        return false;
+    }
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(device, buffer_, &memReq);
+    uint32_t type = findDeviceLocalType(ctx_->physicalDevice(), memReq.memoryTypeBits);
+    if (type == UINT32_MAX) {
+        destroy();
+        return false;
+    }
+
+    // Dedicated: exported memory is imported whole, it cannot come from the arena
+    VkMemoryDedicatedAllocateInfo dedicated{};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated.buffer = buffer_;
+
+    VkExportMemoryAllocateInfo exportInfo{};
+    exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+    exportInfo.pNext = &dedicated;
+    exportInfo.handleTypes = kHandleType;
+
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.pNext = &exportInfo;
+    ai.allocationSize = memReq.size;
+    ai.memoryTypeIndex = type;
+
+    if (vkAllocateMemory(device, &ai, nullptr, &memory_) != VK_SUCCESS ||
+        vkBindBufferMemory(device, buffer_, memory_, 0) != VK_SUCCESS) {
+        destroy();
+        return false;
+    }
+
+    cudaExternalMemoryHandleDesc desc{};
+    desc.size = memReq.size;
+    desc.flags = cudaExternalMemoryDedicated;
+
+#ifdef _WIN32
+    auto getHandle = reinterpret_cast<PFN_vkGetMemoryWin32HandleKHR>(
+        vkGetDeviceProcAddr(device, "vkGetMemoryWin32HandleKHR"));
+    VkMemoryGetWin32HandleInfoKHR hi{};
+    hi.sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR;
+    hi.memory = memory_;
+    hi.handleType = kHandleType;
+    HANDLE handle = nullptr;
+    if (!getHandle || getHandle(device, &hi, &handle) != VK_SUCCESS) {
+        destroy();
+        return false;
+    }
+    desc.type = cudaExternalMemoryHandleTypeOpaqueWin32;
+    desc.handle.win32.handle = handle;
+#else
+    auto getFd = reinterpret_cast<PFN_vkGetMemoryFdKHR>(vkGetDeviceProcAddr(device, "vkGetMemoryFdKHR"));
+    VkMemoryGetFdInfoKHR fi{};
+    fi.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+    fi.memory = memory_;
+    fi.handleType = kHandleType;
+    int fd = -1;
+    if (!getFd || getFd(device, &fi, &fd) != VK_SUCCESS) {
+        destroy();
+        return false;
+    }
+    desc.type = cudaExternalMemoryHandleTypeOpaqueFd;
+    desc.handle.fd = fd;
+#endif
+
+    cudaSetDevice(cudaDevice);
+    cudaExternalMemory_t extMem = nullptr;
+    cudaError_t err = cudaImportExternalMemory(&extMem, &desc);
+#ifdef _WIN32
+    CloseHandle(handle); // CUDA keeps its own reference to Win32 handles
+#endif
+    if (err != cudaSuccess) {
+#ifndef _WIN32
+        close(fd); // on success the fd belongs to CUDA
+#endif
+        std::cerr << "InteropBuffer: cudaImportExternalMemory failed: " << cudaGetErrorString(err) << "\n";
+        destroy();
+        return false;
+    }
+    cudaMemory_ = extMem;
+
+    cudaExternalMemoryBufferDesc bd{};
+    bd.offset = 0;
+    bd.size = bytes;
+    if (cudaExternalMemoryGetMappedBuffer(&devicePtr_, extMem, &bd) != cudaSuccess) {
+        devicePtr_ = nullptr;
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    (void)bytes;
+    return false;
+#endif
+}
+
+void InteropBuffer::destroy() {
+#ifdef USE_CUDA
+    if (devicePtr_) cudaFree(devicePtr_);
+    if (cudaMemory_) cudaDestroyExternalMemory(static_cast<cudaExternalMemory_t>(cudaMemory_));
+#endif
+    devicePtr_ = nullptr;
+    cudaMemory_ = nullptr;
+
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (device) {
+        if (buffer_) vkDestroyBuffer(device, buffer_, nullptr);
+        if (memory_) vkFreeMemory(device, memory_, nullptr);
+    }
+    buffer_ = VK_NULL_HANDLE;
+    memory_ = VK_NULL_HANDLE;
+    size_ = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+class VulkanContext;
+
+// Device memory shared between Vulkan and CUDA. The buffer is allocated by
+// Vulkan as exportable memory (opaque fd / Win32 handle) and imported into
+// CUDA, so inference can write a tensor that the Renderer reads in place,
+// without a round trip through host memory.
+//
+// Needs a USE_CUDA build and VulkanContext::hasExternalMemory(); create()
+// fails otherwise and callers fall back to host uploads.
+class InteropBuffer {
+public:
+    explicit InteropBuffer(VulkanContext* ctx);
+    ~InteropBuffer();
+
+    InteropBuffer(const InteropBuffer&) = delete;
+    InteropBuffer& operator=(const InteropBuffer&) = delete;
+
+    // True when this build and device can share memory with CUDA device `cudaDevice`
+    static bool supported(const VulkanContext* ctx, int cudaDevice);
+
+    bool create(VkDeviceSize bytes, int cudaDevice);
+    void destroy();
+
+    bool isValid() const { return devicePtr_ != nullptr; }
+    VkBuffer buffer() const { return buffer_; }
+    VkDeviceSize size() const { return size_; }
+
+    // CUDA device address of the same bytes
+    void* devicePtr() const { return devicePtr_; }
+
+private:
+    VulkanContext* ctx_;
+    VkBuffer buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    VkDeviceSize size_ = 0;
+    void* devicePtr_ = nullptr;
+    void* cudaMemory_ = nullptr; // cudaExternalMemory_t
+};
@@ -0,0 +1,119 @@
+#include "MemoryArena.hpp"
+#include "VulkanContext.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) {
+    return a > 1 ? (v + a - 1) / a * a : v;
+}
+
+} // namespace
+
+MemoryArena::MemoryArena(VulkanContext* ctx, VkDeviceSize blockSize)
+    : ctx_(ctx), blockSize_(blockSize) {}
+
+MemoryArena::~MemoryArena() {
+    destroy();
+}
+
+void MemoryArena::destroy() {
+    VkDevice device = ctx_->device();
+    for (Block& b : blocks_) {
+        if (device && b.memory) vkFreeMemory(device, b.memory, nullptr);
+    }
+    blocks_.clear();
+}
+
+uint32_t MemoryArena::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags props) const {
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(ctx_->physicalDevice(), &memProps);
+
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & props) == props)
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+bool MemoryArena::allocateFrom(Block& block, const VkMemoryRequirements& req, Allocation& out) {
+    for (size_t i = 0; i < block.freeRanges.size(); i++) {
+        Range& r = block.freeRanges[i];
+        const VkDeviceSize start = alignUp(r.offset, req.alignment);
+        const VkDeviceSize end = start + req.size;
+        if (end > r.offset + r.size) continue;
+
+        // Split the range: the alignment padding in front stays free
+        const Range tail{end, r.offset + r.size - end};
+        if (start > r.offset) {
+            r.size = start - r.offset;
+            if (tail.size) block.freeRanges.insert(block.freeRanges.begin() + static_cast<long>(i) + 1, tail);
+        } else if (tail.size) {
+            r = tail;
+        } else {
+            block.freeRanges.erase(block.freeRanges.begin() + static_cast<long>(i));
+        }
+
+        out.memory = block.memory;
+        out.offset = start;
+        out.size = req.size;
+        return true;
+    }
+    return false;
+}
+
+bool MemoryArena::allocate(const VkMemoryRequirements& req, VkMemoryPropertyFlags props, Allocation& out) {
+    const uint32_t type = findMemoryType(req.memoryTypeBits, props);
+    if (type == UINT32_MAX) return false;
+
+    for (uint32_t i = 0; i < blocks_.size(); i++) {
+        if (blocks_[i].memoryType != type) continue;
+        if (allocateFrom(blocks_[i], req, out)) {
+            out.block = i;
+            return true;
+        }
+    }
+
+    // New block; oversized requests get a block of their own
+    Block block;
+    block.size = std::max(blockSize_, alignUp(req.size, req.alignment));
+    block.memoryType = type;
+
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = block.size;
+    ai.memoryTypeIndex = type;
+    if (vkAllocateMemory(ctx_->device(), &ai, nullptr, &block.memory) != VK_SUCCESS) {
+        std::cerr << "MemoryArena: vkAllocateMemory of " << (block.size >> 20) << " MiB failed\n";
+        return false;
+    }
+    block.freeRanges.push_back({0, block.size});
+    blocks_.push_back(std::move(block));
+
+    out.block = static_cast<uint32_t>(blocks_.size() - 1);
+    return allocateFrom(blocks_.back(), req, out);
+}
+
+void MemoryArena::free(const Allocation& a) {
+    if (!a.memory || a.block >= blocks_.size()) return;
+    std::vector<Range>& ranges = blocks_[a.block].freeRanges;
+
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), a.offset,
+                               [](const Range& r, VkDeviceSize off) { return r.offset < off; });
+    it = ranges.insert(it, Range{a.offset, a.size});
+
+    // Merge with the following range, then with the preceding one
+    auto next = it + 1;
+    if (next != ranges.end() && it->offset + it->size == next->offset) {
+        it->size += next->size;
+        ranges.erase(next);
+    }
+    if (it != ranges.begin()) {
+        auto prev = it - 1;
+        if (prev->offset + prev->size == it->offset) {
+            prev->size += it->size;
+            ranges.erase(it);
+        }
+    }
+}
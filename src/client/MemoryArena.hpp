@@ -0,0 +1,52 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+class VulkanContext;
+
+// Sub-allocates device memory out of a few large VkDeviceMemory blocks, one
+// set per memory type, so that the number of live vkAllocateMemory calls
+// stays tiny regardless of how many images are created. Each block keeps a
+// sorted free list; freed ranges are merged with their neighbours.
+class MemoryArena {
+public:
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t block = 0;
+    };
+
+    explicit MemoryArena(VulkanContext* ctx, VkDeviceSize blockSize = 64ull << 20);
+    ~MemoryArena();
+
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    bool allocate(const VkMemoryRequirements& req, VkMemoryPropertyFlags props, Allocation& out);
+    void free(const Allocation& a);
+    void destroy();
+
+    size_t blockCount() const { return blocks_.size(); }
+
+private:
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryType = 0;
+        std::vector<Range> freeRanges; // sorted by offset
+    };
+
+    VulkanContext* ctx_;
+    VkDeviceSize blockSize_;
+    std::vector<Block> blocks_;
+
+    bool allocateFrom(Block& block, const VkMemoryRequirements& req, Allocation& out);
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags props) const;
+};
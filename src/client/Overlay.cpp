@@ -0,0 +1,326 @@
+#include "Overlay.hpp"
+#include "Swapchain.hpp"
+#include "VulkanContext.hpp"
+#include "Window.hpp"
+#include "../util/Trace.hpp"
+#include "imgui.h"
+#include "imgui_impl_glfw.h"
+#include "imgui_impl_vulkan.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Rates are recomputed this often, so the numbers stay readable
+constexpr auto kRefreshInterval = std::chrono::milliseconds(500);
+
+// Font atlas and user textures; ImGui allocates one set per texture
+constexpr uint32_t kDescriptorSets = 16;
+
+constexpr ImGuiWindowFlags kPanelFlags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                         ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                         ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+
+} // namespace
+
+Overlay::Overlay(VulkanContext* ctx) : ctx_(ctx), frameMs_(kHistory, 0.f) {}
+
+Overlay::~Overlay() {
+    cleanup();
+}
+
+bool Overlay::init(Window* window) {
+    if (contextReady_) return true;
+    if (!window || !window->handle()) return false;
+
+    VkDescriptorPoolSize size{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, kDescriptorSets};
+    VkDescriptorPoolCreateInfo dpi{};
+    dpi.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpi.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    dpi.maxSets = kDescriptorSets;
+    dpi.poolSizeCount = 1;
+    dpi.pPoolSizes = &size;
+    if (vkCreateDescriptorPool(ctx_->device(), &dpi, nullptr, &descriptorPool_) != VK_SUCCESS) {
+        std::cerr << "Overlay: failed to create descriptor pool\n";
+        return false;
+    }
+
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    ImGui::StyleColorsDark();
+    // Chains the callbacks already installed by Window
+    if (!ImGui_ImplGlfw_InitForVulkan(window->handle(), true)) {
+        std::cerr << "Overlay: ImGui GLFW backend init failed\n";
+        ImGui::DestroyContext();
+        vkDestroyDescriptorPool(ctx_->device(), descriptorPool_, nullptr);
+        descriptorPool_ = VK_NULL_HANDLE;
+        return false;
+    }
+    window_ = window;
+    contextReady_ = true;
+    return true;
+}
+
+void Overlay::cleanup() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+    if (backendReady_ || renderPass_) vkDeviceWaitIdle(device);
+
+    destroyFramebuffers();
+    if (backendReady_) ImGui_ImplVulkan_Shutdown();
+    backendReady_ = false;
+    if (contextReady_) {
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+    contextReady_ = false;
+    if (renderPass_) vkDestroyRenderPass(device, renderPass_, nullptr);
+    if (descriptorPool_) vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
+    renderPass_ = VK_NULL_HANDLE;
+    descriptorPool_ = VK_NULL_HANDLE;
+    format_ = VK_FORMAT_UNDEFINED;
+    window_ = nullptr;
+}
+
+bool Overlay::createRenderPass(VkFormat format) {
+    // Draws over the blit: load what is there, hand the image to presentation
+    VkAttachmentDescription color{};
+    color.format = format;
+    color.samples = VK_SAMPLE_COUNT_1_BIT;
+    color.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    color.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    color.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference ref{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &ref;
+
+    // The blit (and the letterbox clear) happen before the pass
+    VkSubpassDependency dep{};
+    dep.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dep.dstSubpass = 0;
+    dep.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dep.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dep.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    dep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo rpi{};
+    rpi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    rpi.attachmentCount = 1;
+    rpi.pAttachments = &color;
+    rpi.subpassCount = 1;
+    rpi.pSubpasses = &subpass;
+    rpi.dependencyCount = 1;
+    rpi.pDependencies = &dep;
+    return vkCreateRenderPass(ctx_->device(), &rpi, nullptr, &renderPass_) == VK_SUCCESS;
+}
+
+bool Overlay::attach(const Swapchain& swapchain) {
+    if (!contextReady_ || !swapchain.isValid()) return false;
+    VkDevice device = ctx_->device();
+    detach();
+
+    // The pipeline ImGui builds is tied to the render pass, hence to the format
+    if (backendReady_ && format_ != swapchain.format()) {
+        vkDeviceWaitIdle(device);
+        ImGui_ImplVulkan_Shutdown();
+        backendReady_ = false;
+        vkDestroyRenderPass(device, renderPass_, nullptr);
+        renderPass_ = VK_NULL_HANDLE;
+    }
+    if (!renderPass_) {
+        if (!createRenderPass(swapchain.format())) {
+            std::cerr << "Overlay: failed to create render pass\n";
+            return false;
+        }
+        format_ = swapchain.format();
+    }
+    if (!backendReady_) {
+        ImGui_ImplVulkan_InitInfo info{};
+        info.Instance = ctx_->instance();
+        info.PhysicalDevice = ctx_->physicalDevice();
+        info.Device = device;
+        info.QueueFamily = ctx_->graphicsQueueFamily();
+        info.Queue = ctx_->graphicsQueue();
+        info.DescriptorPool = descriptorPool_;
+        info.RenderPass = renderPass_;
+        info.PipelineCache = ctx_->pipelineCache();
+        // Vertex buffers are rotated per image; the Renderer keeps fewer frames in flight
+        info.MinImageCount = 2;
+        info.ImageCount = std::max<uint32_t>(2, swapchain.imageCount());
+        info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+        if (!ImGui_ImplVulkan_Init(&info)) {
+            std::cerr << "Overlay: ImGui Vulkan backend init failed\n";
+            return false;
+        }
+        backendReady_ = true;
+    }
+
+    extent_ = swapchain.extent();
+    for (uint32_t i = 0; i < swapchain.imageCount(); i++) {
+        VkImageViewCreateInfo vi{};
+        vi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        vi.image = swapchain.image(i);
+        vi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        vi.format = format_;
+        vi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vi.subresourceRange.levelCount = 1;
+        vi.subresourceRange.layerCount = 1;
+        VkImageView view = VK_NULL_HANDLE;
+        if (vkCreateImageView(device, &vi, nullptr, &view) != VK_SUCCESS) break;
+        views_.push_back(view);
+
+        VkFramebufferCreateInfo fi{};
+        fi.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fi.renderPass = renderPass_;
+        fi.attachmentCount = 1;
+        fi.pAttachments = &view;
+        fi.width = extent_.width;
+        fi.height = extent_.height;
+        fi.layers = 1;
+        VkFramebuffer fb = VK_NULL_HANDLE;
+        if (vkCreateFramebuffer(device, &fi, nullptr, &fb) != VK_SUCCESS) break;
+        framebuffers_.push_back(fb);
+    }
+    if (framebuffers_.size() != swapchain.imageCount()) {
+        std::cerr << "Overlay: failed to create framebuffers\n";
+        destroyFramebuffers();
+        return false;
+    }
+    return true;
+}
+
+void Overlay::detach() {
+    destroyFramebuffers();
+}
+
+void Overlay::destroyFramebuffers() {
+    VkDevice device = ctx_->device();
+    for (VkFramebuffer fb : framebuffers_) vkDestroyFramebuffer(device, fb, nullptr);
+    for (VkImageView view : views_) vkDestroyImageView(device, view, nullptr);
+    framebuffers_.clear();
+    views_.clear();
+}
+
+void Overlay::record(VkCommandBuffer cmd, uint32_t index) {
+    TraceScope span("overlay_record");
+    const Clock::time_point now = Clock::now();
+    if (presented_ > 0) {
+        frameMs_[nextFrame_] = std::chrono::duration<float, std::milli>(now - lastPresent_).count();
+        nextFrame_ = (nextFrame_ + 1) % kHistory;
+    }
+    lastPresent_ = now;
+    ++presented_;
+
+    // The pass also performs the transition to PRESENT_SRC_KHR, so it runs
+    // even before the first update()
+    VkRenderPassBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    bi.renderPass = renderPass_;
+    bi.framebuffer = framebuffers_[index];
+    bi.renderArea.extent = extent_;
+    vkCmdBeginRenderPass(cmd, &bi, VK_SUBPASS_CONTENTS_INLINE);
+    ImDrawData* drawData = ImGui::GetDrawData();
+    if (drawData && drawData->Valid && drawData->CmdListsCount > 0) ImGui_ImplVulkan_RenderDrawData(drawData, cmd);
+    vkCmdEndRenderPass(cmd);
+}
+
+void Overlay::refreshRates(const Stats& stats, Clock::time_point now) {
+    const double seconds = std::chrono::duration<double>(now - windowStart_).count();
+    fps_ = seconds > 0.0 ? static_cast<float>(static_cast<double>(presented_ - windowPresented_) / seconds) : 0.f;
+
+    // Percentiles over the whole history, as plotted
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(presented_ > 0 ? presented_ - 1 : 0, kHistory));
+    if (count > 0) {
+        std::vector<float> sorted;
+        sorted.reserve(count);
+        for (size_t i = 0; i < count; i++) sorted.push_back(frameMs_[(nextFrame_ + kHistory - 1 - i) % kHistory]);
+        std::sort(sorted.begin(), sorted.end());
+        p50Ms_ = sorted[count / 2];
+        p99Ms_ = sorted[std::min(count - 1, count * 99 / 100)];
+    }
+
+    if (windowStages_.size() != stats.stages.size()) windowStages_ = stats.stages;
+    stageMs_.assign(stats.stages.size(), 0.f);
+    for (size_t s = 0; s < stats.stages.size(); s++) {
+        const uint64_t frames = stats.stages[s].frames - windowStages_[s].frames;
+        if (frames > 0)
+            stageMs_[s] = static_cast<float>((stats.stages[s].busyMs - windowStages_[s].busyMs) / static_cast<double>(frames));
+    }
+    windowStages_ = stats.stages;
+
+    const uint64_t hits = stats.cacheHits - windowHits_, misses = stats.cacheMisses - windowMisses_;
+    if (hits + misses > 0) hitRate_ = static_cast<float>(hits) / static_cast<float>(hits + misses);
+    windowHits_ = stats.cacheHits;
+    windowMisses_ = stats.cacheMisses;
+
+    vramKnown_ = ctx_->memoryBudget(vramUsage_, vramBudget_);
+    windowPresented_ = presented_;
+    windowStart_ = now;
+}
+
+void Overlay::update(const Stats& stats, Controls& controls) {
+    if (!backendReady_) return;
+    TraceScope span("overlay");
+    const Clock::time_point start = Clock::now();
+    if (start - windowStart_ >= kRefreshInterval) refreshRates(stats, start);
+
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), ImGuiCond_Always);
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    if (ImGui::Begin("Performance", nullptr, kPanelFlags)) {
+        ImGui::Text("%.1f fps   p50 %.1f ms   p99 %.1f ms", fps_, p50Ms_, p99Ms_);
+        // Oldest first: the ring starts at the next slot to be written
+        const float scale = std::max(p99Ms_ * 1.5f, 1.f);
+        ImGui::PlotHistogram("##frametimes", frameMs_.data(), static_cast<int>(kHistory), static_cast<int>(nextFrame_),
+                             "frame time", 0.f, scale, ImVec2(260.f, 48.f));
+
+        if (!stats.stages.empty() && ImGui::BeginTable("stages", 3, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("stage");
+            ImGui::TableSetupColumn("ms/frame");
+            ImGui::TableSetupColumn("queued");
+            ImGui::TableHeadersRow();
+            for (size_t s = 0; s < stats.stages.size(); s++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", stats.stages[s].name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", s < stageMs_.size() ? stageMs_[s] : 0.f);
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu", stats.stages[s].queued);
+            }
+            ImGui::EndTable();
+        }
+
+        if (vramKnown_)
+            ImGui::Text("VRAM %.0f / %.0f MiB", static_cast<double>(vramUsage_) / (1024.0 * 1024.0),
+                        static_cast<double>(vramBudget_) / (1024.0 * 1024.0));
+        else
+            ImGui::TextDisabled("VRAM n/a (no VK_EXT_memory_budget)");
+        ImGui::Text("Embedding cache %.0f%% hits", hitRate_ * 100.f);
+        ImGui::Text("%d steps, CFG %s, %d in-between(s)", stats.steps, stats.cfg ? "on" : "off", stats.interpolate);
+
+        ImGui::Separator();
+        ImGui::BeginDisabled(!controls.editable);
+        ImGui::SliderInt("steps", &controls.steps, 1, controls.maxSteps, "%d", ImGuiSliderFlags_AlwaysClamp);
+        if (controls.streaming)
+            ImGui::SliderFloat("strength", &controls.strength, 0.05f, 1.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+        ImGui::EndDisabled();
+        if (!controls.editable) ImGui::TextDisabled("settings driven by --target_fps");
+        ImGui::TextDisabled("overlay %.2f ms", updateMs_);
+    }
+    ImGui::End();
+    ImGui::Render();
+
+    updateMs_ = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class VulkanContext;
+class Window;
+class Swapchain;
+
+// Dear ImGui performance overlay over the presented frame. The Renderer
+// records it into the frame's own command buffer right after the blit, as a
+// render pass that loads the blitted image and ends in PRESENT_SRC_KHR, so
+// it adds no submit and no extra copy.
+//
+// Not thread-safe: update() (reads GLFW input, so main thread) and the
+// Renderer's drawFrame() must be serialized by the caller, and so must
+// Window::pollEvents(), since ImGui's GLFW callbacks run inside it.
+class Overlay {
+public:
+    // Cumulative counters as returned by RunnerPool::stats(); the overlay
+    // turns them into rates over its own refresh window
+    struct Stage {
+        const char* name = "";
+        uint64_t frames = 0;
+        double busyMs = 0.0;
+        size_t queued = 0;
+    };
+
+    struct Stats {
+        std::vector<Stage> stages;
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;
+        // Settings of the latest submitted frame
+        int steps = 0;
+        bool cfg = false;
+        int interpolate = 0;
+    };
+
+    // Live settings edited by the sliders; only shown when `editable`
+    struct Controls {
+        bool editable = true;
+        int steps = 1;
+        int maxSteps = 50;
+        bool streaming = false; // strength only applies to img2img streams
+        float strength = 1.f;
+    };
+
+    explicit Overlay(VulkanContext* ctx);
+    ~Overlay();
+
+    Overlay(const Overlay&) = delete;
+    Overlay& operator=(const Overlay&) = delete;
+
+    // Creates the ImGui context and hooks the GLFW input of `window`. The
+    // Vulkan side is built by attach(), once the swapchain format is known.
+    bool init(Window* window);
+    void cleanup();
+
+    // True once attached to a swapchain: update() draws and record() renders
+    bool isActive() const { return backendReady_; }
+
+    // Renderer side: framebuffers for the images of `swapchain`, rebuilt on
+    // every swapchain recreation; detach() before the images go away
+    bool attach(const Swapchain& swapchain);
+    void detach();
+
+    // Renders the latest update() into swapchain image `index`, which must be
+    // in TRANSFER_DST_OPTIMAL; leaves it in PRESENT_SRC_KHR
+    void record(VkCommandBuffer cmd, uint32_t index);
+
+    // Builds the next overlay frame; slider edits are written to `controls`
+    void update(const Stats& stats, Controls& controls);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kHistory = 240; // frame times kept for the plots
+
+    VulkanContext* ctx_;
+    Window* window_ = nullptr;
+    bool contextReady_ = false;
+    bool backendReady_ = false;
+    VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+    VkRenderPass renderPass_ = VK_NULL_HANDLE;
+    VkFormat format_ = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent_{0, 0};
+    std::vector<VkImageView> views_;
+    std::vector<VkFramebuffer> framebuffers_;
+
+    // Presented frames, fed by record()
+    std::vector<float> frameMs_;
+    size_t nextFrame_ = 0;
+    Clock::time_point lastPresent_{};
+    uint64_t presented_ = 0;
+
+    // Rates over the last refresh window
+    Clock::time_point windowStart_{};
+    uint64_t windowPresented_ = 0;
+    std::vector<Stage> windowStages_;
+    uint64_t windowHits_ = 0;
+    uint64_t windowMisses_ = 0;
+    float fps_ = 0.f;
+    float p50Ms_ = 0.f;
+    float p99Ms_ = 0.f;
+    std::vector<float> stageMs_;
+    float hitRate_ = 0.f;
+    VkDeviceSize vramUsage_ = 0;
+    VkDeviceSize vramBudget_ = 0;
+    bool vramKnown_ = false;
+    float updateMs_ = 0.f; // CPU cost of the previous update()
+
+    bool createRenderPass(VkFormat format);
+    void destroyFramebuffers();
+    void refreshRates(const Stats& stats, Clock::time_point now);
+};
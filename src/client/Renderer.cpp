@@ -1,28 +1,361 @@
 #include "Renderer.hpp"
+#include "Overlay.hpp"
 #include "VulkanContext.hpp"
+#include "Window.hpp"
+#include "../util/MappedFile.hpp"
+#include "../util/Trace.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-Renderer::Renderer(VulkanContext* ctx) : ctx_(ctx) {}
+namespace {
+
+constexpr uint32_t kNoMemoryType = UINT32_MAX;
+
+// Covers optimalBufferCopyOffsetAlignment and nonCoherentAtomSize on every
+// implementation we care about
+constexpr VkDeviceSize kStagingAlignment = 256;
+
+// Built by the Shaders target next to the executable
+constexpr const char* kConvertShader = "shaders/latent_to_rgba.comp.glsl.spv";
+constexpr uint32_t kConvertGroupSize = 16;
+
+// Push constants of latent_to_rgba.comp.glsl
+struct ConvertParams {
+    uint32_t width;
+    uint32_t height;
+    uint32_t toneMap;
+    float exposure;
+    float contrast;
+    float saturation;
+    float gamma;
+};
+
+constexpr const char* kInterpolateShader = "shaders/interpolate.comp.glsl.spv";
+constexpr uint32_t kInterpolateGroupSize = 8; // also the motion block size
+constexpr int kInterpolateRange = 16;         // motion search radius in pixels
+
+// Push constants of interpolate.comp.glsl
+struct InterpolateParams {
+    uint32_t width;
+    uint32_t height;
+    uint32_t blocksX;
+    uint32_t blocksY;
+    float t;
+    float pad;
+};
+
+// Specialization constants 0..N-1 of a compute shader, all 32-bit (bools as
+// VkBool32). Workgroup sizes, block sizes and per-variant switches are baked
+// in at pipeline creation, so the shaders carry no branches on them.
+template <uint32_t N>
+struct SpecConstants {
+    uint32_t values[N];
+    VkSpecializationMapEntry entries[N];
+
+    VkSpecializationInfo info() {
+        for (uint32_t i = 0; i < N; ++i) entries[i] = {i, i * 4u, sizeof(uint32_t)};
+        return {N, entries, sizeof(values), values};
+    }
+};
+
+// After a failed submit the fence stays unsignaled; replace it so the next
+// wait on the slot does not hang
+void recreateSignaledFence(VkDevice device, VkFence& fence) {
+    vkDestroyFence(device, fence, nullptr);
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    vkCreateFence(device, &fci, nullptr, &fence);
+}
+
+VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) {
+    return (v + a - 1) / a * a;
+}
+
+} // namespace
+
+Renderer::Renderer(VulkanContext* ctx) : ctx_(ctx), arena_(ctx), swapchain_(ctx) {}
 
 Renderer::~Renderer() {
     cleanup();
 }
 
 bool Renderer::init() {
+    uploadTimeline_ = ctx_->createTimelineSemaphore();
+    renderTimeline_ = ctx_->createTimelineSemaphore();
+    convertTimeline_ = ctx_->createTimelineSemaphore();
+    if (!uploadTimeline_ || !renderTimeline_ || !convertTimeline_) {
+        std::cerr << "Renderer: failed to create timeline semaphores\n";
+        return false;
+    }
+    if (ctx_->hasAsyncTransfer())
+        std::cout << "Renderer: uploads on the dedicated transfer queue\n";
     return true;
 }
 
-void Renderer::cleanup() {}
+void Renderer::cleanup() {
+    destroyPresentation();
+    destroyStagingRing();
+    destroyConvertPipeline();
+    destroyInterpolatePipeline();
+    destroyReadback();
+    destroyImages();
+    arena_.destroy();
 
-VkImage Renderer::uploadImageRGBA(const uint8_t* data, uint32_t width, uint32_t height,
-                                  VkDeviceMemory* outMemory)
-{
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (device) {
+        if (timestampPool_) vkDestroyQueryPool(device, timestampPool_, nullptr);
+        if (uploadTimeline_) vkDestroySemaphore(device, uploadTimeline_, nullptr);
+        if (renderTimeline_) vkDestroySemaphore(device, renderTimeline_, nullptr);
+        if (convertTimeline_) vkDestroySemaphore(device, convertTimeline_, nullptr);
+    }
+    uploadTimeline_ = VK_NULL_HANDLE;
+    renderTimeline_ = VK_NULL_HANDLE;
+    convertTimeline_ = VK_NULL_HANDLE;
+    timestampPool_ = VK_NULL_HANDLE;
+    for (GpuTimer& t : timers_) t = GpuTimer{};
+}
+
+bool Renderer::initTiming() {
+    if (timestampPool_) return true;
+    if (ctx_->timestampBits(ctx_->graphicsQueueFamily()) == 0 || ctx_->timestampPeriod() <= 0.f) {
+        std::cerr << "Renderer: no GPU timestamps on this device\n";
+        return false;
+    }
+    timestampPool_ = ctx_->createTimestampPool(2 * kTimerCount);
+    if (!timestampPool_) {
+        std::cerr << "Renderer: failed to create timestamp query pool (needs hostQueryReset)\n";
+        return false;
+    }
+    return true;
+}
+
+void Renderer::beginTimer(VkCommandBuffer cmd, uint32_t timer, uint32_t family) {
+    GpuTimer& t = timers_[timer];
+    const uint32_t bits = ctx_->timestampBits(family);
+    t.mask = timestampPool_ && Trace::enabled() && bits > 0 ? (bits >= 64 ? ~0ull : (1ull << bits) - 1) : 0;
+    t.pending = false;
+    if (!t.mask) return;
+    // The timer's previous submit has completed (its slot fence was waited on)
+    vkResetQueryPool(ctx_->device(), timestampPool_, 2 * timer, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_, 2 * timer);
+}
+
+void Renderer::endTimer(VkCommandBuffer cmd, uint32_t timer, const char* name, const char* queue) {
+    GpuTimer& t = timers_[timer];
+    if (!t.mask) return;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_, 2 * timer + 1);
+    t.name = name;
+    t.queue = queue;
+    t.pending = true; // a failed submit leaves the queries unavailable; collectTimer skips them
+}
+
+// Call once the fence of the timer's last submit has signaled
+void Renderer::collectTimer(uint32_t timer) {
+    GpuTimer& t = timers_[timer];
+    if (!t.pending) return;
+    t.pending = false;
+    uint64_t ticks[2] = {};
+    if (vkGetQueryPoolResults(ctx_->device(), timestampPool_, 2 * timer, 2, sizeof(ticks), ticks, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    // GPU and CPU clocks are aligned on the smallest observed gap between a
+    // span's end and the CPU seeing it, which converges on the true offset
+    const double tickUs = ctx_->timestampPeriod() / 1000.0;
+    const int64_t beginUs = static_cast<int64_t>(static_cast<double>(ticks[0] & t.mask) * tickUs);
+    const int64_t durationUs = static_cast<int64_t>(static_cast<double>((ticks[1] - ticks[0]) & t.mask) * tickUs);
+    const int64_t offset = Trace::to_us(Trace::Clock::now()) - (beginUs + durationUs);
+    if (!gpuOffsetSet_ || offset < gpuOffsetUs_) gpuOffsetUs_ = offset;
+    gpuOffsetSet_ = true;
+    Trace::record_gpu(t.name, t.queue, beginUs + gpuOffsetUs_, durationUs);
+}
+
+uint32_t Renderer::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags props) const {
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(ctx_->physicalDevice(), &memProps);
+
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & props) == props)
+            return i;
+    }
+    return kNoMemoryType;
+}
+
+bool Renderer::createStagingRing(VkDeviceSize slotSize) {
+    destroyStagingRing();
+    VkDevice device = ctx_->device();
+
+    stagingSlotSize_ = alignUp(slotSize, kStagingAlignment);
+
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = stagingSlotSize_ * kUploadSlots;
+    bci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bci, nullptr, &stagingBuffer_) != VK_SUCCESS)
+        return false;
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(device, stagingBuffer_, &memReq);
+
+    // Prefer coherent memory; otherwise every write is flushed explicitly
+    uint32_t type = findMemoryType(memReq.memoryTypeBits,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingCoherent_ = type != kNoMemoryType;
+    if (!stagingCoherent_)
+        type = findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (type == kNoMemoryType) {
+        std::cerr << "Renderer: no host-visible memory for staging\n";
+        destroyStagingRing();
+        return false;
+    }
+
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = memReq.size;
+    ai.memoryTypeIndex = type;
+
+    if (vkAllocateMemory(device, &ai, nullptr, &stagingMemory_) != VK_SUCCESS) {
+        destroyStagingRing();
+        return false;
+    }
+    vkBindBufferMemory(device, stagingBuffer_, stagingMemory_, 0);
+
+    void* mapped = nullptr;
+    if (vkMapMemory(device, stagingMemory_, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        destroyStagingRing();
+        return false;
+    }
+    stagingMapped_ = static_cast<uint8_t*>(mapped);
+
+    VkCommandBufferAllocateInfo cai{};
+    cai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cai.commandPool = ctx_->transferCommandPool();
+    cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cai.commandBufferCount = 1;
+
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (uint32_t i = 0; i < kUploadSlots; i++) {
+        UploadSlot& slot = uploadSlots_[i];
+        slot.offset = stagingSlotSize_ * i;
+        if (vkAllocateCommandBuffers(device, &cai, &slot.cmd) != VK_SUCCESS ||
+            vkCreateFence(device, &fci, nullptr, &slot.fence) != VK_SUCCESS) {
+            destroyStagingRing();
+            return false;
+        }
+    }
+    nextUploadSlot_ = 0;
+    return true;
+}
+
+void Renderer::destroyStagingRing() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    for (UploadSlot& slot : uploadSlots_) {
+        if (slot.fence) {
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(device, slot.fence, nullptr);
+        }
+        if (slot.cmd) vkFreeCommandBuffers(device, ctx_->transferCommandPool(), 1, &slot.cmd);
+        slot = UploadSlot{};
+    }
+    if (stagingMapped_) vkUnmapMemory(device, stagingMemory_);
+    if (stagingBuffer_) vkDestroyBuffer(device, stagingBuffer_, nullptr);
+    if (stagingMemory_) vkFreeMemory(device, stagingMemory_, nullptr);
+    stagingMapped_ = nullptr;
+    stagingBuffer_ = VK_NULL_HANDLE;
+    stagingMemory_ = VK_NULL_HANDLE;
+    stagingSlotSize_ = 0;
+}
+
+bool Renderer::recordUpload(UploadSlot& slot, PooledImage& image) {
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(slot.cmd, 0);
+    if (vkBeginCommandBuffer(slot.cmd, &bi) != VK_SUCCESS)
+        return false;
+    const uint32_t timer = kUploadTimers + static_cast<uint32_t>(&slot - uploadSlots_);
+    beginTimer(slot.cmd, timer, ctx_->transferQueueFamily());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    // UNDEFINED -> TRANSFER_DST: the previous contents are overwritten anyway.
+    // Earlier readers of a recycled image are covered by the renderTimeline_
+    // wait on this submit; this orders the copy after prior work on this queue.
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = slot.offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {image.width, image.height, 1};
+    vkCmdCopyBufferToImage(slot.cmd, stagingBuffer_, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // TRANSFER_DST -> SHADER_READ_ONLY for sampling / blitting in drawFrame.
+    // A transfer-only queue cannot name shader stages; the reader's wait on
+    // uploadTimeline_ provides the visibility instead.
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+    endTimer(slot.cmd, timer, "upload_copy", "transfer");
+
+    if (vkEndCommandBuffer(slot.cmd) != VK_SUCCESS)
+        return false;
+
+    const uint64_t value = uploadValue_ + 1;
+    if (!ctx_->submit(ctx_->transferQueue(), slot.cmd,
+                      renderTimeline_, image.releaseValue, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      uploadTimeline_, value, slot.fence))
+        return false;
+    uploadValue_ = value;
+    image.readyTimeline = uploadTimeline_;
+    image.uploadValue = value;
+    return true;
+}
+
+Renderer::PooledImage* Renderer::acquireImage(uint32_t width, uint32_t height, VkFormat format) {
+    for (PooledImage& p : images_) {
+        if (!p.inUse && p.width == width && p.height == height && p.format == format) {
+            p.inUse = true;
+            return &p;
+        }
+    }
+
+    // Pool miss: only happens while the pool warms up or the resolution changes
     VkDevice device = ctx_->device();
+    PooledImage p;
+    p.width = width;
+    p.height = height;
+    p.format = format;
 
     VkImageCreateInfo ci{};
     ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     ci.imageType = VK_IMAGE_TYPE_2D;
-    ci.format = VK_FORMAT_R8G8B8A8_UNORM;
+    ci.format = format;
     ci.extent.width = width;
     ci.extent.height = height;
     ci.extent.depth = 1;
@@ -30,47 +363,1233 @@ VkImage Renderer::uploadImageRGBA(const uint8_t* data, uint32_t width, uint32_t
     ci.arrayLayers = 1;
     ci.samples = VK_SAMPLE_COUNT_1_BIT;
     ci.tiling = VK_IMAGE_TILING_OPTIMAL;
-    ci.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    ci.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+               VK_IMAGE_USAGE_STORAGE_BIT;
+
+    // Written on the transfer or compute queue, read on graphics: concurrent
+    // sharing avoids queue family ownership transfers
+    const std::vector<uint32_t>& families = ctx_->queueFamilies();
+    if (families.size() > 1) {
+        ci.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        ci.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+        ci.pQueueFamilyIndices = families.data();
+    }
+
+    if (vkCreateImage(device, &ci, nullptr, &p.image) != VK_SUCCESS)
+        return nullptr;
+
+    VkMemoryRequirements memReq;
+    vkGetImageMemoryRequirements(device, p.image, &memReq);
+
+    if (!arena_.allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, p.memory) ||
+        vkBindImageMemory(device, p.image, p.memory.memory, p.memory.offset) != VK_SUCCESS) {
+        arena_.free(p.memory);
+        vkDestroyImage(device, p.image, nullptr);
+        return nullptr;
+    }
+
+    p.inUse = true;
+    images_.push_back(p);
+    return &images_.back();
+}
 
-    VkImage image;
-    if (vkCreateImage(device, &ci, nullptr, &image) != VK_SUCCESS)
+Renderer::PooledImage* Renderer::findImage(VkImage image) {
+    for (PooledImage& p : images_) {
+        if (p.image == image) return &p;
+    }
+    return nullptr;
+}
+
+void Renderer::releaseImage(VkImage image) {
+    if (PooledImage* p = findImage(image)) {
+        // Everything submitted so far may still read it
+        p->releaseValue = renderValue_;
+        p->inUse = false;
+    }
+}
+
+void Renderer::destroyImages() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    if (!images_.empty()) vkDeviceWaitIdle(device);
+    for (PooledImage& p : images_) {
+        if (p.view) vkDestroyImageView(device, p.view, nullptr);
+        vkDestroyImage(device, p.image, nullptr);
+        arena_.free(p.memory);
+    }
+    images_.clear();
+}
+
+VkImage Renderer::uploadImageRGBA(const uint8_t* data, uint32_t width, uint32_t height)
+{
+    VkDevice device = ctx_->device();
+    const VkDeviceSize bytes = static_cast<VkDeviceSize>(width) * height * 4;
+
+    // Sized for the current frame size; only rebuilt when frames get bigger
+    if (bytes > stagingSlotSize_ && !createStagingRing(bytes)) {
+        std::cerr << "Renderer: failed to create staging ring\n";
+        return VK_NULL_HANDLE;
+    }
+
+    PooledImage* target = acquireImage(width, height, VK_FORMAT_R8G8B8A8_UNORM);
+    if (!target) {
+        std::cerr << "Renderer: failed to create frame image\n";
         return VK_NULL_HANDLE;
+    }
+
+    // Wait until the GPU is done with the copy that last used this slot
+    const uint32_t slotIndex = nextUploadSlot_;
+    UploadSlot& slot = uploadSlots_[slotIndex];
+    nextUploadSlot_ = (nextUploadSlot_ + 1) % kUploadSlots;
+    vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &slot.fence);
+    collectTimer(kUploadTimers + slotIndex);
+
+    std::memcpy(stagingMapped_ + slot.offset, data, static_cast<size_t>(bytes));
+    if (!stagingCoherent_) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = stagingMemory_;
+        range.offset = slot.offset;
+        range.size = stagingSlotSize_;
+        vkFlushMappedMemoryRanges(device, 1, &range);
+    }
+
+    if (!recordUpload(slot, *target)) {
+        std::cerr << "Renderer: upload submit failed\n";
+        recreateSignaledFence(device, slot.fence);
+        releaseImage(target->image);
+        return VK_NULL_HANDLE;
+    }
+
+    return target->image;
+}
+
+// One pipeline per entry of `variants`, all from the same module, in one call
+// through the context's pipeline cache
+bool Renderer::createComputePipelines(const char* shader, VkPipelineLayout layout,
+                                      const VkSpecializationInfo* variants, uint32_t count, VkPipeline* pipelines) {
+    VkDevice device = ctx_->device();
+
+    MappedFile spirv;
+    if (!spirv.open(shader) || spirv.size() % 4 != 0) {
+        std::cerr << "Renderer: failed to load " << shader << "\n";
+        return false;
+    }
+
+    VkShaderModuleCreateInfo smi{};
+    smi.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    smi.codeSize = spirv.size();
+    smi.pCode = reinterpret_cast<const uint32_t*>(spirv.data());
+    VkShaderModule module = VK_NULL_HANDLE;
+    if (vkCreateShaderModule(device, &smi, nullptr, &module) != VK_SUCCESS)
+        return false;
+
+    std::vector<VkComputePipelineCreateInfo> cpis(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        VkComputePipelineCreateInfo& cpi = cpis[i];
+        cpi.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        cpi.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        cpi.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        cpi.stage.module = module;
+        cpi.stage.pName = "main";
+        cpi.stage.pSpecializationInfo = &variants[i];
+        cpi.layout = layout;
+    }
+    VkResult res = vkCreateComputePipelines(device, ctx_->pipelineCache(), count, cpis.data(), nullptr, pipelines);
+    vkDestroyShaderModule(device, module, nullptr);
+    if (res == VK_SUCCESS) return true;
+    // Creation may fail part way; whatever did get built is released here
+    for (uint32_t i = 0; i < count; ++i) {
+        if (pipelines[i]) vkDestroyPipeline(device, pipelines[i], nullptr);
+        pipelines[i] = VK_NULL_HANDLE;
+    }
+    return false;
+}
+
+bool Renderer::ensureView(PooledImage& image) {
+    if (image.view) return true;
+    VkImageViewCreateInfo vi{};
+    vi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    vi.image = image.image;
+    vi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    vi.format = image.format;
+    vi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    vi.subresourceRange.levelCount = 1;
+    vi.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(ctx_->device(), &vi, nullptr, &image.view) != VK_SUCCESS) {
+        image.view = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+bool Renderer::createConvertPipeline() {
+    VkDevice device = ctx_->device();
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo dli{};
+    dli.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    dli.bindingCount = 2;
+    dli.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(device, &dli, nullptr, &convertSetLayout_) != VK_SUCCESS)
+        return false;
+
+    VkPushConstantRange push{};
+    push.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push.size = sizeof(ConvertParams);
+
+    VkPipelineLayoutCreateInfo pli{};
+    pli.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pli.setLayoutCount = 1;
+    pli.pSetLayouts = &convertSetLayout_;
+    pli.pushConstantRangeCount = 1;
+    pli.pPushConstantRanges = &push;
+    if (vkCreatePipelineLayout(device, &pli, nullptr, &convertPipelineLayout_) != VK_SUCCESS)
+        return false;
+
+    // One variant per input type: fp32 tensors from the host, fp16 ones from CUDA
+    SpecConstants<3> fp32{{kConvertGroupSize, kConvertGroupSize, VK_FALSE}, {}};
+    SpecConstants<3> fp16{{kConvertGroupSize, kConvertGroupSize, VK_TRUE}, {}};
+    const VkSpecializationInfo variants[2] = {fp32.info(), fp16.info()};
+    if (!createComputePipelines(kConvertShader, convertPipelineLayout_, variants, 2, convertPipelines_))
+        return false;
+
+    VkDescriptorPoolSize sizes[2] = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kUploadSlots},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kUploadSlots},
+    };
+    VkDescriptorPoolCreateInfo dpi{};
+    dpi.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpi.maxSets = kUploadSlots;
+    dpi.poolSizeCount = 2;
+    dpi.pPoolSizes = sizes;
+    if (vkCreateDescriptorPool(device, &dpi, nullptr, &convertDescriptorPool_) != VK_SUCCESS)
+        return false;
+
+    VkCommandBufferAllocateInfo cai{};
+    cai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cai.commandPool = ctx_->computeCommandPool();
+    cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cai.commandBufferCount = 1;
+
+    VkDescriptorSetAllocateInfo dai{};
+    dai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dai.descriptorPool = convertDescriptorPool_;
+    dai.descriptorSetCount = 1;
+    dai.pSetLayouts = &convertSetLayout_;
+
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (ConvertSlot& slot : convertSlots_) {
+        if (vkAllocateCommandBuffers(device, &cai, &slot.cmd) != VK_SUCCESS ||
+            vkAllocateDescriptorSets(device, &dai, &slot.set) != VK_SUCCESS ||
+            vkCreateFence(device, &fci, nullptr, &slot.fence) != VK_SUCCESS)
+            return false;
+    }
+    nextConvertSlot_ = 0;
+    return true;
+}
+
+void Renderer::destroyConvertPipeline() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    for (ConvertSlot& slot : convertSlots_) {
+        if (slot.fence) {
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(device, slot.fence, nullptr);
+        }
+        if (slot.cmd) vkFreeCommandBuffers(device, ctx_->computeCommandPool(), 1, &slot.cmd);
+        if (slot.input) vkDestroyBuffer(device, slot.input, nullptr);
+        arena_.free(slot.inputMemory);
+        slot = ConvertSlot{}; // sets go with the pool
+    }
+    if (convertDescriptorPool_) vkDestroyDescriptorPool(device, convertDescriptorPool_, nullptr);
+    for (VkPipeline& pipeline : convertPipelines_) {
+        if (pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+    if (convertPipelineLayout_) vkDestroyPipelineLayout(device, convertPipelineLayout_, nullptr);
+    if (convertSetLayout_) vkDestroyDescriptorSetLayout(device, convertSetLayout_, nullptr);
+    convertDescriptorPool_ = VK_NULL_HANDLE;
+    convertPipelineLayout_ = VK_NULL_HANDLE;
+    convertSetLayout_ = VK_NULL_HANDLE;
+}
+
+bool Renderer::createConvertInput(ConvertSlot& slot, VkDeviceSize size) {
+    VkDevice device = ctx_->device();
+    if (slot.input) vkDestroyBuffer(device, slot.input, nullptr);
+    arena_.free(slot.inputMemory);
+    slot.input = VK_NULL_HANDLE;
+    slot.inputSize = 0;
+
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = size;
+    bci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    // Filled on the transfer queue, read on the compute queue
+    const std::vector<uint32_t>& families = ctx_->queueFamilies();
+    if (families.size() > 1) {
+        bci.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bci.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+        bci.pQueueFamilyIndices = families.data();
+    }
+    if (vkCreateBuffer(device, &bci, nullptr, &slot.input) != VK_SUCCESS) {
+        slot.input = VK_NULL_HANDLE;
+        return false;
+    }
 
     VkMemoryRequirements memReq;
-    vkGetImageMemoryRequirements(device, image, &memReq);
+    vkGetBufferMemoryRequirements(device, slot.input, &memReq);
+    if (!arena_.allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.inputMemory) ||
+        vkBindBufferMemory(device, slot.input, slot.inputMemory.memory, slot.inputMemory.offset) != VK_SUCCESS) {
+        arena_.free(slot.inputMemory);
+        vkDestroyBuffer(device, slot.input, nullptr);
+        slot.input = VK_NULL_HANDLE;
+        return false;
+    }
+    slot.inputSize = size;
+    return true;
+}
 
-    VkMemoryAllocateInfo ai{};
-    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    ai.allocationSize = memReq.size;
-    ai.memoryTypeIndex = 0;
+// Copies host bytes into a device buffer through the staging ring. The copy
+// waits for renderTimeline_ to reach waitRenderValue, so the conversion that
+// follows it on uploadTimeline_ is ordered after earlier readers of its target.
+bool Renderer::uploadBuffer(const void* data, VkDeviceSize bytes, VkBuffer dst, uint64_t waitRenderValue) {
+    VkDevice device = ctx_->device();
+    if (bytes > stagingSlotSize_ && !createStagingRing(bytes)) {
+        std::cerr << "Renderer: failed to create staging ring\n";
+        return false;
+    }
 
-    VkPhysicalDeviceMemoryProperties memProps;
-    vkGetPhysicalDeviceMemoryProperties(ctx_->physicalDevice(), &memProps);
+    const uint32_t slotIndex = nextUploadSlot_;
+    UploadSlot& slot = uploadSlots_[slotIndex];
+    nextUploadSlot_ = (nextUploadSlot_ + 1) % kUploadSlots;
+    vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &slot.fence);
+    collectTimer(kUploadTimers + slotIndex);
 
-    bool found = false;
-    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
-        if ((memReq.memoryTypeBits & (1 << i)) &&
-            (memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-            ai.memoryTypeIndex = i;
-            found = true;
-            break;
+    std::memcpy(stagingMapped_ + slot.offset, data, static_cast<size_t>(bytes));
+    if (!stagingCoherent_) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = stagingMemory_;
+        range.offset = slot.offset;
+        range.size = stagingSlotSize_;
+        vkFlushMappedMemoryRanges(device, 1, &range);
+    }
+
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkResetCommandBuffer(slot.cmd, 0);
+    vkBeginCommandBuffer(slot.cmd, &bi);
+    beginTimer(slot.cmd, kUploadTimers + slotIndex, ctx_->transferQueueFamily());
+    VkBufferCopy region{slot.offset, 0, bytes};
+    vkCmdCopyBuffer(slot.cmd, stagingBuffer_, dst, 1, &region);
+    endTimer(slot.cmd, kUploadTimers + slotIndex, "upload_copy", "transfer");
+    vkEndCommandBuffer(slot.cmd);
+
+    const uint64_t value = uploadValue_ + 1;
+    if (!ctx_->submit(ctx_->transferQueue(), slot.cmd,
+                      renderTimeline_, waitRenderValue, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      uploadTimeline_, value, slot.fence)) {
+        recreateSignaledFence(device, slot.fence);
+        return false;
+    }
+    uploadValue_ = value;
+    return true;
+}
+
+bool Renderer::recordConvert(ConvertSlot& slot, VkBuffer src, PooledImage& image, bool fp16,
+                             VkSemaphore waitSemaphore, uint64_t waitValue) {
+    VkDevice device = ctx_->device();
+
+    VkDescriptorBufferInfo bufferInfo{src, 0, VK_WHOLE_SIZE};
+    VkDescriptorImageInfo imageInfo{VK_NULL_HANDLE, image.view, VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = slot.set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &bufferInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = slot.set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(slot.cmd, 0);
+    if (vkBeginCommandBuffer(slot.cmd, &bi) != VK_SUCCESS)
+        return false;
+    const uint32_t timer = kConvertTimers + static_cast<uint32_t>(&slot - convertSlots_);
+    beginTimer(slot.cmd, timer, ctx_->computeQueueFamily());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Uploaded tensors are made visible by the uploadTimeline_ wait; CUDA
+    // writes finished before this was recorded (the decoder run synchronizes
+    // its stream). Either way the buffer needs no barrier here.
+    const ConvertParams params{image.width, image.height, grade_.toneMap ? 1u : 0u,
+                               grade_.exposure, grade_.contrast, grade_.saturation, std::max(grade_.gamma, 0.01f)};
+    vkCmdBindPipeline(slot.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, convertPipelines_[fp16 ? 1 : 0]);
+    vkCmdBindDescriptorSets(slot.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, convertPipelineLayout_, 0, 1, &slot.set, 0, nullptr);
+    vkCmdPushConstants(slot.cmd, convertPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(slot.cmd, (image.width + kConvertGroupSize - 1) / kConvertGroupSize,
+                  (image.height + kConvertGroupSize - 1) / kConvertGroupSize, 1);
+
+    // Same resting layout as an uploaded image
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+    endTimer(slot.cmd, timer, "convert", "compute");
+
+    if (vkEndCommandBuffer(slot.cmd) != VK_SUCCESS)
+        return false;
+
+    const uint64_t value = convertValue_ + 1;
+    if (!ctx_->submit(ctx_->computeQueue(), slot.cmd,
+                      waitSemaphore, waitValue, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      convertTimeline_, value, slot.fence))
+        return false;
+    convertValue_ = value;
+    image.readyTimeline = convertTimeline_;
+    image.uploadValue = value;
+    return true;
+}
+
+VkImage Renderer::convertImageNCHW(VkBuffer src, uint32_t width, uint32_t height, bool fp16) {
+    return convertImage(src, width, height, fp16, nullptr);
+}
+
+VkImage Renderer::uploadImageNCHW(const float* data, uint32_t width, uint32_t height) {
+    return convertImage(VK_NULL_HANDLE, width, height, false, data);
+}
+
+bool Renderer::initConversion() {
+    if (convertPipelines_[0]) return true;
+    if (createConvertPipeline()) return true;
+    std::cerr << "Renderer: failed to create conversion pipeline\n";
+    destroyConvertPipeline();
+    return false;
+}
+
+VkImage Renderer::convertImage(VkBuffer src, uint32_t width, uint32_t height, bool fp16, const float* hostData) {
+    VkDevice device = ctx_->device();
+    if (!initConversion()) return VK_NULL_HANDLE;
+
+    PooledImage* target = acquireImage(width, height, VK_FORMAT_R8G8B8A8_UNORM);
+    if (!target) {
+        std::cerr << "Renderer: failed to create frame image\n";
+        return VK_NULL_HANDLE;
+    }
+    if (!ensureView(*target)) {
+        releaseImage(target->image);
+        return VK_NULL_HANDLE;
+    }
+
+    // The slot's descriptor set and input buffer may only be rewritten once
+    // its last dispatch is done
+    const uint32_t slotIndex = nextConvertSlot_;
+    ConvertSlot& slot = convertSlots_[slotIndex];
+    nextConvertSlot_ = (nextConvertSlot_ + 1) % kUploadSlots;
+    vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+    collectTimer(kConvertTimers + slotIndex);
+
+    // Device tensors only have to wait for earlier readers of the target;
+    // host tensors wait for their copy, which itself waits for those readers
+    VkSemaphore waitSemaphore = renderTimeline_;
+    uint64_t waitValue = target->releaseValue;
+    if (hostData) {
+        const VkDeviceSize bytes = static_cast<VkDeviceSize>(width) * height * 3 * sizeof(float);
+        if ((bytes > slot.inputSize && !createConvertInput(slot, bytes)) ||
+            !uploadBuffer(hostData, bytes, slot.input, target->releaseValue)) {
+            std::cerr << "Renderer: tensor upload failed\n";
+            releaseImage(target->image);
+            return VK_NULL_HANDLE;
+        }
+        src = slot.input;
+        waitSemaphore = uploadTimeline_;
+        waitValue = uploadValue_;
+    }
+
+    vkResetFences(device, 1, &slot.fence);
+    if (!recordConvert(slot, src, *target, fp16, waitSemaphore, waitValue)) {
+        std::cerr << "Renderer: conversion submit failed\n";
+        recreateSignaledFence(device, slot.fence);
+        releaseImage(target->image);
+        return VK_NULL_HANDLE;
+    }
+    return target->image;
+}
+
+bool Renderer::waitImage(VkImage image) {
+    const PooledImage* p = findImage(image);
+    if (!p) return false;
+    return !p->readyTimeline || ctx_->waitTimeline(p->readyTimeline, p->uploadValue);
+}
+
+bool Renderer::createInterpolatePipeline() {
+    VkDevice device = ctx_->device();
+
+    VkDescriptorSetLayoutBinding bindings[4]{};
+    const VkDescriptorType types[4] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    for (uint32_t i = 0; i < 4; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo dli{};
+    dli.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    dli.bindingCount = 4;
+    dli.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(device, &dli, nullptr, &interpSetLayout_) != VK_SUCCESS)
+        return false;
+
+    VkPushConstantRange push{};
+    push.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push.size = sizeof(InterpolateParams);
+
+    VkPipelineLayoutCreateInfo pli{};
+    pli.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pli.setLayoutCount = 1;
+    pli.pSetLayouts = &interpSetLayout_;
+    pli.pushConstantRangeCount = 1;
+    pli.pPushConstantRanges = &push;
+    if (vkCreatePipelineLayout(device, &pli, nullptr, &interpPipelineLayout_) != VK_SUCCESS)
+        return false;
+
+    // One variant per pass; both share the block size and search radius
+    const uint32_t range = static_cast<uint32_t>(kInterpolateRange);
+    SpecConstants<5> estimate{{kInterpolateGroupSize, kInterpolateGroupSize, kInterpolateGroupSize, range, 0}, {}};
+    SpecConstants<5> synthesize{{kInterpolateGroupSize, kInterpolateGroupSize, kInterpolateGroupSize, range, 1}, {}};
+    const VkSpecializationInfo variants[2] = {estimate.info(), synthesize.info()};
+    if (!createComputePipelines(kInterpolateShader, interpPipelineLayout_, variants, 2, interpPipelines_))
+        return false;
+
+    // Bilinear taps for the sub-pixel warp; the motion search uses texelFetch
+    VkSamplerCreateInfo sci{};
+    sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sci.magFilter = VK_FILTER_LINEAR;
+    sci.minFilter = VK_FILTER_LINEAR;
+    sci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    if (vkCreateSampler(device, &sci, nullptr, &interpSampler_) != VK_SUCCESS)
+        return false;
+
+    VkDescriptorPoolSize sizes[3] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * kUploadSlots},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kUploadSlots},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kUploadSlots},
+    };
+    VkDescriptorPoolCreateInfo dpi{};
+    dpi.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpi.maxSets = kUploadSlots;
+    dpi.poolSizeCount = 3;
+    dpi.pPoolSizes = sizes;
+    if (vkCreateDescriptorPool(device, &dpi, nullptr, &interpDescriptorPool_) != VK_SUCCESS)
+        return false;
+
+    // Graphics queue: in-betweens are read by the present blits and readbacks
+    // right after, and every reader of a pooled image then signals one timeline
+    VkCommandBufferAllocateInfo cai{};
+    cai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cai.commandPool = ctx_->commandPool();
+    cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cai.commandBufferCount = 1;
+
+    VkDescriptorSetAllocateInfo dai{};
+    dai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dai.descriptorPool = interpDescriptorPool_;
+    dai.descriptorSetCount = 1;
+    dai.pSetLayouts = &interpSetLayout_;
+
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (InterpSlot& slot : interpSlots_) {
+        if (vkAllocateCommandBuffers(device, &cai, &slot.cmd) != VK_SUCCESS ||
+            vkAllocateDescriptorSets(device, &dai, &slot.set) != VK_SUCCESS ||
+            vkCreateFence(device, &fci, nullptr, &slot.fence) != VK_SUCCESS)
+            return false;
+    }
+    nextInterpSlot_ = 0;
+    return true;
+}
+
+void Renderer::destroyInterpolatePipeline() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    for (InterpSlot& slot : interpSlots_) {
+        if (slot.fence) {
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(device, slot.fence, nullptr);
         }
+        if (slot.cmd) vkFreeCommandBuffers(device, ctx_->commandPool(), 1, &slot.cmd);
+        if (slot.flow) vkDestroyBuffer(device, slot.flow, nullptr);
+        arena_.free(slot.flowMemory);
+        slot = InterpSlot{}; // sets go with the pool
     }
+    if (interpDescriptorPool_) vkDestroyDescriptorPool(device, interpDescriptorPool_, nullptr);
+    if (interpSampler_) vkDestroySampler(device, interpSampler_, nullptr);
+    for (VkPipeline& pipeline : interpPipelines_) {
+        if (pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+    if (interpPipelineLayout_) vkDestroyPipelineLayout(device, interpPipelineLayout_, nullptr);
+    if (interpSetLayout_) vkDestroyDescriptorSetLayout(device, interpSetLayout_, nullptr);
+    interpDescriptorPool_ = VK_NULL_HANDLE;
+    interpSampler_ = VK_NULL_HANDLE;
+    interpPipelineLayout_ = VK_NULL_HANDLE;
+    interpSetLayout_ = VK_NULL_HANDLE;
+}
+
+bool Renderer::createFlowBuffer(InterpSlot& slot, VkDeviceSize size) {
+    VkDevice device = ctx_->device();
+    if (slot.flow) vkDestroyBuffer(device, slot.flow, nullptr);
+    arena_.free(slot.flowMemory);
+    slot.flow = VK_NULL_HANDLE;
+    slot.flowSize = 0;
+
+    // Written and read only by the interpolation dispatches
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = size;
+    bci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bci, nullptr, &slot.flow) != VK_SUCCESS) {
+        slot.flow = VK_NULL_HANDLE;
+        return false;
+    }
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(device, slot.flow, &memReq);
+    if (!arena_.allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.flowMemory) ||
+        vkBindBufferMemory(device, slot.flow, slot.flowMemory.memory, slot.flowMemory.offset) != VK_SUCCESS) {
+        arena_.free(slot.flowMemory);
+        vkDestroyBuffer(device, slot.flow, nullptr);
+        slot.flow = VK_NULL_HANDLE;
+        return false;
+    }
+    slot.flowSize = size;
+    return true;
+}
+
+bool Renderer::recordInterpolate(InterpSlot& slot, const PooledImage& prev, const PooledImage& next,
+                                 PooledImage& image, float t) {
+    VkDevice device = ctx_->device();
+
+    VkDescriptorImageInfo prevInfo{interpSampler_, prev.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo nextInfo{interpSampler_, next.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorBufferInfo flowInfo{slot.flow, 0, VK_WHOLE_SIZE};
+    VkDescriptorImageInfo outInfo{VK_NULL_HANDLE, image.view, VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet writes[4]{};
+    for (uint32_t i = 0; i < 4; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = slot.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &prevInfo;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].pImageInfo = &nextInfo;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[2].pBufferInfo = &flowInfo;
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[3].pImageInfo = &outInfo;
+    vkUpdateDescriptorSets(device, 4, writes, 0, nullptr);
+
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(slot.cmd, 0);
+    if (vkBeginCommandBuffer(slot.cmd, &bi) != VK_SUCCESS)
+        return false;
+    const uint32_t timer = kInterpTimers + static_cast<uint32_t>(&slot - interpSlots_);
+    beginTimer(slot.cmd, timer, ctx_->graphicsQueueFamily());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    const uint32_t blocksX = (image.width + kInterpolateGroupSize - 1) / kInterpolateGroupSize;
+    const uint32_t blocksY = (image.height + kInterpolateGroupSize - 1) / kInterpolateGroupSize;
+    const InterpolateParams params{image.width, image.height, blocksX, blocksY, t, 0.f};
+    vkCmdBindPipeline(slot.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, interpPipelines_[0]);
+    vkCmdBindDescriptorSets(slot.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, interpPipelineLayout_, 0, 1, &slot.set, 0, nullptr);
+
+    // Pass 1: one invocation per block
+    vkCmdPushConstants(slot.cmd, interpPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(slot.cmd, (blocksX + kInterpolateGroupSize - 1) / kInterpolateGroupSize,
+                  (blocksY + kInterpolateGroupSize - 1) / kInterpolateGroupSize, 1);
+
+    VkBufferMemoryBarrier flowReady{};
+    flowReady.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    flowReady.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    flowReady.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    flowReady.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    flowReady.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    flowReady.buffer = slot.flow;
+    flowReady.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 1, &flowReady, 0, nullptr);
+
+    // Pass 2: one invocation per pixel. Same layout, so the bound set and push
+    // constants stay valid across the pipeline switch.
+    vkCmdBindPipeline(slot.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, interpPipelines_[1]);
+    vkCmdDispatch(slot.cmd, blocksX, blocksY, 1);
+
+    // Same resting layout as an uploaded image
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+    endTimer(slot.cmd, timer, "interpolate", "graphics");
 
-    if (!found)
+    if (vkEndCommandBuffer(slot.cmd) != VK_SUCCESS)
+        return false;
+
+    // Waits for both keyframes and for earlier readers of the target; signals
+    // the render timeline, so releasing the keyframes afterwards is covered
+    // like any other read
+    const uint64_t renderValue = renderValue_ + 1;
+    VkSemaphore waits[3] = {prev.readyTimeline, next.readyTimeline, renderTimeline_};
+    uint64_t waitValues[3] = {prev.uploadValue, next.uploadValue, image.releaseValue};
+    VkPipelineStageFlags waitStages[3] = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+    uint32_t waitCount = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (!waits[i]) continue;
+        waits[waitCount] = waits[i];
+        waitValues[waitCount] = waitValues[i];
+        ++waitCount;
+    }
+
+    VkTimelineSemaphoreSubmitInfo ti{};
+    ti.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    ti.waitSemaphoreValueCount = waitCount;
+    ti.pWaitSemaphoreValues = waitValues;
+    ti.signalSemaphoreValueCount = 1;
+    ti.pSignalSemaphoreValues = &renderValue;
+
+    VkSubmitInfo si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.pNext = &ti;
+    si.waitSemaphoreCount = waitCount;
+    si.pWaitSemaphores = waits;
+    si.pWaitDstStageMask = waitStages;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &slot.cmd;
+    si.signalSemaphoreCount = 1;
+    si.pSignalSemaphores = &renderTimeline_;
+
+    if (vkQueueSubmit(ctx_->graphicsQueue(), 1, &si, slot.fence) != VK_SUCCESS)
+        return false;
+    renderValue_ = renderValue;
+    image.readyTimeline = renderTimeline_;
+    image.uploadValue = renderValue;
+    return true;
+}
+
+bool Renderer::initInterpolation() {
+    if (interpPipelines_[0]) return true;
+    if (createInterpolatePipeline()) return true;
+    std::cerr << "Renderer: failed to create interpolation pipeline\n";
+    destroyInterpolatePipeline();
+    return false;
+}
+
+VkImage Renderer::interpolateImages(VkImage prev, VkImage next, float t) {
+    VkDevice device = ctx_->device();
+    if (!initInterpolation()) return VK_NULL_HANDLE;
+
+    const PooledImage* a = findImage(prev);
+    const PooledImage* b = findImage(next);
+    if (!a || !b || a->width != b->width || a->height != b->height) {
+        std::cerr << "Renderer: interpolation needs two frames of the same size\n";
+        return VK_NULL_HANDLE;
+    }
+    const uint32_t width = a->width, height = a->height;
+
+    // acquireImage may grow the pool, so the inputs are looked up again after it
+    PooledImage* target = acquireImage(width, height, VK_FORMAT_R8G8B8A8_UNORM);
+    if (!target) {
+        std::cerr << "Renderer: failed to create frame image\n";
+        return VK_NULL_HANDLE;
+    }
+    PooledImage* prevImage = findImage(prev);
+    PooledImage* nextImage = findImage(next);
+    if (!ensureView(*target) || !ensureView(*prevImage) || !ensureView(*nextImage)) {
+        releaseImage(target->image);
         return VK_NULL_HANDLE;
+    }
+
+    const uint32_t slotIndex = nextInterpSlot_;
+    InterpSlot& slot = interpSlots_[slotIndex];
+    nextInterpSlot_ = (nextInterpSlot_ + 1) % kUploadSlots;
+    vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+    collectTimer(kInterpTimers + slotIndex);
+
+    const VkDeviceSize flowBytes = static_cast<VkDeviceSize>((width + kInterpolateGroupSize - 1) / kInterpolateGroupSize) *
+                                   ((height + kInterpolateGroupSize - 1) / kInterpolateGroupSize) * 4 * sizeof(float);
+    if (flowBytes > slot.flowSize && !createFlowBuffer(slot, flowBytes)) {
+        std::cerr << "Renderer: failed to create motion buffer\n";
+        releaseImage(target->image);
+        return VK_NULL_HANDLE;
+    }
 
-    VkDeviceMemory memory;
-    if (vkAllocateMemory(device, &ai, nullptr, &memory) != VK_SUCCESS)
+    vkResetFences(device, 1, &slot.fence);
+    if (!recordInterpolate(slot, *prevImage, *nextImage, *target, std::clamp(t, 0.f, 1.f))) {
+        std::cerr << "Renderer: interpolation submit failed\n";
+        recreateSignaledFence(device, slot.fence);
+        releaseImage(target->image);
         return VK_NULL_HANDLE;
+    }
+    return target->image;
+}
+
+bool Renderer::createReadback(VkDeviceSize size) {
+    destroyReadback();
+    VkDevice device = ctx_->device();
+
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = size;
+    bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bci, nullptr, &readbackBuffer_) != VK_SUCCESS)
+        return false;
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(device, readbackBuffer_, &memReq);
+
+    // Cached memory makes the CPU read fast; it is usually not coherent
+    uint32_t type = findMemoryType(memReq.memoryTypeBits,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    if (type == kNoMemoryType) type = findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (type == kNoMemoryType) return false;
+
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(ctx_->physicalDevice(), &memProps);
+    readbackCoherent_ = (memProps.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = memReq.size;
+    ai.memoryTypeIndex = type;
+    if (vkAllocateMemory(device, &ai, nullptr, &readbackMemory_) != VK_SUCCESS)
+        return false;
+    vkBindBufferMemory(device, readbackBuffer_, readbackMemory_, 0);
+
+    void* mapped = nullptr;
+    if (vkMapMemory(device, readbackMemory_, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+        return false;
+    readbackMapped_ = static_cast<uint8_t*>(mapped);
+
+    VkCommandBufferAllocateInfo cai{};
+    cai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cai.commandPool = ctx_->commandPool();
+    cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cai.commandBufferCount = 1;
+
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkAllocateCommandBuffers(device, &cai, &readbackCmd_) != VK_SUCCESS ||
+        vkCreateFence(device, &fci, nullptr, &readbackFence_) != VK_SUCCESS)
+        return false;
+
+    readbackSize_ = size;
+    return true;
+}
+
+void Renderer::destroyReadback() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    if (readbackFence_) vkDestroyFence(device, readbackFence_, nullptr);
+    if (readbackCmd_) vkFreeCommandBuffers(device, ctx_->commandPool(), 1, &readbackCmd_);
+    if (readbackMapped_) vkUnmapMemory(device, readbackMemory_);
+    if (readbackBuffer_) vkDestroyBuffer(device, readbackBuffer_, nullptr);
+    if (readbackMemory_) vkFreeMemory(device, readbackMemory_, nullptr);
+    readbackFence_ = VK_NULL_HANDLE;
+    readbackCmd_ = VK_NULL_HANDLE;
+    readbackMapped_ = nullptr;
+    readbackBuffer_ = VK_NULL_HANDLE;
+    readbackMemory_ = VK_NULL_HANDLE;
+    readbackSize_ = 0;
+}
+
+bool Renderer::readImageRGBA(VkImage image, uint8_t* dst) {
+    const PooledImage* p = findImage(image);
+    if (!p) return false;
+
+    VkDevice device = ctx_->device();
+    const VkDeviceSize bytes = static_cast<VkDeviceSize>(p->width) * p->height * 4;
+    if (bytes > readbackSize_ && !createReadback(bytes)) {
+        std::cerr << "Renderer: failed to create readback buffer\n";
+        destroyReadback();
+        return false;
+    }
+
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkResetCommandBuffer(readbackCmd_, 0);
+    vkBeginCommandBuffer(readbackCmd_, &bi);
+    beginTimer(readbackCmd_, kReadbackTimer, ctx_->graphicsQueueFamily());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = p->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(readbackCmd_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {p->width, p->height, 1};
+    vkCmdCopyImageToBuffer(readbackCmd_, p->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer_, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    VkBufferMemoryBarrier hostRead{};
+    hostRead.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostRead.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostRead.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostRead.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostRead.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostRead.buffer = readbackBuffer_;
+    hostRead.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(readbackCmd_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 0, nullptr, 1, &hostRead, 1, &barrier);
+    endTimer(readbackCmd_, kReadbackTimer, "readback", "graphics");
+    vkEndCommandBuffer(readbackCmd_);
+
+    // Graphics queue: ordered with the present blits that read the same image
+    if (!ctx_->submit(ctx_->graphicsQueue(), readbackCmd_,
+                      p->readyTimeline, p->uploadValue, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_NULL_HANDLE, 0, readbackFence_))
+        return false;
+    vkWaitForFences(device, 1, &readbackFence_, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &readbackFence_);
+    collectTimer(kReadbackTimer);
+
+    if (!readbackCoherent_) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = readbackMemory_;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+    std::memcpy(dst, readbackMapped_, static_cast<size_t>(bytes));
+    return true;
+}
+
+bool Renderer::initPresentation(Window* window, PresentMode mode) {
+    VkSurfaceKHR surface = window ? window->createSurface(ctx_->instance()) : VK_NULL_HANDLE;
+    if (!surface) {
+        std::cerr << "Renderer: failed to create window surface\n";
+        return false;
+    }
+    window_ = window;
+    if (!swapchain_.create(surface, window->framebufferExtent(), mode) || !createFrameSync() || !createRenderFinished()) {
+        std::cerr << "Renderer: failed to create swapchain\n";
+        destroyPresentation();
+        return false;
+    }
+    return true;
+}
+
+bool Renderer::createFrameSync() {
+    VkDevice device = ctx_->device();
+
+    VkCommandBufferAllocateInfo cai{};
+    cai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cai.commandPool = ctx_->commandPool();
+    cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cai.commandBufferCount = 1;
 
-    vkBindImageMemory(device, image, memory, 0);
-    *outMemory = memory;
+    VkFenceCreateInfo fci{};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    std::cout << "Image uploaded (placeholder, no staging yet)\n";
-    return image;
+    VkSemaphoreCreateInfo sci{};
+    sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (FrameSync& f : frames_) {
+        if (vkAllocateCommandBuffers(device, &cai, &f.cmd) != VK_SUCCESS ||
+            vkCreateFence(device, &fci, nullptr, &f.inFlight) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &sci, nullptr, &f.imageAvailable) != VK_SUCCESS)
+            return false;
+    }
+    frameIndex_ = 0;
+    return true;
+}
+
+bool Renderer::createRenderFinished() {
+    VkDevice device = ctx_->device();
+    for (VkSemaphore s : renderFinished_) vkDestroySemaphore(device, s, nullptr);
+    renderFinished_.assign(swapchain_.imageCount(), VK_NULL_HANDLE);
+
+    VkSemaphoreCreateInfo sci{};
+    sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (VkSemaphore& s : renderFinished_) {
+        if (vkCreateSemaphore(device, &sci, nullptr, &s) != VK_SUCCESS)
+            return false;
+    }
+    return true;
+}
+
+void Renderer::destroyPresentation() {
+    VkDevice device = ctx_ ? ctx_->device() : VK_NULL_HANDLE;
+    if (!device) return;
+
+    if (swapchain_.isValid() || frames_[0].cmd) vkDeviceWaitIdle(device);
+    for (FrameSync& f : frames_) {
+        if (f.inFlight) vkDestroyFence(device, f.inFlight, nullptr);
+        if (f.imageAvailable) vkDestroySemaphore(device, f.imageAvailable, nullptr);
+        if (f.cmd) vkFreeCommandBuffers(device, ctx_->commandPool(), 1, &f.cmd);
+        f = FrameSync{};
+    }
+    for (VkSemaphore s : renderFinished_) {
+        if (s) vkDestroySemaphore(device, s, nullptr);
+    }
+    renderFinished_.clear();
+    if (overlay_) overlay_->detach();
+    overlay_ = nullptr;
+    swapchain_.destroy();
+    window_ = nullptr;
+}
+
+bool Renderer::setOverlay(Overlay* overlay) {
+    overlay_ = nullptr;
+    if (!overlay || !swapchain_.isValid() || !overlay->attach(swapchain_)) return false;
+    overlay_ = overlay;
+    return true;
+}
+
+bool Renderer::recreateSwapchain() {
+    VkExtent2D extent = window_->framebufferExtent();
+    if (extent.width == 0 || extent.height == 0) return false; // minimized
+    if (overlay_) {
+        vkDeviceWaitIdle(ctx_->device()); // its framebuffers may still be in flight
+        overlay_->detach();
+    }
+    if (!swapchain_.recreate(extent) || !createRenderFinished()) return false;
+    if (overlay_ && !overlay_->attach(swapchain_)) {
+        std::cerr << "Renderer: overlay lost with the swapchain\n";
+        overlay_ = nullptr;
+    }
+    return true;
+}
+
+void Renderer::recordPresent(VkCommandBuffer cmd, const PooledImage& src, VkImage dst) {
+    VkImageMemoryBarrier barriers[2]{};
+    for (VkImageMemoryBarrier& b : barriers) {
+        b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        b.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        b.subresourceRange.levelCount = 1;
+        b.subresourceRange.layerCount = 1;
+    }
+
+    // Upload visibility comes from the timeline wait; the acquired swapchain
+    // image is discarded (UNDEFINED) and cleared for the letterbox bars
+    barriers[0].image = src.image;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image = dst;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    VkClearColorValue black{};
+    vkCmdClearColorImage(cmd, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &barriers[1].subresourceRange);
+
+    VkMemoryBarrier clearDone{};
+    clearDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearDone.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearDone.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &clearDone, 0, nullptr, 0, nullptr);
+
+    // Scale to fit, keeping the aspect ratio
+    const VkExtent2D ext = swapchain_.extent();
+    const float scale = std::min(float(ext.width) / float(src.width), float(ext.height) / float(src.height));
+    const int32_t w = std::max(1, static_cast<int32_t>(float(src.width) * scale));
+    const int32_t h = std::max(1, static_cast<int32_t>(float(src.height) * scale));
+    const int32_t x = (static_cast<int32_t>(ext.width) - w) / 2;
+    const int32_t y = (static_cast<int32_t>(ext.height) - h) / 2;
+
+    VkImageBlit blit{};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = {static_cast<int32_t>(src.width), static_cast<int32_t>(src.height), 1};
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstOffsets[0] = {x, y, 0};
+    blit.dstOffsets[1] = {x + w, y + h, 1};
+    vkCmdBlitImage(cmd, src.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &blit, VK_FILTER_LINEAR);
+
+    // Source back to its resting layout, swapchain image to present (the
+    // overlay's render pass does that one instead)
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].dstAccessMask = 0;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = 0;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, overlay_ ? 1 : 2, barriers);
 }
 
 void Renderer::drawFrame(VkImage image) {
-    std::cout << "Drawing frame (stub). Vulkan swapchain not implemented yet.\n";
+    const PooledImage* src = findImage(image);
+    if (!src) return;
+
+    if (!window_) {
+        if (!warnedHeadless_) std::cout << "Renderer: no window, frames are not presented\n";
+        warnedHeadless_ = true;
+        return;
+    }
+    if (!swapchain_.isValid() && !recreateSwapchain()) return;
+
+    VkDevice device = ctx_->device();
+    FrameSync& f = frames_[frameIndex_];
+    vkWaitForFences(device, 1, &f.inFlight, VK_TRUE, UINT64_MAX);
+    collectTimer(kFrameTimers + frameIndex_);
+
+    uint32_t index = 0;
+    VkResult acquired = swapchain_.acquire(f.imageAvailable, index);
+    if (acquired == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreateSwapchain();
+        return;
+    }
+    if (acquired != VK_SUCCESS && acquired != VK_SUBOPTIMAL_KHR) return;
+
+    vkResetFences(device, 1, &f.inFlight);
+    vkResetCommandBuffer(f.cmd, 0);
+
+    VkCommandBufferBeginInfo bi{};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(f.cmd, &bi);
+    beginTimer(f.cmd, kFrameTimers + frameIndex_, ctx_->graphicsQueueFamily());
+    recordPresent(f.cmd, *src, swapchain_.image(index));
+    if (overlay_) overlay_->record(f.cmd, index);
+    endTimer(f.cmd, kFrameTimers + frameIndex_, "present_blit", "graphics");
+    vkEndCommandBuffer(f.cmd);
+
+    // Wait for the swapchain image and for this frame's upload (or conversion); signal the
+    // present semaphore and the render timeline (recycling of the source)
+    const uint64_t renderValue = renderValue_ + 1;
+    VkSemaphore waits[2] = {f.imageAvailable, src->readyTimeline};
+    uint64_t waitValues[2] = {0, src->uploadValue};
+    VkPipelineStageFlags waitStages[2] = {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT};
+    VkSemaphore signals[2] = {renderFinished_[index], renderTimeline_};
+    uint64_t signalValues[2] = {0, renderValue};
+
+    VkTimelineSemaphoreSubmitInfo ti{};
+    ti.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    ti.waitSemaphoreValueCount = 2;
+    ti.pWaitSemaphoreValues = waitValues;
+    ti.signalSemaphoreValueCount = 2;
+    ti.pSignalSemaphoreValues = signalValues;
+
+    VkSubmitInfo si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.pNext = &ti;
+    si.waitSemaphoreCount = 2;
+    si.pWaitSemaphores = waits;
+    si.pWaitDstStageMask = waitStages;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &f.cmd;
+    si.signalSemaphoreCount = 2;
+    si.pSignalSemaphores = signals;
+
+    if (vkQueueSubmit(ctx_->graphicsQueue(), 1, &si, f.inFlight) != VK_SUCCESS) {
+        std::cerr << "Renderer: present submit failed\n";
+        return;
+    }
+    renderValue_ = renderValue;
+    frameIndex_ = (frameIndex_ + 1) % kFramesInFlight;
+
+    VkResult presented = swapchain_.present(ctx_->graphicsQueue(), renderFinished_[index], index);
+    const VkExtent2D want = window_->framebufferExtent();
+    const VkExtent2D have = swapchain_.extent();
+    if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR || acquired == VK_SUBOPTIMAL_KHR ||
+        want.width != have.width || want.height != have.height)
+        recreateSwapchain();
 }
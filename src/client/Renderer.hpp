@@ -1,22 +1,259 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include <cstdint>
+#include <vector>
 
+#include "MemoryArena.hpp"
+#include "Swapchain.hpp"
+
+class Overlay;
 class VulkanContext;
+class Window;
 
 class Renderer {
 public:
     explicit Renderer(VulkanContext* ctx);
     ~Renderer();
 
+    // Applied by the GPU conversion (convertImageNCHW / uploadImageNCHW), in
+    // this order. The defaults only map [-1,1] to [0,1] and clamp.
+    struct ColorGrade {
+        float exposure = 0.f;   // stops
+        bool toneMap = false;   // soft highlight roll-off instead of a hard clip
+        float contrast = 1.f;   // around mid grey
+        float saturation = 1.f; // 0 = greyscale
+        float gamma = 1.f;
+    };
+
     bool init();
     void cleanup();
 
-    VkImage uploadImageRGBA(const uint8_t* data, uint32_t width, uint32_t height,
-                            VkDeviceMemory* outMemory);
+    void setColorGrade(const ColorGrade& grade) { grade_ = grade; }
+    const ColorGrade& colorGrade() const { return grade_; }
+
+    // Creates the surface and swapchain for `window`. Without it drawFrame()
+    // is a no-op (headless runs still upload and write frames).
+    bool initPresentation(Window* window, PresentMode mode);
+
+    // Copies an RGBA8 frame into a pooled image. The image stays owned by the
+    // Renderer; hand it back with releaseImage() once no more work using it
+    // will be submitted.
+    VkImage uploadImageRGBA(const uint8_t* data, uint32_t width, uint32_t height);
+    void releaseImage(VkImage image);
+
+    // Builds the compute pipeline used by convertImageNCHW / uploadImageNCHW.
+    // False when the shader is missing; callers then stay on uploadImageRGBA.
+    bool initConversion();
+
+    // Converts a decoder output that is already in GPU memory (planar NCHW in
+    // [-1,1], float or fp16, e.g. an InteropBuffer written by CUDA) into a
+    // pooled RGBA8 image on the compute queue, with no host round trip.
+    // `src` must not be rewritten until waitImage() has returned for the result.
+    VkImage convertImageNCHW(VkBuffer src, uint32_t width, uint32_t height, bool fp16);
+
+    // Same conversion for a decoder output in host memory (planar NCHW floats):
+    // the tensor goes through the staging ring into a device buffer and is
+    // converted and graded there, instead of in a per-pixel CPU loop.
+    VkImage uploadImageNCHW(const float* data, uint32_t width, uint32_t height);
+
+    // Builds the compute pipeline used by interpolateImages(). False when the
+    // shader is missing; callers then present keyframes only.
+    bool initInterpolation();
 
+    // Synthesizes the frame at time t in (0, 1) between two pooled RGBA8
+    // images of the same size: block motion is estimated between them and
+    // both are warped along it and blended, on the graphics queue. Returns a
+    // pooled image like uploadImageRGBA(); the inputs stay owned by the
+    // caller and may be released right away.
+    VkImage interpolateImages(VkImage prev, VkImage next, float t);
+
+    // Blocks until the upload or conversion that produced `image` has finished
+    bool waitImage(VkImage image);
+
+    // Copies a pooled image back into host RGBA8 (width * height * 4 bytes),
+    // for writing frames that never went through host memory
+    bool readImageRGBA(VkImage image, uint8_t* dst);
+
+    // GPU timestamps for Trace: each submit slot gets a begin/end query pair,
+    // read back once the slot's fence shows the work finished, so timing
+    // never stalls the queue. False when the device cannot write timestamps.
+    bool initTiming();
+
+    // Draws `overlay` over every presented frame, in the frame's own command
+    // buffer. Needs initPresentation(); the overlay must outlive it. False
+    // (and no overlay) when it cannot target the swapchain.
+    bool setOverlay(Overlay* overlay);
+
+    // Blits an uploaded image (letterboxed) into the next swapchain image and
+    // presents it. Waits for the image's upload on the GPU, not on the CPU.
     void drawFrame(VkImage image);
 
 private:
+    // Uploads go through a persistently mapped staging ring: one slot per frame
+    // in flight, each with its own command buffer and fence. A slot is only
+    // rewritten once the GPU has finished the copy that last used it.
+    static constexpr uint32_t kUploadSlots = 3;
+
+    struct UploadSlot {
+        VkDeviceSize offset = 0;
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    // Frame images are recycled instead of created per frame. Uploads run on
+    // the transfer queue and signal uploadTimeline_, conversions run on the
+    // compute queue and signal convertTimeline_; work that reads an image
+    // waits for readyTimeline to reach its uploadValue and signals
+    // renderTimeline_. A recycled image is only overwritten once
+    // renderTimeline_ reaches its releaseValue.
+    struct PooledImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE; // created on first compute use
+        MemoryArena::Allocation memory;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        bool inUse = false;
+        VkSemaphore readyTimeline = VK_NULL_HANDLE;
+        uint64_t uploadValue = 0;
+        uint64_t releaseValue = 0;
+    };
+
+    // GPU-side conversions reuse a descriptor set and command buffer per slot,
+    // like the staging ring. `input` receives tensors uploaded from the host.
+    struct ConvertSlot {
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkBuffer input = VK_NULL_HANDLE;
+        MemoryArena::Allocation inputMemory;
+        VkDeviceSize inputSize = 0;
+    };
+
+    // Interpolations reuse a descriptor set, command buffer and block motion
+    // buffer per slot, so back-to-back in-betweens may overlap on the GPU.
+    struct InterpSlot {
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkBuffer flow = VK_NULL_HANDLE;
+        MemoryArena::Allocation flowMemory;
+        VkDeviceSize flowSize = 0;
+    };
+
+    // Presentation: up to kFramesInFlight frames are recorded ahead of the
+    // GPU, each with its own command buffer, fence and acquire semaphore.
+    // Render-finished semaphores are per swapchain image, since presentation
+    // of an image may still hold its semaphore when the frame slot comes round.
+    static constexpr uint32_t kFramesInFlight = 2;
+
+    struct FrameSync {
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VkFence inFlight = VK_NULL_HANDLE;
+        VkSemaphore imageAvailable = VK_NULL_HANDLE;
+    };
+
+    // Query pairs: one per upload, conversion and interpolation slot, frame in
+    // flight, and the readback
+    static constexpr uint32_t kUploadTimers = 0;
+    static constexpr uint32_t kConvertTimers = kUploadTimers + kUploadSlots;
+    static constexpr uint32_t kInterpTimers = kConvertTimers + kUploadSlots;
+    static constexpr uint32_t kFrameTimers = kInterpTimers + kUploadSlots;
+    static constexpr uint32_t kReadbackTimer = kFrameTimers + kFramesInFlight;
+    static constexpr uint32_t kTimerCount = kReadbackTimer + 1;
+
+    struct GpuTimer {
+        const char* name = nullptr;
+        const char* queue = nullptr;
+        uint64_t mask = 0;   // valid timestamp bits of the queue, 0 = not armed
+        bool pending = false; // written by a submitted command buffer, not read yet
+    };
+
     VulkanContext* ctx_;
+    MemoryArena arena_;
+    Swapchain swapchain_;
+    Window* window_ = nullptr;
+    Overlay* overlay_ = nullptr;
+    FrameSync frames_[kFramesInFlight];
+    std::vector<VkSemaphore> renderFinished_;
+    uint32_t frameIndex_ = 0;
+    bool warnedHeadless_ = false;
+    std::vector<PooledImage> images_;
+
+    VkSemaphore uploadTimeline_ = VK_NULL_HANDLE;
+    VkSemaphore renderTimeline_ = VK_NULL_HANDLE;
+    VkSemaphore convertTimeline_ = VK_NULL_HANDLE;
+    uint64_t uploadValue_ = 0;
+    uint64_t renderValue_ = 0;
+    uint64_t convertValue_ = 0;
+
+    VkBuffer stagingBuffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory_ = VK_NULL_HANDLE;
+    uint8_t* stagingMapped_ = nullptr;
+    VkDeviceSize stagingSlotSize_ = 0;
+    bool stagingCoherent_ = true;
+    UploadSlot uploadSlots_[kUploadSlots];
+    uint32_t nextUploadSlot_ = 0;
+
+    VkDescriptorSetLayout convertSetLayout_ = VK_NULL_HANDLE;
+    VkPipelineLayout convertPipelineLayout_ = VK_NULL_HANDLE;
+    VkPipeline convertPipelines_[2] = {}; // fp32 / fp16 input
+    ColorGrade grade_;
+    VkDescriptorPool convertDescriptorPool_ = VK_NULL_HANDLE;
+    ConvertSlot convertSlots_[kUploadSlots];
+    uint32_t nextConvertSlot_ = 0;
+
+    VkDescriptorSetLayout interpSetLayout_ = VK_NULL_HANDLE;
+    VkPipelineLayout interpPipelineLayout_ = VK_NULL_HANDLE;
+    VkPipeline interpPipelines_[2] = {}; // estimate / synthesize pass
+    VkSampler interpSampler_ = VK_NULL_HANDLE;
+    VkDescriptorPool interpDescriptorPool_ = VK_NULL_HANDLE;
+    InterpSlot interpSlots_[kUploadSlots];
+    uint32_t nextInterpSlot_ = 0;
+
+    VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+    GpuTimer timers_[kTimerCount];
+    int64_t gpuOffsetUs_ = 0; // GPU timestamp -> Trace clock
+    bool gpuOffsetSet_ = false;
+
+    VkBuffer readbackBuffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory_ = VK_NULL_HANDLE;
+    uint8_t* readbackMapped_ = nullptr;
+    VkDeviceSize readbackSize_ = 0;
+    bool readbackCoherent_ = true;
+    VkCommandBuffer readbackCmd_ = VK_NULL_HANDLE;
+    VkFence readbackFence_ = VK_NULL_HANDLE;
+
+    bool createStagingRing(VkDeviceSize slotSize);
+    void destroyStagingRing();
+    PooledImage* acquireImage(uint32_t width, uint32_t height, VkFormat format);
+    PooledImage* findImage(VkImage image);
+    void destroyImages();
+    bool createFrameSync();
+    bool createRenderFinished();
+    void destroyPresentation();
+    bool recreateSwapchain();
+    void recordPresent(VkCommandBuffer cmd, const PooledImage& src, VkImage dst);
+    bool recordUpload(UploadSlot& slot, PooledImage& image);
+    bool createComputePipelines(const char* shader, VkPipelineLayout layout,
+                                const VkSpecializationInfo* variants, uint32_t count, VkPipeline* pipelines);
+    bool ensureView(PooledImage& image);
+    bool createConvertPipeline();
+    void destroyConvertPipeline();
+    bool createConvertInput(ConvertSlot& slot, VkDeviceSize size);
+    bool uploadBuffer(const void* data, VkDeviceSize bytes, VkBuffer dst, uint64_t waitRenderValue);
+    VkImage convertImage(VkBuffer src, uint32_t width, uint32_t height, bool fp16, const float* hostData);
+    bool recordConvert(ConvertSlot& slot, VkBuffer src, PooledImage& image, bool fp16,
+                       VkSemaphore waitSemaphore, uint64_t waitValue);
+    bool createInterpolatePipeline();
+    void destroyInterpolatePipeline();
+    bool createFlowBuffer(InterpSlot& slot, VkDeviceSize size);
+    bool recordInterpolate(InterpSlot& slot, const PooledImage& prev, const PooledImage& next, PooledImage& image,
+                           float t);
+    void beginTimer(VkCommandBuffer cmd, uint32_t timer, uint32_t family);
+    void endTimer(VkCommandBuffer cmd, uint32_t timer, const char* name, const char* queue);
+    void collectTimer(uint32_t timer);
+    bool createReadback(VkDeviceSize size);
+    void destroyReadback();
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags props) const;
 };
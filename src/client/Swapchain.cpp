@@ -0,0 +1,171 @@
+#include "Swapchain.hpp"
+#include "VulkanContext.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+namespace {
+
+VkPresentModeKHR toVk(PresentMode mode) {
+    switch (mode) {
+        case PresentMode::Mailbox: return VK_PRESENT_MODE_MAILBOX_KHR;
+        case PresentMode::Immediate: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        case PresentMode::Fifo: break;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+} // namespace
+
+const char* presentModeName(PresentMode mode) {
+    switch (mode) {
+        case PresentMode::Mailbox: return "mailbox";
+        case PresentMode::Immediate: return "immediate";
+        case PresentMode::Fifo: break;
+    }
+    return "fifo";
+}
+
+bool parsePresentMode(const std::string& name, PresentMode& out) {
+    std::string l = name;
+    std::transform(l.begin(), l.end(), l.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (l == "fifo" || l == "vsync") out = PresentMode::Fifo;
+    else if (l == "mailbox") out = PresentMode::Mailbox;
+    else if (l == "immediate") out = PresentMode::Immediate;
+    else return false;
+    return true;
+}
+
+Swapchain::Swapchain(VulkanContext* ctx) : ctx_(ctx) {}
+
+Swapchain::~Swapchain() {
+    destroy();
+}
+
+bool Swapchain::create(VkSurfaceKHR surface, VkExtent2D extent, PresentMode mode) {
+    destroy();
+    surface_ = surface;
+    requestedMode_ = mode;
+    return build(extent, VK_NULL_HANDLE);
+}
+
+bool Swapchain::recreate(VkExtent2D extent) {
+    if (!surface_) return false;
+    vkDeviceWaitIdle(ctx_->device());
+    VkSwapchainKHR old = swapchain_;
+    swapchain_ = VK_NULL_HANDLE;
+    bool ok = build(extent, old);
+    if (old) vkDestroySwapchainKHR(ctx_->device(), old, nullptr);
+    return ok;
+}
+
+void Swapchain::destroy() {
+    VkDevice device = ctx_->device();
+    if (swapchain_ && device) vkDestroySwapchainKHR(device, swapchain_, nullptr);
+    if (surface_ && ctx_->instance()) vkDestroySurfaceKHR(ctx_->instance(), surface_, nullptr);
+    swapchain_ = VK_NULL_HANDLE;
+    surface_ = VK_NULL_HANDLE;
+    images_.clear();
+}
+
+bool Swapchain::build(VkExtent2D extent, VkSwapchainKHR oldSwapchain) {
+    VkPhysicalDevice gpu = ctx_->physicalDevice();
+
+    VkSurfaceCapabilitiesKHR caps;
+    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu, surface_, &caps) != VK_SUCCESS)
+        return false;
+
+    // Frames are blitted into the swapchain images
+    if (!(caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        std::cerr << "Swapchain: surface does not support TRANSFER_DST images\n";
+        return false;
+    }
+
+    if (caps.currentExtent.width != UINT32_MAX) {
+        extent_ = caps.currentExtent;
+    } else {
+        extent_.width = std::clamp(extent.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+        extent_.height = std::clamp(extent.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+    }
+    // Minimized: nothing to present until the window comes back
+    if (extent_.width == 0 || extent_.height == 0) return false;
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface_, &formatCount, nullptr);
+    std::vector<VkSurfaceFormatKHR> formats(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface_, &formatCount, formats.data());
+    if (formats.empty()) return false;
+
+    // UNORM so the generated pixels are shown as-is, without an extra sRGB encode
+    VkSurfaceFormatKHR chosen = formats[0];
+    for (const VkSurfaceFormatKHR& f : formats) {
+        if ((f.format == VK_FORMAT_B8G8R8A8_UNORM || f.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+            f.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            chosen = f;
+            break;
+        }
+    }
+    format_ = chosen.format;
+
+    uint32_t modeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface_, &modeCount, nullptr);
+    std::vector<VkPresentModeKHR> modes(modeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface_, &modeCount, modes.data());
+
+    activeMode_ = PresentMode::Fifo;
+    if (std::find(modes.begin(), modes.end(), toVk(requestedMode_)) != modes.end()) {
+        activeMode_ = requestedMode_;
+    } else {
+        std::cerr << "Swapchain: present mode " << presentModeName(requestedMode_) << " not supported, using fifo\n";
+    }
+
+    // One more than the minimum so acquire does not wait on the compositor;
+    // mailbox needs a third image to have something to replace
+    uint32_t imageCount = std::max(caps.minImageCount + 1, activeMode_ == PresentMode::Mailbox ? 3u : 2u);
+    if (caps.maxImageCount > 0) imageCount = std::min(imageCount, caps.maxImageCount);
+
+    VkSwapchainCreateInfoKHR ci{};
+    ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    ci.surface = surface_;
+    ci.minImageCount = imageCount;
+    ci.imageFormat = chosen.format;
+    ci.imageColorSpace = chosen.colorSpace;
+    ci.imageExtent = extent_;
+    ci.imageArrayLayers = 1;
+    ci.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ci.preTransform = caps.currentTransform;
+    ci.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    ci.presentMode = toVk(activeMode_);
+    ci.clipped = VK_TRUE;
+    ci.oldSwapchain = oldSwapchain;
+
+    if (vkCreateSwapchainKHR(ctx_->device(), &ci, nullptr, &swapchain_) != VK_SUCCESS) {
+        swapchain_ = VK_NULL_HANDLE;
+        return false;
+    }
+
+    uint32_t count = 0;
+    vkGetSwapchainImagesKHR(ctx_->device(), swapchain_, &count, nullptr);
+    images_.resize(count);
+    vkGetSwapchainImagesKHR(ctx_->device(), swapchain_, &count, images_.data());
+
+    std::cout << "Swapchain: " << extent_.width << "x" << extent_.height << ", " << count << " images, "
+              << presentModeName(activeMode_) << "\n";
+    return true;
+}
+
+VkResult Swapchain::acquire(VkSemaphore imageAvailable, uint32_t& index) {
+    return vkAcquireNextImageKHR(ctx_->device(), swapchain_, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &index);
+}
+
+VkResult Swapchain::present(VkQueue queue, VkSemaphore renderFinished, uint32_t index) {
+    VkPresentInfoKHR pi{};
+    pi.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    pi.waitSemaphoreCount = 1;
+    pi.pWaitSemaphores = &renderFinished;
+    pi.swapchainCount = 1;
+    pi.pSwapchains = &swapchain_;
+    pi.pImageIndices = &index;
+    return vkQueuePresentKHR(queue, &pi);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class VulkanContext;
+
+// FIFO is vsync'd and always available. MAILBOX replaces the queued image
+// instead of waiting for it (no tearing, lower latency). IMMEDIATE may tear
+// but never waits. Unsupported modes fall back to FIFO.
+enum class PresentMode { Fifo, Mailbox, Immediate };
+
+const char* presentModeName(PresentMode mode);
+bool parsePresentMode(const std::string& name, PresentMode& out);
+
+class Swapchain {
+public:
+    explicit Swapchain(VulkanContext* ctx);
+    ~Swapchain();
+
+    Swapchain(const Swapchain&) = delete;
+    Swapchain& operator=(const Swapchain&) = delete;
+
+    // Takes ownership of `surface`. `extent` is only used when the surface
+    // leaves the size to the application.
+    bool create(VkSurfaceKHR surface, VkExtent2D extent, PresentMode mode);
+    bool recreate(VkExtent2D extent);
+    void destroy();
+
+    bool isValid() const { return swapchain_ != VK_NULL_HANDLE; }
+    VkSwapchainKHR handle() const { return swapchain_; }
+    VkFormat format() const { return format_; }
+    VkExtent2D extent() const { return extent_; }
+    PresentMode presentMode() const { return activeMode_; }
+    uint32_t imageCount() const { return static_cast<uint32_t>(images_.size()); }
+    VkImage image(uint32_t index) const { return images_[index]; }
+
+    VkResult acquire(VkSemaphore imageAvailable, uint32_t& index);
+    VkResult present(VkQueue queue, VkSemaphore renderFinished, uint32_t index);
+
+private:
+    VulkanContext* ctx_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
+    VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
+    VkFormat format_ = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent_{0, 0};
+    PresentMode requestedMode_ = PresentMode::Fifo;
+    PresentMode activeMode_ = PresentMode::Fifo;
+    std::vector<VkImage> images_;
+
+    bool build(VkExtent2D extent, VkSwapchainKHR oldSwapchain);
+};
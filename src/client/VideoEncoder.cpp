@@ -0,0 +1,573 @@
+#include "VideoEncoder.hpp"
+#include "stb_image_write.h"
+#include "../util/MappedFile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#define popen _popen
+#define pclose _pclose
+#define POPEN_BINARY "b"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define POPEN_BINARY ""
+#endif
+
+namespace {
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+    return s.rfind(prefix, 0) == 0;
+}
+
+bool endsWith(const std::string& s, const char* suffix) {
+    const size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool parseInt(const std::string& v, int& out) {
+    try {
+        size_t pos = 0;
+        out = std::stoi(v, &pos);
+        return pos == v.size() && out > 0;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+std::string quote(const std::string& arg) {
+#ifdef _WIN32
+    // CommandLineToArgvW rules: backslashes are literal unless they precede a
+    // quote, so those (and the ones before the closing quote) are doubled
+    std::string q = "\"";
+    size_t slashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            ++slashes;
+        } else {
+            if (c == '"') q.append(slashes + 1, '\\');
+            slashes = 0;
+        }
+        q += c;
+    }
+    q.append(slashes, '\\');
+    return q + "\"";
+#else
+    std::string q = "'";
+    for (char c : arg) q += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return q + "'";
+#endif
+}
+
+// ----- PNG sequence (frame_N.png in a folder) -----
+
+class PngEncoder : public VideoEncoder {
+public:
+    explicit PngEncoder(const std::string& folder) : folder_(folder) {}
+
+    bool open(uint32_t width, uint32_t height) override {
+        width_ = width;
+        height_ = height;
+        std::error_code ec;
+        std::filesystem::create_directories(folder_, ec);
+        return !ec;
+    }
+
+    std::string encode(const uint8_t* rgba, uint64_t index) override {
+        std::string path = target(index);
+        if (!stbi_write_png(path.c_str(), width_, height_, 4, rgba, width_ * 4)) return {};
+        return path;
+    }
+
+    std::string target(uint64_t index) const override {
+        std::ostringstream ss;
+        ss << folder_ << "/frame_" << index << ".png";
+        return ss.str();
+    }
+
+    // Every frame is its own file, so PNG compression parallelizes freely
+    bool parallel() const override { return true; }
+
+    void close() override {}
+
+private:
+    std::string folder_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+};
+
+// ----- ffmpeg pipe (libx264/x265, NVENC, VAAPI; file or stream) -----
+
+class FfmpegEncoder : public VideoEncoder {
+public:
+    explicit FfmpegEncoder(const VideoWriterConfig& cfg) : cfg_(cfg) {}
+    ~FfmpegEncoder() override { close(); }
+
+    bool open(uint32_t width, uint32_t height) override {
+        close();
+        width_ = width;
+        height_ = height;
+        // popen() succeeds whether or not ffmpeg can encode, so a missing
+        // binary or encoder would only show up once frames are lost
+        if (!probe()) {
+            std::cerr << "VideoEncoder: " << cfg_.ffmpeg << " cannot encode with "
+                      << encoderBackendName(cfg_.backend) << "\n";
+            return false;
+        }
+        const std::string cmd = command();
+        pipe_ = popen(cmd.c_str(), "w" POPEN_BINARY);
+        if (!pipe_) {
+            std::cerr << "VideoEncoder: failed to start " << cfg_.ffmpeg << "\n";
+            return false;
+        }
+        std::cout << "VideoEncoder: " << encoderBackendName(cfg_.backend) << " -> " << cfg_.output << "\n";
+        return true;
+    }
+
+    std::string encode(const uint8_t* rgba, uint64_t) override {
+        const size_t bytes = static_cast<size_t>(width_) * height_ * 4;
+        // SIGPIPE is ignored process-wide (see main), so a dead ffmpeg shows up
+        // here as EPIPE
+        if (!pipe_ || std::fwrite(rgba, 1, bytes, pipe_) != bytes) {
+            std::cerr << "VideoEncoder: ffmpeg stopped accepting frames: " << std::strerror(errno) << "\n";
+            return {};
+        }
+        return cfg_.output;
+    }
+
+    std::string target(uint64_t) const override { return cfg_.output; }
+
+    void close() override {
+        if (!pipe_) return;
+        // EOF on stdin makes ffmpeg flush the encoder and write the trailer
+        int status = pclose(pipe_);
+        pipe_ = nullptr;
+        if (status != 0) std::cerr << "VideoEncoder: ffmpeg exited with status " << status << "\n";
+    }
+
+private:
+    VideoWriterConfig cfg_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    FILE* pipe_ = nullptr;
+
+    std::string command() const {
+        std::ostringstream c;
+        c << quote(cfg_.ffmpeg) << " -hide_banner -loglevel error -y";
+        if (cfg_.backend == EncoderBackend::Vaapi) c << " -vaapi_device " << quote(cfg_.vaapiDevice);
+        c << " -f rawvideo -pix_fmt rgba -s " << width_ << "x" << height_ << " -r " << cfg_.fps << " -i -";
+        c << codecArgs();
+
+        // Live outputs need regular keyframes and an explicit muxer
+        const std::string out = lowercase(cfg_.output);
+        if (startsWith(out, "rtmp://") || startsWith(out, "rtmps://")) {
+            c << " -g " << cfg_.fps * 2 << " -f flv";
+        } else if (startsWith(out, "srt://") || startsWith(out, "udp://")) {
+            c << " -g " << cfg_.fps * 2 << " -f mpegts";
+        }
+        c << " " << quote(cfg_.output);
+        return c.str();
+    }
+
+    std::string codecArgs() const {
+        const bool h265 = cfg_.codec == VideoCodec::H265;
+        std::ostringstream c;
+        switch (cfg_.backend) {
+            case EncoderBackend::Nvenc:
+                // NVENC takes RGBA and converts on the GPU
+                c << " -c:v " << (h265 ? "hevc_nvenc" : "h264_nvenc") << " -preset p4";
+                break;
+            case EncoderBackend::Vaapi:
+                c << " -vf format=nv12,hwupload -c:v " << (h265 ? "hevc_vaapi" : "h264_vaapi");
+                break;
+            default:
+                c << " -c:v " << (h265 ? "libx265" : "libx264") << " -preset veryfast -pix_fmt yuv420p";
+                break;
+        }
+        c << " -b:v " << cfg_.bitrateKbps << "k";
+        return c.str();
+    }
+
+    // Encodes one generated frame at the output size with the same encoder
+    // settings into the null muxer. Fails when the binary is missing, the
+    // build lacks the encoder, or NVENC / the VAAPI device is not usable.
+    bool probe() const {
+        std::ostringstream c;
+        c << quote(cfg_.ffmpeg) << " -hide_banner -loglevel error";
+        if (cfg_.backend == EncoderBackend::Vaapi) c << " -vaapi_device " << quote(cfg_.vaapiDevice);
+        c << " -f lavfi -i color=c=black:s=" << width_ << "x" << height_ << ":r=" << cfg_.fps << " -frames:v 1";
+        c << codecArgs() << " -f null -";
+#ifdef _WIN32
+        c << " >NUL";
+#else
+        c << " >/dev/null";
+#endif
+        return std::system(c.str().c_str()) == 0;
+    }
+};
+
+// ----- Raw dump (RGBA / NV12 / Y4M into one preallocated file) -----
+
+constexpr size_t kDirectAlign = 4096;
+
+size_t alignUp(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+uint8_t clampByte(int v) {
+    return static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+}
+
+// BT.601 limited range. The chroma of each 2x2 block is taken from its
+// average colour. NV12 interleaves U/V after the luma plane, I420 (Y4M)
+// stores a U plane and then a V plane.
+void rgbaToYuv420(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* dst, bool interleaved) {
+    const uint32_t cw = (width + 1) / 2, ch = (height + 1) / 2;
+    uint8_t* yPlane = dst;
+    uint8_t* uPlane = dst + static_cast<size_t>(width) * height;
+    uint8_t* vPlane = interleaved ? uPlane + 1 : uPlane + static_cast<size_t>(cw) * ch;
+    const size_t step = interleaved ? 2 : 1;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = rgba + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; ++x) {
+            const int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            yPlane[static_cast<size_t>(y) * width + x] = clampByte(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+        }
+    }
+    for (uint32_t cy = 0; cy < ch; ++cy) {
+        for (uint32_t cx = 0; cx < cw; ++cx) {
+            int r = 0, g = 0, b = 0;
+            for (uint32_t dy = 0; dy < 2; ++dy) {
+                for (uint32_t dx = 0; dx < 2; ++dx) {
+                    const uint32_t x = std::min(cx * 2 + dx, width - 1), y = std::min(cy * 2 + dy, height - 1);
+                    const uint8_t* p = rgba + (static_cast<size_t>(y) * width + x) * 4;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+            }
+            r /= 4; g /= 4; b /= 4;
+            const size_t i = (static_cast<size_t>(cy) * cw + cx) * step;
+            uPlane[i] = clampByte(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            vPlane[i] = clampByte(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        }
+    }
+}
+
+// File opened for unbuffered writes. Offsets, sizes and source buffers must
+// be multiples of kDirectAlign.
+class DirectFile {
+public:
+    ~DirectFile() { close(); }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#endif
+        fd_ = ::open(path.c_str(), flags, 0644);
+#if defined(__APPLE__)
+        if (fd_ >= 0) fcntl(fd_, F_NOCACHE, 1);
+#endif
+        return fd_ >= 0;
+#endif
+    }
+
+    // Safe to call from several threads for disjoint ranges
+    bool write(const uint8_t* data, size_t bytes, uint64_t offset) {
+#ifdef _WIN32
+        OVERLAPPED ov{};
+        ov.Offset = static_cast<DWORD>(offset & 0xffffffffu);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        return WriteFile(handle_, data, static_cast<DWORD>(bytes), &written, &ov) && written == bytes;
+#else
+        while (bytes > 0) {
+            ssize_t n = pwrite(fd_, data, bytes, static_cast<off_t>(offset));
+            if (n <= 0) return false;
+            data += n;
+            bytes -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+#else
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Page-aligned scratch buffer, one per writer thread
+uint8_t* alignedScratch(size_t bytes) {
+    thread_local std::vector<uint8_t> storage;
+    if (storage.size() < bytes + kDirectAlign) storage.assign(bytes + kDirectAlign, 0);
+    const uintptr_t p = reinterpret_cast<uintptr_t>(storage.data());
+    return reinterpret_cast<uint8_t*>(alignUp(p, kDirectAlign));
+}
+
+class RawEncoder : public VideoEncoder {
+public:
+    explicit RawEncoder(const VideoWriterConfig& cfg) : cfg_(cfg) {}
+    ~RawEncoder() override { close(); }
+
+    bool open(uint32_t width, uint32_t height) override {
+        close();
+        width_ = width;
+        height_ = height;
+        y4m_ = endsWith(lowercase(cfg_.output), ".y4m");
+        yuv_ = y4m_ || cfg_.rawFormat == RawFormat::Nv12;
+        const size_t chroma = 2 * static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+        payload_ = yuv_ ? static_cast<size_t>(width) * height + chroma : static_cast<size_t>(width) * height * 4;
+        direct_ = cfg_.directIo;
+        if (direct_ && y4m_) {
+            // Y4M has no room for alignment padding
+            std::cerr << "VideoEncoder: direct_io is not available for .y4m, using a mapping\n";
+            direct_ = false;
+        }
+
+        std::string header;
+        if (y4m_) {
+            std::ostringstream h;
+            h << "YUV4MPEG2 W" << width << " H" << height << " F" << cfg_.fps << ":1 Ip A1:1 C420jpeg\n";
+            header = h.str();
+            dataOffset_ = header.size();
+            stride_ = sizeof(kY4mFrame) - 1 + payload_;
+        } else {
+            dataOffset_ = kDirectAlign;
+            stride_ = direct_ ? alignUp(payload_, kDirectAlign) : payload_;
+        }
+        frames_ = 0;
+
+        if (direct_) {
+            if (!file_.open(cfg_.output)) {
+                std::cerr << "VideoEncoder: cannot open " << cfg_.output << " for direct I/O\n";
+                return false;
+            }
+        } else {
+            reserve_ = static_cast<size_t>(std::max(cfg_.rawReserveFrames, 1));
+            if (!map_.create(cfg_.output, dataOffset_ + reserve_ * stride_)) {
+                std::cerr << "VideoEncoder: cannot map " << cfg_.output << "\n";
+                return false;
+            }
+            if (y4m_) std::memcpy(map_.writable_data(), header.data(), header.size());
+        }
+        open_ = true;
+        std::cout << "VideoEncoder: raw " << (y4m_ ? "y4m" : yuv_ ? "nv12" : "rgba")
+                  << (direct_ ? " (direct I/O)" : "") << " -> " << cfg_.output << "\n";
+        return true;
+    }
+
+    std::string encode(const uint8_t* rgba, uint64_t index) override {
+        if (!open_) return {};
+        const uint64_t offset = dataOffset_ + index * stride_;
+        bool ok;
+        if (direct_) {
+            uint8_t* buf = alignedScratch(stride_);
+            convert(rgba, buf);
+            ok = file_.write(buf, stride_, offset);
+        } else {
+            ok = writeMapped(rgba, offset);
+        }
+        if (!ok) return {};
+        uint64_t count = frames_.load(std::memory_order_relaxed);
+        while (count < index + 1 && !frames_.compare_exchange_weak(count, index + 1, std::memory_order_relaxed)) {}
+        return cfg_.output;
+    }
+
+    std::string target(uint64_t) const override { return cfg_.output; }
+
+    // Frames land at disjoint offsets, so writers need no ordering
+    bool parallel() const override { return true; }
+
+    void close() override {
+        if (!open_) return;
+        open_ = false;
+        const uint64_t frames = frames_.load();
+        if (direct_) {
+            uint8_t* block = alignedScratch(kDirectAlign);
+            std::memset(block, 0, kDirectAlign);
+            writeHeader(block, frames);
+            if (!file_.write(block, kDirectAlign, 0)) std::cerr << "VideoEncoder: failed to write raw header\n";
+            file_.close();
+        } else {
+            // Drop the unused reservation
+            map_.resize(dataOffset_ + frames * stride_);
+            if (!y4m_ && map_.writable_data()) writeHeader(map_.writable_data(), frames);
+            map_.close();
+        }
+    }
+
+private:
+    static constexpr char kY4mFrame[] = "FRAME\n";
+
+    VideoWriterConfig cfg_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    bool y4m_ = false;
+    bool yuv_ = false;
+    bool direct_ = false;
+    bool open_ = false;
+    size_t payload_ = 0;
+    size_t stride_ = 0;
+    size_t reserve_ = 0;
+    uint64_t dataOffset_ = 0;
+    std::atomic<uint64_t> frames_{0};
+    MappedFile map_;
+    std::shared_mutex mapMutex_; // exclusive while the mapping grows
+    DirectFile file_;
+
+    void convert(const uint8_t* rgba, uint8_t* dst) const {
+        if (yuv_) rgbaToYuv420(rgba, width_, height_, dst, !y4m_);
+        else std::memcpy(dst, rgba, payload_);
+    }
+
+    bool writeMapped(const uint8_t* rgba, uint64_t offset) {
+        std::shared_lock<std::shared_mutex> lock(mapMutex_);
+        while (offset + stride_ > map_.size()) {
+            lock.unlock();
+            {
+                std::unique_lock<std::shared_mutex> grow(mapMutex_);
+                if (offset + stride_ > map_.size()) {
+                    const size_t frames = (offset + stride_ - dataOffset_) / stride_;
+                    const size_t size = dataOffset_ + alignUp(frames, reserve_) * stride_;
+                    if (!map_.resize(size)) {
+                        std::cerr << "VideoEncoder: cannot grow " << cfg_.output << "\n";
+                        return false;
+                    }
+                }
+            }
+            lock.lock();
+        }
+        uint8_t* dst = map_.writable_data() + offset;
+        if (y4m_) {
+            std::memcpy(dst, kY4mFrame, sizeof(kY4mFrame) - 1);
+            dst += sizeof(kY4mFrame) - 1;
+        }
+        convert(rgba, dst);
+        return true;
+    }
+
+    void writeHeader(uint8_t* dst, uint64_t frames) const {
+        RawDumpHeader h{};
+        std::memcpy(h.magic, "VGRAW001", sizeof(h.magic));
+        h.format = yuv_ ? static_cast<uint32_t>(RawFormat::Nv12) : static_cast<uint32_t>(RawFormat::Rgba);
+        h.width = width_;
+        h.height = height_;
+        h.fps = static_cast<uint32_t>(cfg_.fps);
+        h.frameBytes = payload_;
+        h.frameStride = stride_;
+        h.dataOffset = dataOffset_;
+        h.frameCount = frames;
+        std::memcpy(dst, &h, sizeof(h));
+    }
+};
+
+} // namespace
+
+const char* encoderBackendName(EncoderBackend backend) {
+    switch (backend) {
+        case EncoderBackend::Software: return "software";
+        case EncoderBackend::Nvenc: return "nvenc";
+        case EncoderBackend::Vaapi: return "vaapi";
+        case EncoderBackend::Raw: return "raw";
+        case EncoderBackend::Png: break;
+    }
+    return "png";
+}
+
+bool isVideoOption(const std::string& key) {
+    return key == "encoder" || key == "codec" || key == "output" || key == "fps" || key == "bitrate" ||
+           key == "ffmpeg" || key == "vaapi_device" || key == "writers" || key == "write_queue" ||
+           key == "raw_format" || key == "raw_reserve" || key == "direct_io";
+}
+
+bool applyVideoOption(VideoWriterConfig& cfg, const std::string& key, const std::string& value) {
+    const std::string l = lowercase(value);
+    if (key == "encoder") {
+        if (l == "png") cfg.backend = EncoderBackend::Png;
+        else if (l == "software" || l == "x264" || l == "cpu") cfg.backend = EncoderBackend::Software;
+        else if (l == "nvenc") cfg.backend = EncoderBackend::Nvenc;
+        else if (l == "vaapi") cfg.backend = EncoderBackend::Vaapi;
+        else if (l == "raw") cfg.backend = EncoderBackend::Raw;
+        else return false;
+        return true;
+    }
+    if (key == "codec") {
+        if (l == "h264" || l == "avc") cfg.codec = VideoCodec::H264;
+        else if (l == "h265" || l == "hevc") cfg.codec = VideoCodec::H265;
+        else return false;
+        return true;
+    }
+    if (key == "output") { cfg.output = value; return !value.empty(); }
+    if (key == "fps") return parseInt(value, cfg.fps);
+    if (key == "bitrate") return parseInt(value, cfg.bitrateKbps);
+    if (key == "ffmpeg") { cfg.ffmpeg = value; return !value.empty(); }
+    if (key == "vaapi_device") { cfg.vaapiDevice = value; return !value.empty(); }
+    if (key == "writers") {
+        if (value == "0") { cfg.writerThreads = 0; return true; }
+        return parseInt(value, cfg.writerThreads);
+    }
+    if (key == "write_queue") return parseInt(value, cfg.queueDepth);
+    if (key == "raw_format") {
+        if (l == "rgba") cfg.rawFormat = RawFormat::Rgba;
+        else if (l == "nv12") cfg.rawFormat = RawFormat::Nv12;
+        else return false;
+        return true;
+    }
+    if (key == "raw_reserve") return parseInt(value, cfg.rawReserveFrames);
+    if (key == "direct_io") {
+        if (value != "0" && value != "1") return false;
+        cfg.directIo = value == "1";
+        return true;
+    }
+    return false;
+}
+
+std::unique_ptr<VideoEncoder> VideoEncoder::create(const VideoWriterConfig& cfg) {
+    if (cfg.backend == EncoderBackend::Png) return std::make_unique<PngEncoder>(cfg.output);
+    if (cfg.backend == EncoderBackend::Raw) {
+        // The default output names the PNG folder
+        if (cfg.output != VideoWriterConfig().output) return std::make_unique<RawEncoder>(cfg);
+        VideoWriterConfig raw = cfg;
+        raw.output += ".raw";
+        return std::make_unique<RawEncoder>(raw);
+    }
+    return std::make_unique<FfmpegEncoder>(cfg);
+}
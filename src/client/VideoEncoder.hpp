@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Backends behind VideoWriter. Png keeps one file per frame; the others pipe
+// raw RGBA frames into an ffmpeg process that encodes H.264/H.265 on the CPU
+// (libx264/libx265), NVENC or VAAPI and muxes into a container picked from
+// the output name (.mp4, .mkv, ...) or streams to rtmp:// / srt:// URLs.
+// open() test-encodes one frame first, so a missing ffmpeg or an unusable
+// encoder fails the open and VideoWriter falls back to PNG.
+//
+// Raw dumps uncompressed frames into one preallocated file for other tools:
+// a .y4m output is a standard YUV4MPEG2 (I420) stream, anything else gets a
+// 4 KiB RawDumpHeader followed by frames at a fixed stride. Frames are
+// converted straight into a memory mapping of the file, or written with
+// O_DIRECT / unbuffered I/O from aligned buffers when directIo is set.
+enum class EncoderBackend { Png, Software, Nvenc, Vaapi, Raw };
+enum class VideoCodec { H264, H265 };
+enum class RawFormat { Rgba, Nv12 };
+
+struct RawDumpHeader {
+    char magic[8];        // "VGRAW001"
+    uint32_t format;      // RawFormat: 0 = RGBA8, 1 = NV12 (BT.601 limited range)
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint64_t frameBytes;  // payload of one frame
+    uint64_t frameStride; // distance between frames (payload rounded up for O_DIRECT)
+    uint64_t dataOffset;  // first frame
+    uint64_t frameCount;  // frame i is at dataOffset + i * frameStride
+};
+
+struct VideoWriterConfig {
+    EncoderBackend backend = EncoderBackend::Png;
+    VideoCodec codec = VideoCodec::H264;
+    std::string output = "frames_out"; // folder for Png, file or URL otherwise (Raw: frames_out.raw)
+    int fps = 30;
+    int bitrateKbps = 8000;
+    std::string ffmpeg = "ffmpeg";     // executable used by the streaming backends
+    std::string vaapiDevice = "/dev/dri/renderD128";
+    int writerThreads = 2;             // 0 = encode on the thread calling writeFrame
+    int queueDepth = 8;                // frames buffered before writeFrame blocks
+    RawFormat rawFormat = RawFormat::Rgba;
+    int rawReserveFrames = 64;         // Raw: file space reserved up front and per growth step
+    bool directIo = false;             // Raw: bypass the page cache instead of mapping the file
+};
+
+// --encoder=png|software|nvenc|vaapi|raw --codec=h264|h265 --output= --fps= --bitrate= --ffmpeg=
+// --vaapi_device= --writers= --write_queue= --raw_format=rgba|nv12 --raw_reserve= --direct_io=0|1
+// Returns false for unknown keys or bad values.
+bool applyVideoOption(VideoWriterConfig& cfg, const std::string& key, const std::string& value);
+bool isVideoOption(const std::string& key);
+const char* encoderBackendName(EncoderBackend backend);
+
+class VideoEncoder {
+public:
+    virtual ~VideoEncoder() = default;
+
+    virtual bool open(uint32_t width, uint32_t height) = 0;
+
+    // rgba: width * height * 4 bytes, any host memory (pageable or pinned).
+    // `index` is the frame number, counted by the caller.
+    // Returns where the frame went (file, container or URL), empty on failure.
+    virtual std::string encode(const uint8_t* rgba, uint64_t index) = 0;
+
+    // Where frame `index` will go, before it has been encoded
+    virtual std::string target(uint64_t index) const = 0;
+
+    // True when encode() may run on several threads at once, in any order.
+    // Otherwise frames must arrive one at a time, in index order.
+    virtual bool parallel() const { return false; }
+
+    // Flushes and finalizes the container; called again by the destructor
+    virtual void close() = 0;
+
+    static std::unique_ptr<VideoEncoder> create(const VideoWriterConfig& cfg);
+};
@@ -1,21 +1,134 @@
 #include "VideoWriter.hpp"
-#include "stb_image_write.h"
-#include <sstream>
-#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 
 VideoWriter::VideoWriter(const std::string& folder, uint32_t w, uint32_t h)
-    : folder_(folder), width_(w), height_(h), frameIndex_(0)
+    : width_(w), height_(h)
 {
-    std::filesystem::create_directories(folder_);
+    VideoWriterConfig cfg;
+    cfg.output = folder;
+    open(cfg);
 }
 
-VideoWriter::~VideoWriter() {}
+VideoWriter::VideoWriter(const VideoWriterConfig& cfg, uint32_t w, uint32_t h)
+    : width_(w), height_(h)
+{
+    open(cfg);
+}
+
+VideoWriter::~VideoWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_all();
+    for (auto& t : workers_) t.join();
+    if (encoder_) encoder_->close();
+}
+
+void VideoWriter::open(const VideoWriterConfig& cfg) {
+    encoder_ = VideoEncoder::create(cfg);
+    if (encoder_->open(width_, height_)) {
+        startWorkers(cfg);
+        return;
+    }
+
+    if (cfg.backend != EncoderBackend::Png) {
+        std::cerr << "VideoWriter: " << encoderBackendName(cfg.backend)
+                  << " encoder unavailable, writing PNG frames to frames_out\n";
+        VideoWriterConfig png;
+        png.writerThreads = cfg.writerThreads;
+        png.queueDepth = cfg.queueDepth;
+        encoder_ = VideoEncoder::create(png);
+        if (encoder_->open(width_, height_)) {
+            startWorkers(png);
+            return;
+        }
+    }
+    std::cerr << "VideoWriter: cannot open output\n";
+    encoder_.reset();
+}
+
+void VideoWriter::startWorkers(const VideoWriterConfig& cfg) {
+    int threads = std::max(cfg.writerThreads, 0);
+    if (!encoder_->parallel()) threads = std::min(threads, 1);
+    queueDepth_ = static_cast<size_t>(std::max(cfg.queueDepth, 1));
+    for (int i = 0; i < threads; ++i) workers_.emplace_back(&VideoWriter::workerLoop, this);
+}
 
 std::string VideoWriter::writeFrame(const uint8_t* rgbaData) {
-    std::ostringstream ss;
-    ss << folder_ << "/frame_" << frameIndex_++ << ".png";
-    std::string path = ss.str();
+    if (!rgbaData || !encoder_) return {};
+    const size_t bytes = static_cast<size_t>(width_) * height_ * 4;
+    if (workers_.empty()) return encodeNow(rgbaData);
 
-    stbi_write_png(path.c_str(), width_, height_, 4, rgbaData, width_ * 4);
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!freeBuffers_.empty()) {
+            buffer = std::move(freeBuffers_.back());
+            freeBuffers_.pop_back();
+        }
+    }
+    buffer.resize(bytes);
+    std::memcpy(buffer.data(), rgbaData, bytes);
+    return enqueue(std::move(buffer));
+}
+
+std::string VideoWriter::writeFrame(std::vector<uint8_t>&& rgba) {
+    if (!encoder_ || rgba.size() < static_cast<size_t>(width_) * height_ * 4) return {};
+    if (workers_.empty()) return encodeNow(rgba.data());
+    return enqueue(std::move(rgba));
+}
+
+std::string VideoWriter::encodeNow(const uint8_t* rgba) {
+    std::string path = encoder_->encode(rgba, frameIndex_++);
+    if (path.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++failed_;
+    }
     return path;
 }
+
+std::string VideoWriter::enqueue(std::vector<uint8_t>&& rgba) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [&] { return pending_ < queueDepth_; });
+    const uint64_t index = frameIndex_++;
+    queue_.push_back(Frame{index, std::move(rgba)});
+    ++pending_;
+    lock.unlock();
+    queued_.notify_one();
+    return encoder_->target(index);
+}
+
+void VideoWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [&] { return pending_ == 0; });
+}
+
+uint64_t VideoWriter::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+void VideoWriter::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        queued_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        Frame frame = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        const bool ok = !encoder_->encode(frame.rgba.data(), frame.index).empty();
+        if (!ok) std::cerr << "VideoWriter: failed to write frame " << frame.index << "\n";
+
+        lock.lock();
+        if (!ok) ++failed_;
+        // Keep at most one buffer per queue slot for reuse
+        if (freeBuffers_.size() < queueDepth_) freeBuffers_.push_back(std::move(frame.rgba));
+        --pending_;
+        drained_.notify_all();
+    }
+}
@@ -1,18 +1,73 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
+#include "VideoEncoder.hpp"
+
+// Frames are copied (or moved) into pooled buffers and encoded by
+// cfg.writerThreads workers, so writeFrame() only blocks once cfg.queueDepth
+// frames are pending. Frame numbers are assigned in writeFrame() order, so
+// file names stay in order even when PNGs are compressed in parallel;
+// encoders that need ordered input get a single worker.
 class VideoWriter {
 public:
+    // PNG sequence in `folder` (frame_N.png)
     VideoWriter(const std::string& folder, uint32_t w, uint32_t h);
+
+    // Any backend from VideoEncoder.hpp; a backend that fails to start falls
+    // back to a PNG sequence so frames are not lost
+    VideoWriter(const VideoWriterConfig& cfg, uint32_t w, uint32_t h);
+
+    // Drains every pending frame and finalizes the output
     ~VideoWriter();
 
+    VideoWriter(const VideoWriter&) = delete;
+    VideoWriter& operator=(const VideoWriter&) = delete;
+
+    // Returns where the frame will be written (written already when the
+    // writer is synchronous), empty on failure
     std::string writeFrame(const uint8_t* rgbaData);
 
+    // Takes ownership of a width * height * 4 byte frame instead of copying it
+    std::string writeFrame(std::vector<uint8_t>&& rgba);
+
+    // Blocks until every frame handed to writeFrame() has been encoded
+    void flush();
+
+    // Frames the encoder rejected so far
+    uint64_t failed() const;
+
 private:
-    std::string folder_;
+    struct Frame {
+        uint64_t index = 0;
+        std::vector<uint8_t> rgba;
+    };
+
+    std::unique_ptr<VideoEncoder> encoder_;
     uint32_t width_;
     uint32_t height_;
-    int frameIndex_;
+    uint64_t frameIndex_ = 0;
+    size_t queueDepth_ = 1;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_;  // a frame was queued, or stopping
+    std::condition_variable drained_; // a frame finished
+    std::deque<Frame> queue_;
+    std::vector<std::vector<uint8_t>> freeBuffers_;
+    size_t pending_ = 0; // queued + being encoded
+    uint64_t failed_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    void open(const VideoWriterConfig& cfg);
+    void startWorkers(const VideoWriterConfig& cfg);
+    std::string encodeNow(const uint8_t* rgba);
+    std::string enqueue(std::vector<uint8_t>&& rgba);
+    void workerLoop();
 };
@@ -1,29 +1,77 @@
 #include "VulkanContext.hpp"
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <vector>
 #include <iostream>
 
+namespace fs = std::filesystem;
+
+namespace {
+
+#ifdef _WIN32
+const char* kExternalMemoryExt = VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME;
+#else
+const char* kExternalMemoryExt = VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME;
+#endif
+
+bool hasDeviceExtension(VkPhysicalDevice device, const char* name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> exts(count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, exts.data());
+    for (const VkExtensionProperties& e : exts) {
+        if (std::strcmp(e.extensionName, name) == 0) return true;
+    }
+    return false;
+}
+
+} // namespace
+
 VulkanContext::~VulkanContext() {
     cleanup();
 }
 
-bool VulkanContext::init() {
+bool VulkanContext::init(bool presentation, int deviceIndex) {
+    presentation_ = presentation;
     if (!createInstance()) return false;
-    if (!pickPhysicalDevice()) return false;
+    if (!pickPhysicalDevice(deviceIndex)) return false;
     if (!createLogicalDevice()) return false;
     if (!createCommandPool()) return false;
+    // Optional: pipelines are only slower to build without it
+    createPipelineCache();
     return true;
 }
 
 void VulkanContext::cleanup() {
     if (device_) {
         vkDeviceWaitIdle(device_);
+        if (pipelineCache_) {
+            savePipelineCache();
+            vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+            pipelineCache_ = VK_NULL_HANDLE;
+        }
+        if (computeCommandPool_ && computeCommandPool_ != commandPool_)
+            vkDestroyCommandPool(device_, computeCommandPool_, nullptr);
+        if (transferCommandPool_ && transferCommandPool_ != commandPool_ && transferCommandPool_ != computeCommandPool_)
+            vkDestroyCommandPool(device_, transferCommandPool_, nullptr);
+        computeCommandPool_ = VK_NULL_HANDLE;
+        transferCommandPool_ = VK_NULL_HANDLE;
         if (commandPool_) {
             vkDestroyCommandPool(device_, commandPool_, nullptr);
+            commandPool_ = VK_NULL_HANDLE;
         }
         vkDestroyDevice(device_, nullptr);
+        device_ = VK_NULL_HANDLE;
     }
     if (instance_) {
         vkDestroyInstance(instance_, nullptr);
+        instance_ = VK_NULL_HANDLE;
     }
 }
 
@@ -37,27 +85,84 @@ bool VulkanContext::createInstance() {
     ci.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     ci.pApplicationInfo = &app;
 
+    if (presentation_) {
+        uint32_t count = 0;
+        const char** extensions = glfwGetRequiredInstanceExtensions(&count);
+        if (!extensions) {
+            std::cerr << "VulkanContext: GLFW reports no surface extensions\n";
+            return false;
+        }
+        ci.enabledExtensionCount = count;
+        ci.ppEnabledExtensionNames = extensions;
+    }
+
     return vkCreateInstance(&ci, nullptr, &instance_) == VK_SUCCESS;
 }
 
-bool VulkanContext::pickPhysicalDevice() {
+namespace {
+
+// Prefers a family that has `want` but none of `avoid` (dedicated DMA /
+// async compute engines), then one that merely lacks graphics.
+uint32_t findQueueFamily(const std::vector<VkQueueFamilyProperties>& props, VkQueueFlags want,
+                         VkQueueFlags avoid, uint32_t fallback) {
+    for (uint32_t i = 0; i < props.size(); i++) {
+        if ((props[i].queueFlags & want) && !(props[i].queueFlags & avoid)) return i;
+    }
+    for (uint32_t i = 0; i < props.size(); i++) {
+        if ((props[i].queueFlags & want) && !(props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) return i;
+    }
+    return fallback;
+}
+
+} // namespace
+
+bool VulkanContext::pickPhysicalDevice(int preferred) {
     uint32_t count = 0;
     vkEnumeratePhysicalDevices(instance_, &count, nullptr);
     if (count == 0) return false;
 
     std::vector<VkPhysicalDevice> devs(count);
     vkEnumeratePhysicalDevices(instance_, &count, devs.data());
+    if (preferred >= 0 && static_cast<uint32_t>(preferred) < count) {
+        std::rotate(devs.begin(), devs.begin() + preferred, devs.begin() + preferred + 1);
+    } else if (preferred >= 0) {
+        std::cerr << "Vulkan: no device " << preferred << ", using the first usable one\n";
+    }
 
     for (auto d : devs) {
+        // Timeline semaphores need a Vulkan 1.2 device
+        VkPhysicalDeviceProperties p;
+        vkGetPhysicalDeviceProperties(d, &p);
+        if (p.apiVersion < VK_API_VERSION_1_2) continue;
+
         uint32_t qcount = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(d, &qcount, nullptr);
         std::vector<VkQueueFamilyProperties> props(qcount);
         vkGetPhysicalDeviceQueueFamilyProperties(d, &qcount, props.data());
 
         for (uint32_t i = 0; i < qcount; i++) {
+            // Frames are presented from the graphics queue
+            if (presentation_ && !glfwGetPhysicalDevicePresentationSupport(instance_, d, i)) continue;
             if (props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                 physicalDevice_ = d;
                 graphicsQueueFamily_ = i;
+                transferQueueFamily_ = findQueueFamily(props, VK_QUEUE_TRANSFER_BIT,
+                                                       VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, i);
+                computeQueueFamily_ = findQueueFamily(props, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, i);
+
+                properties_ = p;
+                timestampPeriod_ = p.limits.timestampPeriod;
+                timestampBits_.clear();
+                for (const VkQueueFamilyProperties& f : props) timestampBits_.push_back(f.timestampValidBits);
+
+                queueFamilies_ = {graphicsQueueFamily_};
+                for (uint32_t f : {transferQueueFamily_, computeQueueFamily_}) {
+                    bool seen = false;
+                    for (uint32_t q : queueFamilies_) seen = seen || q == f;
+                    if (!seen) queueFamilies_.push_back(f);
+                }
+                std::cout << "Vulkan: " << p.deviceName << " (graphics " << graphicsQueueFamily_
+                          << ", transfer " << transferQueueFamily_ << ", compute " << computeQueueFamily_ << ")\n";
                 return true;
             }
         }
@@ -68,21 +173,63 @@ bool VulkanContext::pickPhysicalDevice() {
 bool VulkanContext::createLogicalDevice() {
     float priority = 1.0f;
 
-    VkDeviceQueueCreateInfo qci{};
-    qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    qci.queueFamilyIndex = graphicsQueueFamily_;
-    qci.queueCount = 1;
-    qci.pQueuePriorities = &priority;
+    std::vector<VkDeviceQueueCreateInfo> queues;
+    for (uint32_t family : queueFamilies_) {
+        VkDeviceQueueCreateInfo qci{};
+        qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        qci.queueFamilyIndex = family;
+        qci.queueCount = 1;
+        qci.pQueuePriorities = &priority;
+        queues.push_back(qci);
+    }
+
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice_, &supported);
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    // Optional: only used by the GPU timers
+    features12.hostQueryReset = supported12.hostQueryReset;
+    hostQueryReset_ = supported12.hostQueryReset == VK_TRUE;
 
     VkDeviceCreateInfo ci{};
     ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    ci.queueCreateInfoCount = 1;
-    ci.pQueueCreateInfos = &qci;
+    ci.pNext = &features12;
+    ci.queueCreateInfoCount = static_cast<uint32_t>(queues.size());
+    ci.pQueueCreateInfos = queues.data();
+
+    std::vector<const char*> extensions;
+    if (presentation_) extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    // Optional: only used by the CUDA interop path
+    externalMemory_ = hasDeviceExtension(physicalDevice_, kExternalMemoryExt);
+    if (externalMemory_) extensions.push_back(kExternalMemoryExt);
+    // Optional: only read by the overlay
+    memoryBudget_ = hasDeviceExtension(physicalDevice_, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget_) extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    ci.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    ci.ppEnabledExtensionNames = extensions.data();
 
     if (vkCreateDevice(physicalDevice_, &ci, nullptr, &device_) != VK_SUCCESS)
         return false;
 
+    VkPhysicalDeviceIDProperties idProps{};
+    idProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 props2{};
+    props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props2.pNext = &idProps;
+    vkGetPhysicalDeviceProperties2(physicalDevice_, &props2);
+    std::memcpy(deviceUUID_, idProps.deviceUUID, VK_UUID_SIZE);
+
     vkGetDeviceQueue(device_, graphicsQueueFamily_, 0, &graphicsQueue_);
+    vkGetDeviceQueue(device_, transferQueueFamily_, 0, &transferQueue_);
+    vkGetDeviceQueue(device_, computeQueueFamily_, 0, &computeQueue_);
     return true;
 }
 
@@ -92,7 +239,109 @@ bool VulkanContext::createCommandPool() {
     ci.queueFamilyIndex = graphicsQueueFamily_;
     ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    return vkCreateCommandPool(device_, &ci, nullptr, &commandPool_) == VK_SUCCESS;
+    if (vkCreateCommandPool(device_, &ci, nullptr, &commandPool_) != VK_SUCCESS)
+        return false;
+
+    // One pool per family; an aliased queue shares the pool of its family
+    transferCommandPool_ = commandPool_;
+    if (hasAsyncTransfer()) {
+        ci.queueFamilyIndex = transferQueueFamily_;
+        if (vkCreateCommandPool(device_, &ci, nullptr, &transferCommandPool_) != VK_SUCCESS)
+            return false;
+    }
+    computeCommandPool_ = commandPool_;
+    if (computeQueueFamily_ == transferQueueFamily_) {
+        computeCommandPool_ = transferCommandPool_;
+    } else if (hasAsyncCompute()) {
+        ci.queueFamilyIndex = computeQueueFamily_;
+        if (vkCreateCommandPool(device_, &ci, nullptr, &computeCommandPool_) != VK_SUCCESS)
+            return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Checks the VkPipelineCacheHeaderVersionOne prefix before handing a file to
+// the driver; most drivers validate it too, but not all of them gracefully
+bool matchesPipelineCache(const std::vector<char>& data, const VkPhysicalDeviceProperties& p) {
+    constexpr size_t kHeaderSize = 16 + VK_UUID_SIZE;
+    if (data.size() < kHeaderSize) return false;
+    uint32_t header[4];
+    std::memcpy(header, data.data(), sizeof(header));
+    return header[0] >= kHeaderSize && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header[2] == p.vendorID && header[3] == p.deviceID &&
+           std::memcmp(data.data() + 16, p.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+} // namespace
+
+void VulkanContext::createPipelineCache() {
+    std::vector<char> initial;
+    if (!pipelineCacheDir_.empty()) {
+        char name[96];
+        std::snprintf(name, sizeof(name), "vk_pipelines_%04x_%04x_%08x_", properties_.vendorID,
+                      properties_.deviceID, properties_.driverVersion);
+        std::string file = name;
+        for (int i = 0; i < 8; ++i) {
+            std::snprintf(name, sizeof(name), "%02x", properties_.pipelineCacheUUID[i]);
+            file += name;
+        }
+        pipelineCachePath_ = (fs::path(pipelineCacheDir_) / (file + ".bin")).string();
+
+        std::ifstream in(pipelineCachePath_, std::ios::binary);
+        if (in) {
+            initial.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            if (!matchesPipelineCache(initial, properties_)) {
+                std::cerr << "VulkanContext: ignoring mismatched pipeline cache " << pipelineCachePath_ << "\n";
+                initial.clear();
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    ci.initialDataSize = initial.size();
+    ci.pInitialData = initial.empty() ? nullptr : initial.data();
+    if (vkCreatePipelineCache(device_, &ci, nullptr, &pipelineCache_) != VK_SUCCESS && !initial.empty()) {
+        // The driver refused the data; an empty cache still helps within this run
+        initial.clear();
+        ci.initialDataSize = 0;
+        ci.pInitialData = nullptr;
+        if (vkCreatePipelineCache(device_, &ci, nullptr, &pipelineCache_) != VK_SUCCESS) pipelineCache_ = VK_NULL_HANDLE;
+    }
+    pipelineCacheLoaded_ = initial.size();
+    if (pipelineCacheLoaded_ > 0)
+        std::cout << "Vulkan: pipeline cache loaded (" << pipelineCacheLoaded_ / 1024 << " KiB)\n";
+}
+
+// Written to a temporary file and renamed, so a crash mid-write or two
+// processes saving at once never leave a torn cache behind
+void VulkanContext::savePipelineCache() {
+    if (pipelineCachePath_.empty()) return;
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device_, pipelineCache_, &size, nullptr) != VK_SUCCESS || size == 0) return;
+    // Entries are only ever added, so an unchanged size means nothing new was compiled
+    if (size == pipelineCacheLoaded_) return;
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device_, pipelineCache_, &size, data.data()) != VK_SUCCESS) return;
+
+    std::error_code ec;
+    fs::create_directories(fs::path(pipelineCachePath_).parent_path(), ec);
+    const std::string tmp = pipelineCachePath_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(size));
+        if (!out) {
+            std::cerr << "VulkanContext: cannot write pipeline cache " << tmp << "\n";
+            return;
+        }
+    }
+    fs::rename(tmp, pipelineCachePath_, ec);
+    if (ec) {
+        std::cerr << "VulkanContext: cannot save pipeline cache: " << ec.message() << "\n";
+        fs::remove(tmp, ec);
+    }
 }
 
 VkCommandBuffer VulkanContext::beginSingleTimeCommands() {
@@ -112,4 +361,93 @@ VkCommandBuffer VulkanContext::beginSingleTimeCommands() {
     vkBeginCommandBuffer(cmd, &bi);
 
     return cmd;
-}
\ No newline at end of file
+}
+void VulkanContext::endSingleTimeCommands(VkCommandBuffer cmd) {
+    vkEndCommandBuffer(cmd);
+
+    VkSubmitInfo si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &cmd;
+
+    vkQueueSubmit(graphicsQueue_, 1, &si, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphicsQueue_);
+    vkFreeCommandBuffers(device_, commandPool_, 1, &cmd);
+}
+
+VkSemaphore VulkanContext::createTimelineSemaphore(uint64_t initialValue) {
+    VkSemaphoreTypeCreateInfo tci{};
+    tci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    tci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    tci.initialValue = initialValue;
+
+    VkSemaphoreCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    ci.pNext = &tci;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    if (vkCreateSemaphore(device_, &ci, nullptr, &semaphore) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return semaphore;
+}
+
+bool VulkanContext::waitTimeline(VkSemaphore semaphore, uint64_t value, uint64_t timeoutNs) {
+    VkSemaphoreWaitInfo wi{};
+    wi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wi.semaphoreCount = 1;
+    wi.pSemaphores = &semaphore;
+    wi.pValues = &value;
+    return vkWaitSemaphores(device_, &wi, timeoutNs) == VK_SUCCESS;
+}
+
+VkQueryPool VulkanContext::createTimestampPool(uint32_t count) {
+    if (!hostQueryReset_) return VK_NULL_HANDLE;
+    VkQueryPoolCreateInfo qi{};
+    qi.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    qi.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    qi.queryCount = count;
+    VkQueryPool pool = VK_NULL_HANDLE;
+    if (vkCreateQueryPool(device_, &qi, nullptr, &pool) != VK_SUCCESS) return VK_NULL_HANDLE;
+    return pool;
+}
+
+bool VulkanContext::memoryBudget(VkDeviceSize& usage, VkDeviceSize& budget) const {
+    usage = budget = 0;
+    if (!memoryBudget_) return false;
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT mb{};
+    mb.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props.pNext = &mb;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice_, &props);
+    for (uint32_t i = 0; i < props.memoryProperties.memoryHeapCount; i++) {
+        if (!(props.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+        usage += mb.heapUsage[i];
+        budget += mb.heapBudget[i];
+    }
+    return true;
+}
+
+bool VulkanContext::submit(VkQueue queue, VkCommandBuffer cmd,
+                           VkSemaphore waitSemaphore, uint64_t waitValue, VkPipelineStageFlags waitStage,
+                           VkSemaphore signalSemaphore, uint64_t signalValue, VkFence fence) {
+    VkTimelineSemaphoreSubmitInfo ti{};
+    ti.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    ti.waitSemaphoreValueCount = waitSemaphore ? 1 : 0;
+    ti.pWaitSemaphoreValues = &waitValue;
+    ti.signalSemaphoreValueCount = signalSemaphore ? 1 : 0;
+    ti.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.pNext = &ti;
+    si.waitSemaphoreCount = waitSemaphore ? 1 : 0;
+    si.pWaitSemaphores = &waitSemaphore;
+    si.pWaitDstStageMask = &waitStage;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &cmd;
+    si.signalSemaphoreCount = signalSemaphore ? 1 : 0;
+    si.pSignalSemaphores = &signalSemaphore;
+
+    return vkQueueSubmit(queue, 1, &si, fence) == VK_SUCCESS;
+}
@@ -1,33 +1,117 @@
 #pragma once
 #include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 class VulkanContext {
 public:
     VulkanContext() = default;
     ~VulkanContext();
 
-    bool init();
+    // presentation: enable the GLFW surface extensions and VK_KHR_swapchain and
+    // require a graphics family that can present (GLFW must be initialized).
+    // deviceIndex: physical device to try first (enumeration order), -1 = first usable
+    bool init(bool presentation = false, int deviceIndex = -1);
     void cleanup();
 
+    // Directory for the on-disk pipeline cache; call before init(). The file
+    // name is keyed on vendor, device, driver version and pipelineCacheUUID,
+    // so a driver update starts a fresh file instead of feeding the new driver
+    // stale data. Empty (the default) keeps the cache in memory only.
+    void setPipelineCacheDir(const std::string& dir) { pipelineCacheDir_ = dir; }
+
     VkInstance instance() const { return instance_; }
     VkDevice device() const { return device_; }
     VkPhysicalDevice physicalDevice() const { return physicalDevice_; }
     VkQueue graphicsQueue() const { return graphicsQueue_; }
     VkCommandPool commandPool() const { return commandPool_; }
 
+    // Shared by every pipeline creation; loaded in init() and written back by
+    // cleanup() when it grew. VK_NULL_HANDLE if it could not be created.
+    VkPipelineCache pipelineCache() const { return pipelineCache_; }
+
+    // Async transfer / compute queues. On hardware without a separate family
+    // these alias the graphics queue (and pool), so callers can use them
+    // unconditionally; hasAsyncTransfer()/hasAsyncCompute() tell them apart.
+    VkQueue transferQueue() const { return transferQueue_; }
+    VkQueue computeQueue() const { return computeQueue_; }
+    VkCommandPool transferCommandPool() const { return transferCommandPool_; }
+    VkCommandPool computeCommandPool() const { return computeCommandPool_; }
+    uint32_t graphicsQueueFamily() const { return graphicsQueueFamily_; }
+    uint32_t transferQueueFamily() const { return transferQueueFamily_; }
+    uint32_t computeQueueFamily() const { return computeQueueFamily_; }
+    bool hasAsyncTransfer() const { return transferQueueFamily_ != graphicsQueueFamily_; }
+    bool hasAsyncCompute() const { return computeQueueFamily_ != graphicsQueueFamily_; }
+
+    // External memory (VK_KHR_external_memory_fd / _win32) for sharing buffers
+    // with CUDA; deviceUUID() identifies the matching CUDA device.
+    bool hasExternalMemory() const { return externalMemory_; }
+    const uint8_t* deviceUUID() const { return deviceUUID_; }
+
+    // GPU timestamps (vkCmdWriteTimestamp): nanoseconds per tick, and the valid
+    // bits of a queue family's timestamps (0 = that family cannot write them)
+    float timestampPeriod() const { return timestampPeriod_; }
+    uint32_t timestampBits(uint32_t family) const {
+        return family < timestampBits_.size() ? timestampBits_[family] : 0;
+    }
+    // Query pool of `count` timestamps, VK_NULL_HANDLE on failure or without
+    // hostQueryReset: queries are reset with vkResetQueryPool because a
+    // transfer-only queue cannot record vkCmdResetQueryPool.
+    VkQueryPool createTimestampPool(uint32_t count);
+
+    // Device-local heap usage and budget in bytes (VK_EXT_memory_budget);
+    // false when the extension is missing
+    bool memoryBudget(VkDeviceSize& usage, VkDeviceSize& budget) const;
+
+    // Distinct queue families in use, for VK_SHARING_MODE_CONCURRENT resources
+    const std::vector<uint32_t>& queueFamilies() const { return queueFamilies_; }
+
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer cmd);
 
+    // Timeline semaphores (core in Vulkan 1.2) order work across the queues:
+    // a submit waits for value N on one queue's timeline and signals its own.
+    VkSemaphore createTimelineSemaphore(uint64_t initialValue = 0);
+    bool waitTimeline(VkSemaphore semaphore, uint64_t value, uint64_t timeoutNs = UINT64_MAX);
+
+    // Submits one command buffer. waitSemaphore/signalSemaphore are timeline
+    // semaphores and may be VK_NULL_HANDLE; fence may be VK_NULL_HANDLE.
+    bool submit(VkQueue queue, VkCommandBuffer cmd,
+                VkSemaphore waitSemaphore, uint64_t waitValue, VkPipelineStageFlags waitStage,
+                VkSemaphore signalSemaphore, uint64_t signalValue, VkFence fence);
+
 private:
     VkInstance instance_ = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
     VkDevice device_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_ = VK_NULL_HANDLE;
+    VkQueue transferQueue_ = VK_NULL_HANDLE;
+    VkQueue computeQueue_ = VK_NULL_HANDLE;
     uint32_t graphicsQueueFamily_ = 0;
+    uint32_t transferQueueFamily_ = 0;
+    uint32_t computeQueueFamily_ = 0;
+    std::vector<uint32_t> queueFamilies_;
+    bool presentation_ = false;
+    bool externalMemory_ = false;
+    bool memoryBudget_ = false;
+    uint8_t deviceUUID_[VK_UUID_SIZE] = {};
+    float timestampPeriod_ = 0.f;
+    std::vector<uint32_t> timestampBits_;
+    bool hostQueryReset_ = false;
     VkCommandPool commandPool_ = VK_NULL_HANDLE;
+    VkCommandPool transferCommandPool_ = VK_NULL_HANDLE;
+    VkCommandPool computeCommandPool_ = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties_{};
+    VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+    std::string pipelineCacheDir_;
+    std::string pipelineCachePath_;
+    size_t pipelineCacheLoaded_ = 0; // bytes read from disk
 
     bool createInstance();
-    bool pickPhysicalDevice();
+    bool pickPhysicalDevice(int preferred);
     bool createLogicalDevice();
     bool createCommandPool();
+    void createPipelineCache();
+    void savePipelineCache();
 };
@@ -0,0 +1,71 @@
+#include "Window.hpp"
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <iostream>
+
+Window::~Window() {
+    destroy();
+}
+
+bool Window::create(uint32_t width, uint32_t height, const char* title) {
+    if (!glfwInit()) {
+        std::cerr << "Window: glfwInit failed (no display?)\n";
+        return false;
+    }
+    if (!glfwVulkanSupported()) {
+        std::cerr << "Window: GLFW found no Vulkan loader\n";
+        glfwTerminate();
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    window_ = glfwCreateWindow(static_cast<int>(width), static_cast<int>(height), title, nullptr, nullptr);
+    if (!window_) {
+        std::cerr << "Window: glfwCreateWindow failed\n";
+        glfwTerminate();
+        return false;
+    }
+
+    glfwSetWindowUserPointer(window_, this);
+    glfwSetFramebufferSizeCallback(window_, onFramebufferResize);
+
+    int w = 0, h = 0;
+    glfwGetFramebufferSize(window_, &w, &h);
+    fbWidth_ = static_cast<uint32_t>(w);
+    fbHeight_ = static_cast<uint32_t>(h);
+    return true;
+}
+
+void Window::destroy() {
+    if (window_) {
+        glfwDestroyWindow(window_);
+        window_ = nullptr;
+        glfwTerminate();
+    }
+}
+
+bool Window::shouldClose() const {
+    return !window_ || glfwWindowShouldClose(window_);
+}
+
+void Window::pollEvents() {
+    if (window_) glfwPollEvents();
+}
+
+VkSurfaceKHR Window::createSurface(VkInstance instance) const {
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    if (!window_ || glfwCreateWindowSurface(instance, window_, nullptr, &surface) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return surface;
+}
+
+VkExtent2D Window::framebufferExtent() const {
+    return {fbWidth_.load(), fbHeight_.load()};
+}
+
+void Window::onFramebufferResize(GLFWwindow* window, int width, int height) {
+    auto* self = static_cast<Window*>(glfwGetWindowUserPointer(window));
+    self->fbWidth_ = static_cast<uint32_t>(width);
+    self->fbHeight_ = static_cast<uint32_t>(height);
+}
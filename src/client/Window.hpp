@@ -0,0 +1,38 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+
+struct GLFWwindow;
+
+// GLFW window used as the presentation target. create(), pollEvents() and
+// destroy() belong to the main thread; framebufferExtent() may be read from
+// the render thread (it is updated by the resize callback).
+class Window {
+public:
+    Window() = default;
+    ~Window();
+
+    Window(const Window&) = delete;
+    Window& operator=(const Window&) = delete;
+
+    // Initializes GLFW and opens a resizable window without a GL context
+    bool create(uint32_t width, uint32_t height, const char* title);
+    void destroy();
+
+    bool isOpen() const { return window_ != nullptr; }
+    bool shouldClose() const;
+    void pollEvents();
+
+    VkSurfaceKHR createSurface(VkInstance instance) const;
+    VkExtent2D framebufferExtent() const;
+
+    GLFWwindow* handle() const { return window_; }
+
+private:
+    GLFWwindow* window_ = nullptr;
+    std::atomic<uint32_t> fbWidth_{0};
+    std::atomic<uint32_t> fbHeight_{0};
+
+    static void onFramebufferResize(GLFWwindow* window, int width, int height);
+};
@@ -0,0 +1,109 @@
+#version 450
+
+// In-between frame synthesis for two RGBA8 keyframes, in two passes over the
+// same descriptor set:
+//   mode 0: one invocation per 8x8 block estimates the block's motion by a
+//           symmetric search (prev at p - v/2 against next at p + v/2, so the
+//           match is centred on the in-between frame and leaves no holes)
+//   mode 1: one invocation per pixel warps both keyframes along the motion
+//           (interpolated between neighbouring blocks) to time t and blends
+//           them; blocks that found no good match fade to a plain cross-fade.
+// Each pass is its own pipeline, specialized on kMode.
+
+// Specialization constants, set by Renderer::createInterpolatePipeline
+layout(local_size_x_id = 0, local_size_y_id = 1) in;
+layout(constant_id = 2) const int kBlock = 8;  // motion block size in pixels
+layout(constant_id = 3) const int kRange = 16; // search radius in pixels (even)
+layout(constant_id = 4) const uint kMode = 0u;
+
+layout(set = 0, binding = 0) uniform sampler2D prevFrame;
+layout(set = 0, binding = 1) uniform sampler2D nextFrame;
+
+// Per block: motion prev -> next in pixels, and match confidence in [0, 1]
+layout(std430, set = 0, binding = 2) buffer Flow {
+    vec4 blocks[];
+} flow;
+
+layout(set = 0, binding = 3, rgba8) uniform writeonly image2D outImage;
+
+// Must match InterpolateParams in Renderer.cpp
+layout(push_constant) uniform Params {
+    uint width;
+    uint height;
+    uint blocksX;
+    uint blocksY;
+    float t;    // 0 = prev, 1 = next
+    float pad;
+} params;
+
+float luma(vec3 c) {
+    return dot(c, vec3(0.299, 0.587, 0.114));
+}
+
+float lumaAt(sampler2D s, ivec2 p) {
+    p = clamp(p, ivec2(0), ivec2(params.width, params.height) - 1);
+    return luma(texelFetch(s, p, 0).rgb);
+}
+
+void estimate(uvec2 block) {
+    if (block.x >= params.blocksX || block.y >= params.blocksY) return;
+    ivec2 origin = ivec2(block) * kBlock;
+
+    float best = 1e9;
+    ivec2 bestV = ivec2(0);
+    float zeroCost = 0.0;
+    for (int vy = -kRange; vy <= kRange; vy += 2) {
+        for (int vx = -kRange; vx <= kRange; vx += 2) {
+            ivec2 h = ivec2(vx, vy) / 2;
+            float sad = 0.0;
+            // Every other pixel of the block is enough for a match score
+            for (int y = 0; y < kBlock; y += 2)
+                for (int x = 0; x < kBlock; x += 2) {
+                    ivec2 p = origin + ivec2(x, y);
+                    sad += abs(lumaAt(prevFrame, p - h) - lumaAt(nextFrame, p + h));
+                }
+            // Slight preference for small motion keeps flat areas still
+            float cost = sad + 0.002 * float(abs(vx) + abs(vy));
+            if (vx == 0 && vy == 0) zeroCost = cost;
+            if (cost < best) {
+                best = cost;
+                bestV = ivec2(vx, vy);
+            }
+        }
+    }
+    if (zeroCost <= best + 1e-4) bestV = ivec2(0);
+
+    // Mean absolute luma difference of the match, 0.1 and above is a miss
+    float err = best / float((kBlock / 2) * (kBlock / 2));
+    float confidence = clamp(1.0 - err * 10.0, 0.0, 1.0);
+    flow.blocks[block.y * params.blocksX + block.x] = vec4(vec2(bestV), confidence, 0.0);
+}
+
+vec4 blockAt(ivec2 b) {
+    b = clamp(b, ivec2(0), ivec2(params.blocksX, params.blocksY) - 1);
+    return flow.blocks[uint(b.y) * params.blocksX + uint(b.x)];
+}
+
+void synthesize(uvec2 p) {
+    if (p.x >= params.width || p.y >= params.height) return;
+    vec2 size = vec2(params.width, params.height);
+    vec2 pos = vec2(p) + 0.5;
+
+    // Bilinear between the four nearest block centres
+    vec2 g = pos / float(kBlock) - 0.5;
+    ivec2 b0 = ivec2(floor(g));
+    vec2 f = g - vec2(b0);
+    vec4 m = mix(mix(blockAt(b0), blockAt(b0 + ivec2(1, 0)), f.x),
+                 mix(blockAt(b0 + ivec2(0, 1)), blockAt(b0 + ivec2(1, 1)), f.x), f.y);
+
+    float t = params.t;
+    vec2 v = m.xy * m.z;
+    vec3 a = texture(prevFrame, (pos - t * v) / size).rgb;
+    vec3 b = texture(nextFrame, (pos + (1.0 - t) * v) / size).rgb;
+    imageStore(outImage, ivec2(p), vec4(mix(a, b, t), 1.0));
+}
+
+void main() {
+    if (kMode == 0u) estimate(gl_GlobalInvocationID.xy);
+    else synthesize(gl_GlobalInvocationID.xy);
+}
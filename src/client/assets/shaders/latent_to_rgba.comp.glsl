@@ -0,0 +1,60 @@
+#version 450
+
+// VAE decoder output (NCHW, [-1,1]) -> graded RGBA8 image. The tensor is read
+// in place from a storage buffer (uploaded, or shared with CUDA); fp16 outputs
+// are read as packed pairs.
+
+// Specialization constants, set by Renderer::createConvertPipeline
+layout(local_size_x_id = 0, local_size_y_id = 1) in;
+layout(constant_id = 2) const bool kFp16 = false; // tensor holds packed halves
+
+layout(std430, set = 0, binding = 0) readonly buffer Decoded {
+    uint data[];
+} decoded;
+
+layout(set = 0, binding = 1, rgba8) uniform writeonly image2D outImage;
+
+// Must match ConvertParams in Renderer.cpp
+layout(push_constant) uniform Params {
+    uint width;
+    uint height;
+    uint toneMap;
+    float exposure;   // stops
+    float contrast;   // around mid grey
+    float saturation; // 0 = greyscale
+    float gamma;
+} params;
+
+float load(uint i) {
+    if (kFp16) {
+        vec2 pair = unpackHalf2x16(decoded.data[i >> 1]);
+        return (i & 1u) == 0u ? pair.x : pair.y;
+    }
+    return uintBitsToFloat(decoded.data[i]);
+}
+
+// Identity below the knee, smooth roll-off towards 1 above it (slope stays
+// continuous), so overshooting highlights keep some detail instead of clipping
+vec3 shoulder(vec3 c) {
+    const float knee = 0.8;
+    vec3 over = max(c - knee, 0.0);
+    return min(c, knee) + (1.0 - knee) * over / (over + (1.0 - knee));
+}
+
+void main() {
+    uvec2 p = gl_GlobalInvocationID.xy;
+    if (p.x >= params.width || p.y >= params.height) return;
+
+    uint plane = params.width * params.height;
+    uint i = p.y * params.width + p.x;
+    vec3 c = vec3(load(i), load(i + plane), load(i + 2u * plane)) * 0.5 + 0.5;
+
+    c *= exp2(params.exposure);
+    if (params.toneMap != 0u) c = shoulder(max(c, 0.0));
+    c = (c - 0.5) * params.contrast + 0.5;
+    float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));
+    c = mix(vec3(luma), c, params.saturation);
+    c = pow(clamp(c, 0.0, 1.0), vec3(1.0 / params.gamma));
+
+    imageStore(outImage, ivec2(p), vec4(c, 1.0));
+}
@@ -1,182 +1,654 @@
 // onnx_sd_runner.cpp
-// Integração ONNX Runtime + Tokenizers FFI -> Vulkan renderer (adaptado à sua API)
+// Integração ONNX Runtime + CLIP BPE tokenizer -> Vulkan renderer (adaptado à sua API)
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <memory>
 #include <filesystem>
 #include <chrono>
-#include <fstream>
 #include <thread>
+#include <mutex>
 #include <cstdint>
+#include <csignal>
 
 // ONNX Runtime C++ API
 #include <onnxruntime_cxx_api.h>
 
 // Seu renderer / contexto Vulkan (ajuste include path se necessário)
 #include "client/VulkanContext.hpp"
+#include "client/Window.hpp"
 #include "client/Renderer.hpp"
+#include "client/InteropBuffer.hpp"
+#include "client/Overlay.hpp"
 #include "client/VideoWriter.hpp"
+#include "sd/ONNXRunner.hpp"
+#include "pipeline/QualityController.hpp"
+#include "pipeline/RunnerPool.hpp"
+#include "server/GenerationServer.hpp"
+#include "server/HttpServer.hpp"
+#include "util/Trace.hpp"
 
 namespace fs = std::filesystem;
 
-// ------------------------- Util: carregar arquivo binário -------------------
-static std::vector<uint8_t> read_file_bytes(const std::string &path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) return {};
-    f.seekg(0, std::ios::end);
-    std::streampos sp = f.tellg();
-    if (sp <= 0) return {};
-    size_t sz = static_cast<size_t>(sp);
-    f.seekg(0, std::ios::beg);
-    std::vector<uint8_t> b(sz);
-    f.read(reinterpret_cast<char*>(b.data()), sz);
-    return b;
+// ------------------------- Display options -----------------------------------
+// Options consumed by main; every other --key=value goes to the provider config.
+struct DisplayOptions {
+    PresentMode present_mode = PresentMode::Fifo;
+    int vk_device = -1;       // Vulkan physical device, -1 = first suitable
+    bool interop = true;      // share the decoder output with Vulkan when CUDA allows it
+    bool gpu_convert = true;  // convert / grade on the GPU instead of a CPU loop
+    int interpolate = 0;      // frames synthesized between consecutive keyframes
+    bool overlay = false;     // ImGui performance overlay in the window
+    Renderer::ColorGrade grade;
+};
+
+static bool parse_float(const std::string &v, float &out) {
+    try {
+        size_t pos = 0;
+        out = std::stof(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
+    }
 }
 
-// ------------------------- ONNX Runner (simplificado) ----------------------
-class ONNXRunner {
-public:
-    ONNXRunner(const std::string &onnx_dir, bool use_cuda = false)
-    : env_(ORT_LOGGING_LEVEL_WARNING, "onnx_runner") {
-        onnx_dir_ = onnx_dir;
-        Ort::SessionOptions sess_opts;
-        sess_opts.SetIntraOpNumThreads(4);
-        sess_opts.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
-        if (use_cuda) {
-#ifdef USE_CUDA
-            OrtCUDAProviderOptions cuda_opts{};
-            sess_opts.AppendExecutionProvider_CUDA(cuda_opts);
-#else
-            std::cerr << "ONNXRunner built without CUDA support (define USE_CUDA and link providers)" << std::endl;
-#endif
-        }
+// ------------------------- Generation options --------------------------------
+// Per-frame sampling settings. strength < 1 turns on img2img streaming: each
+// frame starts from the previous frame's latents and only runs
+// steps * strength UNet steps (e.g. --steps=8 --strength=0.35 -> 3 steps),
+// with the same noise seed every frame so the video stays coherent.
+// --scheduler picks the sampler and, unless given explicitly, its preset
+// step count and guidance (see sd/Scheduler.hpp).
+struct GenerationOptions {
+    int frames = 1;
+    int steps = 28;
+    int seed = 1337;
+    float guidance = 7.5f;
+    float strength = 1.f;
+    SchedulerKind scheduler = SchedulerKind::Euler;
+    bool steps_set = false, guidance_set = false;
+    int batch = 1; // frames per UNet run (cond + uncond are always batched when the model allows it)
+    std::vector<int> devices; // one runner per provider device id; empty = --device only
+    // Adaptive quality (see pipeline/QualityController.hpp): off unless target_fps > 0
+    float target_fps = 0.f;
+    float latency_ms = 0.f;
+    int min_steps = 0; // 0 = a quarter of --steps
+    bool adapt_cfg = true;
+};
 
-        // Try to load model files if present; otherwise we'll be in fallback mode
-        fs::path base(onnx_dir);
-        auto tenc = base / "text_encoder.onnx";
-        auto unet  = base / "unet.onnx";
-        auto vae   = base / "vae_decoder.onnx";
-
-        try {
-            if (fs::exists(tenc)) session_text_ = std::make_unique<Ort::Session>(env_, tenc.string().c_str(), sess_opts);
-            if (fs::exists(unet))  session_unet_  = std::make_unique<Ort::Session>(env_, unet.string().c_str(), sess_opts);
-            if (fs::exists(vae))   session_vae_   = std::make_unique<Ort::Session>(env_, vae.string().c_str(), sess_opts);
-        } catch (const std::exception &e) {
-            std::cerr << "ONNX load error: " << e.what() << std::endl;
-        }
+static bool parse_int(const std::string &v, int &out) {
+    try {
+        size_t pos = 0;
+        out = std::stoi(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
     }
+}
 
-    // Gera uma imagem RGBA width*height*4 bytes. Se modelos não estiverem prontos, gera padrão.
-    std::vector<uint8_t> generate_image_rgba(const std::string &prompt, int width, int height, int steps = 28, int seed = 1337) {
-        if (!session_text_ || !session_unet_ || !session_vae_) {
-            return make_test_image(width, height, prompt);
-        }
+// Comma separated device ids, e.g. "0,1"
+static bool parse_int_list(const std::string &v, std::vector<int> &out) {
+    out.clear();
+    for (size_t pos = 0;;) {
+        size_t comma = v.find(',', pos);
+        int id = 0;
+        if (!parse_int(v.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos), id) || id < 0)
+            return false;
+        out.push_back(id);
+        if (comma == std::string::npos) return true;
+        pos = comma + 1;
+    }
+}
 
-        // --- Simplificação: many steps omitted ---
-        // Aqui você deve executar: text_encoder -> embeddings, diffusion loop (unet) -> latents, vae decode -> image
-        // Implementação completa do SD em ONNX é longa; por enquanto, retornamos imagem de teste
-        return make_test_image(width, height, prompt);
-    }
-
-private:
-    Ort::Env env_;
-    std::unique_ptr<Ort::Session> session_text_;
-    std::unique_ptr<Ort::Session> session_unet_;
-    std::unique_ptr<Ort::Session> session_vae_;
-    std::string onnx_dir_;
-
-    std::vector<uint8_t> make_test_image(int w, int h, const std::string &seed_text) {
-        std::vector<uint8_t> img(static_cast<size_t>(w) * static_cast<size_t>(h) * 4);
-        // Gradient + text hash color
-        uint64_t hash = 1469598103934665603ull;
-        for (unsigned char c : seed_text) hash = (hash ^ c) * 1099511628211ull;
-        uint8_t r = static_cast<uint8_t>((hash >> 0) & 0xFF);
-        uint8_t g = static_cast<uint8_t>((hash >> 8) & 0xFF);
-        uint8_t b = static_cast<uint8_t>((hash >> 16) & 0xFF);
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                size_t i = (static_cast<size_t>(y) * static_cast<size_t>(w) + static_cast<size_t>(x)) * 4;
-                img[i+0] = static_cast<uint8_t>(((x * 255) / std::max(1, w-1)) ^ r); // R
-                img[i+1] = static_cast<uint8_t>(((y * 255) / std::max(1, h-1)) ^ g); // G
-                img[i+2] = static_cast<uint8_t>(((((x+y)/2) * 255) / std::max(1, (w+h)/2-1)) ^ b); // B
-                img[i+3] = 255;
-            }
+// Returns false when `key` is not a generation option; `ok` reports a bad value.
+static bool apply_generation_option(GenerationOptions &o, std::string &prompt, const std::string &key,
+                                    const std::string &value, bool &ok) {
+    ok = true;
+    SchedulerPreset preset;
+    if (key == "prompt") prompt = value;
+    else if (key == "frames") ok = parse_int(value, o.frames) && o.frames > 0;
+    else if (key == "steps") ok = o.steps_set = parse_int(value, o.steps) && o.steps > 0;
+    else if (key == "seed") ok = parse_int(value, o.seed);
+    else if (key == "batch") ok = parse_int(value, o.batch) && o.batch > 0;
+    else if (key == "devices") ok = parse_int_list(value, o.devices);
+    else if (key == "guidance") ok = o.guidance_set = parse_float(value, o.guidance);
+    else if (key == "target_fps") ok = parse_float(value, o.target_fps) && o.target_fps >= 0.f;
+    else if (key == "latency_ms") ok = parse_float(value, o.latency_ms) && o.latency_ms >= 0.f;
+    else if (key == "min_steps") ok = parse_int(value, o.min_steps) && o.min_steps > 0;
+    else if (key == "adapt_cfg") o.adapt_cfg = value != "0" && value != "false" && value != "off";
+    else if (key == "scheduler") {
+        ok = scheduler_preset(value, preset);
+        if (ok) {
+            o.scheduler = preset.kind;
+            if (!o.steps_set) o.steps = preset.steps;
+            if (!o.guidance_set) o.guidance = preset.guidance;
         }
-        return img;
     }
+    else if (key == "strength") ok = parse_float(value, o.strength) && o.strength > 0.f && o.strength <= 1.f;
+    else return false;
+    return true;
+}
+
+// Returns false when `key` is not a display option; `ok` reports a bad value.
+static bool apply_display_option(DisplayOptions &o, const std::string &key, const std::string &value, bool &ok) {
+    const bool on = value != "0" && value != "false" && value != "off";
+    ok = true;
+    if (key == "present") ok = parsePresentMode(value, o.present_mode);
+    else if (key == "interop") o.interop = on;
+    else if (key == "vk_device") ok = parse_int(value, o.vk_device) && o.vk_device >= 0;
+    else if (key == "gpu_convert") o.gpu_convert = on;
+    else if (key == "interpolate") ok = parse_int(value, o.interpolate) && o.interpolate >= 0;
+    else if (key == "overlay") o.overlay = on;
+    else if (key == "tonemap") o.grade.toneMap = on;
+    else if (key == "exposure") ok = parse_float(value, o.grade.exposure);
+    else if (key == "contrast") ok = parse_float(value, o.grade.contrast);
+    else if (key == "saturation") ok = parse_float(value, o.grade.saturation);
+    else if (key == "gamma") ok = parse_float(value, o.grade.gamma);
+    else return false;
+    return true;
+}
+
+// ------------------------- Profiling options ---------------------------------
+// --trace=<file.json> records CPU spans (stages, UNet steps, VAE) and GPU
+// timestamps into a Chrome trace; --trace_summary=N prints p50/p99 per span
+// every N frames, on its own without a file. ORT's profiler is separate
+// (--ort_profile=<prefix>, see RunnerConfig.hpp).
+struct TraceOptions {
+    std::string path;
+    int summary_every = 0;
+    bool enabled() const { return !path.empty() || summary_every > 0; }
 };
 
+// Returns false when `key` is not a profiling option; `ok` reports a bad value.
+static bool apply_trace_option(TraceOptions &o, const std::string &key, const std::string &value, bool &ok) {
+    ok = true;
+    if (key == "trace") {
+        o.path = value;
+        ok = !value.empty();
+    }
+    else if (key == "trace_summary") ok = parse_int(value, o.summary_every) && o.summary_every > 0;
+    else return false;
+    return true;
+}
 
-// ------------------------- Integration function ---------------------------
-// This function demonstrates the full flow: use tokenizer, run ONNXRunner, upload to your Renderer
-bool generate_and_present(const std::string &prompt, int w, int h, const std::string &models_dir, const std::string &tokenizer_json, VulkanContext &vkctx, Renderer &renderer, VideoWriter *vw = nullptr) {
-
-    // 2) ONNX -> produce RGBA image buffer
-    ONNXRunner runner(models_dir);
-    auto rgba = runner.generate_image_rgba(prompt, w, h);
-    if (rgba.empty()) {
-        std::cerr << "Failed to generate image\n";
-        return false;
+// ------------------------- Server options ------------------------------------
+// --serve=<port> runs headless as a generation service instead of rendering
+// --frames: models stay loaded and requests come in over HTTP (see
+// server/GenerationServer.hpp). --steps / --seed / --guidance / --strength and
+// the 512x512 resolution become the per-request defaults.
+struct ServerOptions {
+    int port = -1;                 // -1 = off, 0 = any free port
+    std::string host = "127.0.0.1";
+    ServerConfig cfg;
+};
+
+// Returns false when `key` is not a server option; `ok` reports a bad value.
+static bool apply_server_option(ServerOptions &o, const std::string &key, const std::string &value, bool &ok) {
+    int n = 0;
+    ok = true;
+    if (key == "serve") ok = parse_int(value, o.port) && o.port >= 0 && o.port <= 65535;
+    else if (key == "host") {
+        o.host = value;
+        ok = !value.empty();
+    }
+    else if (key == "queue") {
+        ok = parse_int(value, n) && n > 0;
+        if (ok) o.cfg.queue_capacity = static_cast<size_t>(n);
+    }
+    else if (key == "max_batch") {
+        ok = parse_int(value, n) && n > 0;
+        if (ok) o.cfg.max_batch = static_cast<size_t>(n);
     }
+    else if (key == "batch_window_ms") ok = parse_int(value, o.cfg.batch_window_ms) && o.cfg.batch_window_ms >= 0;
+    else if (key == "max_frames") ok = parse_int(value, o.cfg.max_frames) && o.cfg.max_frames > 0;
+    else return false;
+    return true;
+}
+
+// ------------------------- Integration function ---------------------------
+// Stage callbacks for the frame pipeline: upload each decoded frame to your Renderer and draw it.
+// The runner is owned by the caller so sessions are loaded and optimized only once.
+// Frames decoded into an interop buffer or left planar are converted on the GPU instead of uploaded as RGBA8.
+// With interpolation on, the previous keyframe's image is kept and job.interpolate in-between frames
+// are synthesized, presented and read back into job.inbetween before the keyframe itself.
+struct FrameInterpolation {
+    bool enabled = false;
+    VkImage previous = VK_NULL_HANDLE;
+};
 
-    // 3) Upload to renderer
-    VkDeviceMemory outMem = VK_NULL_HANDLE;
-    VkImage image = renderer.uploadImageRGBA(rgba.data(), static_cast<uint32_t>(w), static_cast<uint32_t>(h), &outMem);
+static bool upload_and_present(FrameJob &job, Renderer &renderer, const std::vector<std::unique_ptr<InteropBuffer>> &interop,
+                               bool fp16, FrameInterpolation &interp) {
+    const uint32_t w = static_cast<uint32_t>(job.width), h = static_cast<uint32_t>(job.height);
+    const bool gpu_converted = job.image_on_device || !job.planar.empty();
+    VkImage image = job.image_on_device  ? renderer.convertImageNCHW(interop[job.slot]->buffer(), w, h, fp16)
+                    : !job.planar.empty() ? renderer.uploadImageNCHW(job.planar.data(), w, h)
+                                          : renderer.uploadImageRGBA(job.rgba.data(), w, h);
     if (image == VK_NULL_HANDLE) {
-        std::cerr << "Renderer uploadImageRGBA failed\n";
+        std::cerr << "Renderer upload failed\n";
         return false;
     }
 
-    // (Optional) draw/present - renderer.drawFrame is a placeholder in your Renderer
-    renderer.drawFrame(image);
+    // In-betweens go out first; a failed one just leaves the keyframes
+    size_t produced = 0;
+    const int count = interp.enabled ? job.interpolate : 0;
+    if (count > 0 && interp.previous != VK_NULL_HANDLE) {
+        job.inbetween.resize(static_cast<size_t>(count));
+        for (int k = 1; k <= count; ++k) {
+            TraceScope span("interpolate");
+            const float t = static_cast<float>(k) / static_cast<float>(count + 1);
+            VkImage mid = renderer.interpolateImages(interp.previous, image, t);
+            if (mid == VK_NULL_HANDLE) break;
+            renderer.drawFrame(mid);
+            std::vector<uint8_t> &pixels = job.inbetween[produced];
+            pixels.resize(static_cast<size_t>(w) * h * 4);
+            const bool read = renderer.readImageRGBA(mid, pixels.data());
+            renderer.releaseImage(mid);
+            if (!read) break;
+            ++produced;
+        }
+    }
+    job.inbetween.resize(produced);
 
-    // 4) Optionally write frame to video (use VideoWriter::writeFrame)
-    if (vw) {
-        // VideoWriter in your headers exposes writeFrame(const uint8_t*)
-        vw->writeFrame(rgba.data());
+    // Blit into the swapchain and present (no-op when running headless)
+    {
+        TraceScope span("draw");
+        renderer.drawFrame(image);
+    }
+
+    // The writer still needs host pixels: read back the (graded) RGBA8 result, a
+    // quarter of the float tensor. This also waits for the conversion, so the
+    // decoder may reuse the interop buffer afterwards.
+    if (gpu_converted) {
+        TraceScope span("readback");
+        job.rgba.resize(static_cast<size_t>(w) * h * 4);
+        if (!renderer.readImageRGBA(image, job.rgba.data())) {
+            std::cerr << "Renderer readback failed\n";
+            renderer.releaseImage(image);
+            return false;
+        }
     }
 
-    // Note: Caller is responsible for destroying image and freeing memory if needed (renderer.destroyImage)
+    // Back to the Renderer's pool; the next upload reuses it without allocating.
+    // The newest keyframe is held until the next one arrives to interpolate from.
+    if (interp.enabled) {
+        if (interp.previous != VK_NULL_HANDLE) renderer.releaseImage(interp.previous);
+        interp.previous = image;
+    } else {
+        renderer.releaseImage(image);
+    }
     return true;
 }
 
+// Overlay counters from every device, and the settings of the frame about to be submitted
+static void fill_overlay_stats(Overlay::Stats &stats, RunnerPool &pool, const FrameRequest &req) {
+    stats.stages.resize(FramePipeline::StageCount);
+    for (int s = 0; s < FramePipeline::StageCount; ++s) {
+        const auto stage = static_cast<FramePipeline::Stage>(s);
+        const FramePipeline::StageStats st = pool.stats(stage);
+        stats.stages[s].name = FramePipeline::stage_name(stage);
+        stats.stages[s].frames = st.frames;
+        stats.stages[s].busyMs = st.busy_ms;
+        stats.stages[s].queued = st.queued;
+    }
+    stats.cacheHits = stats.cacheMisses = 0;
+    for (size_t d = 0; d < pool.size(); ++d) {
+        stats.cacheHits += pool.runner(d).embedding_cache().hits();
+        stats.cacheMisses += pool.runner(d).embedding_cache().misses();
+    }
+    stats.steps = req.steps;
+    stats.cfg = req.guidance_scale > 1.f;
+    stats.interpolate = req.interpolate;
+}
+
+// Compiled Vulkan pipelines are kept next to the optimized models (--cache=, else <models>/.cache)
+static std::string pipeline_cache_dir(const std::string &models_dir, const ProviderConfig &cfg) {
+    return cfg.cache_dir.empty() ? (fs::path(models_dir) / ".cache").string() : cfg.cache_dir;
+}
+
+// ------------------------- Server mode -------------------------------------
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
+// Headless service: Vulkan without a surface (only for the GPU conversion and
+// grading), one resident runner, and the HTTP front end until SIGINT / SIGTERM.
+static int run_server(const std::string &models_dir, const std::string &tokenizer_json, ProviderConfig provider_cfg,
+                      const GenerationOptions &gen, const DisplayOptions &display, const ServerOptions &server,
+                      int width, int height) {
+    VulkanContext vkctx;
+    vkctx.setPipelineCacheDir(pipeline_cache_dir(models_dir, provider_cfg));
+    Renderer renderer(&vkctx);
+    const bool vulkan = display.gpu_convert && vkctx.init(false, display.vk_device) && renderer.init();
+    if (vulkan) renderer.setColorGrade(display.grade);
+    const bool gpu_convert = vulkan && renderer.initConversion();
+    if (display.gpu_convert && !gpu_convert) std::cerr << "GPU conversion unavailable, converting on the CPU" << std::endl;
+
+    provider_cfg.shape_width = width;
+    provider_cfg.shape_height = height;
+    ONNXRunner runner(models_dir, provider_cfg, tokenizer_json);
+    runner.set_scheduler(gen.scheduler);
+    runner.warmup(width, height);
+    if (!runner.ready()) std::cerr << "Models not loaded, serving test images" << std::endl;
+
+    GenerationServer gen_server(runner, server.cfg);
+    GenerationRequest defaults;
+    defaults.width = width;
+    defaults.height = height;
+    defaults.steps = gen.steps;
+    defaults.seed = gen.seed;
+    defaults.guidance_scale = gen.guidance;
+    defaults.strength = gen.strength;
+    gen_server.set_defaults(defaults);
+    gen_server.set_planar_output(gpu_convert);
+    // Only the batcher thread touches the Renderer
+    gen_server.set_postprocess([&](FrameJob &job) {
+        if (job.planar.empty()) return true;
+        const uint32_t w = static_cast<uint32_t>(job.width), h = static_cast<uint32_t>(job.height);
+        VkImage image = renderer.uploadImageNCHW(job.planar.data(), w, h);
+        if (image == VK_NULL_HANDLE) {
+            std::cerr << "Renderer upload failed\n";
+            return false;
+        }
+        job.rgba.resize(static_cast<size_t>(w) * h * 4);
+        const bool read = renderer.readImageRGBA(image, job.rgba.data());
+        renderer.releaseImage(image);
+        if (!read) std::cerr << "Renderer readback failed\n";
+        return read;
+    });
+
+    HttpServer http;
+    if (!gen_server.start() ||
+        !http.start(server.host, server.port, [&](const HttpRequest &req, HttpResponse &res) { gen_server.handle(req, res); })) {
+        std::cerr << "Server start failed" << std::endl;
+        return -1;
+    }
+    std::cout << "Serving on http://" << server.host << ":" << http.port() << "/generate ("
+              << width << "x" << height << ", queue " << server.cfg.queue_capacity << ")" << std::endl;
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    while (!stop_requested) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // Failing the queued tickets first releases the connection threads waiting on them
+    std::cout << "Shutting down" << std::endl;
+    gen_server.stop();
+    http.stop();
+    const GenerationServer::Stats stats = gen_server.stats();
+    std::cout << stats.requests << " request(s), " << stats.frames << " frame(s) in " << stats.batches
+              << " UNet batch(es), " << stats.rejected << " rejected, " << stats.failed << " failed" << std::endl;
+    if (vulkan) renderer.cleanup();
+    vkctx.cleanup();
+    return 0;
+}
+
 // ------------------------- Usage example (main) ---------------------------
 int main(int argc, char** argv) {
+#ifndef _WIN32
+    // A dead ffmpeg pipe (VideoEncoder) must fail the write with EPIPE, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
     std::string models_dir = "models"; // models/text_encoder.onnx etc
     std::string tokenizer_json = "models/tokenizer.json";
     std::string prompt = "um gato astronauta, painting, high detail";
     int width = 512, height = 512;
 
-    // 0) Init VulkanContext (use your existing class)
+    // Execution provider from the command line: --config=<file> and/or --key=value (see RunnerConfig.hpp)
+    // Generation: --prompt= --frames= --steps= --seed= --guidance= --strength=<(0,1], < 1 streams img2img>
+    // --scheduler=euler|euler_a|dpmpp|lcm|turbo --batch=<frames per UNet run>. Several prompts separated
+    // by '|' are used in turn, one per frame; with --strength < 1 each is its own stream.
+    // Multi-GPU: --devices=0,1,... loads one runner per device and spreads frames over them (streams stay
+    // on device stream % count, so --batch is per device); --vk_device= picks the presenting GPU.
+    // Adaptive quality: --target_fps= (output rate, in-betweens included) and optionally --latency_ms=
+    // lower steps (down to --min_steps=), drop CFG (unless --adapt_cfg=0) and add up to --interpolate
+    // in-betweens whenever the measured stage timings say the target would be missed.
+    // Display: --present=fifo|mailbox|immediate, --interop=0, --gpu_convert=0 and
+    // color grading with --exposure= --contrast= --saturation= --gamma= --tonemap=1
+    // --overlay=1 draws FPS, frame times, stage timings, VRAM and cache stats over the frame, with
+    // live --steps / --strength sliders (read-only under --target_fps)
+    // --interpolate=N synthesizes N frames between consecutive generated frames (output rate x (N+1),
+    // raise --fps to match); single device and a single prompt, since it blends neighbouring frames.
+    // With --target_fps it is the most the controller may use instead.
+    // Recording: --encoder=png|software|nvenc|vaapi|raw --codec=h264|h265 --output=<folder|file|url>
+    // --fps= --bitrate=<kbps> --ffmpeg=<path> --vaapi_device=<node>, and --writers=<threads, 0 = inline>
+    // --write_queue=<frames> for the asynchronous writer; raw dumps take --raw_format=rgba|nv12
+    // (or a .y4m output), --raw_reserve=<frames> and --direct_io=1 (see client/VideoEncoder.hpp)
+    // Profiling: --trace=<file.json> --trace_summary=<frames> --ort_profile=<prefix>
+    // Server: --serve=<port> [--host=127.0.0.1] --queue=<requests> --max_batch=<frames per UNet run>
+    // --batch_window_ms= --max_frames=<per request> runs headless and serves POST /generate and GET /health
+    ProviderConfig provider_cfg;
+    GenerationOptions gen;
+    DisplayOptions display;
+    TraceOptions trace;
+    ServerOptions server;
+    VideoWriterConfig video_cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            std::cerr << "Ignoring argument '" << arg << "' (expected --key=value)" << std::endl;
+            continue;
+        }
+        std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        bool ok = true;
+        if (apply_generation_option(gen, prompt, key, value, ok) || apply_display_option(display, key, value, ok) ||
+            apply_trace_option(trace, key, value, ok) || apply_server_option(server, key, value, ok)) {
+            if (!ok) std::cerr << "Invalid option '" << arg << "'" << std::endl;
+            continue;
+        }
+        if (isVideoOption(key)) {
+            if (!applyVideoOption(video_cfg, key, value)) std::cerr << "Invalid option '" << arg << "'" << std::endl;
+            continue;
+        }
+        ok = key == "config" ? load_provider_config(value, provider_cfg) : apply_provider_option(provider_cfg, key, value);
+        if (!ok) std::cerr << "Invalid option '" << arg << "'" << std::endl;
+    }
+
+    if (server.port >= 0) return run_server(models_dir, tokenizer_json, provider_cfg, gen, display, server, width, height);
+
+    // 0) Open the window (falls back to headless when there is no display) and init VulkanContext
+    Window window;
+    bool presentation = window.create(static_cast<uint32_t>(width), static_cast<uint32_t>(height), "VideoGenerator");
+    if (!presentation) std::cerr << "No window available, running headless" << std::endl;
     VulkanContext vkctx;
-    if (!vkctx.init()) {
+    vkctx.setPipelineCacheDir(pipeline_cache_dir(models_dir, provider_cfg));
+    if (!vkctx.init(presentation, display.vk_device)) {
         std::cerr << "Failed to initialize VulkanContext - adapt call to your class" << std::endl;
         return -1;
     }
 
-    // 1) Create Renderer using your Vulkan context
+    // 1) Create Renderer using your Vulkan context (the overlay outlives its presentation)
+    Overlay overlay(&vkctx);
     Renderer renderer(&vkctx);
     if (!renderer.init()) {
         std::cerr << "Renderer init failed - adapt to your Renderer API" << std::endl;
         return -1;
     }
+    renderer.setColorGrade(display.grade);
+    const bool gpu_convert = display.gpu_convert && renderer.initConversion();
+    if (presentation && !renderer.initPresentation(&window, display.present_mode)) {
+        std::cerr << "Swapchain creation failed, frames will not be presented" << std::endl;
+    } else if (display.overlay && !(overlay.init(&window) && renderer.setOverlay(&overlay))) {
+        std::cerr << "Overlay unavailable" << std::endl;
+        overlay.cleanup();
+    }
+
+    // 2) Create the VideoWriter: a PNG sequence by default, or an encoded file / stream
+    VideoWriter vw(video_cfg, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
 
-    // 2) Create VideoWriter if you want to record (folder, width, height)
-    VideoWriter vw("frames_out", static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-    vw.writeFrame(nullptr); // harmless no-op depending on impl; you can remove or call open if implemented
+    // 3) Load the models once and warm them up at the target resolution
+    //    (TensorRT engines in the model cache are keyed on it)
+    provider_cfg.shape_width = width;
+    provider_cfg.shape_height = height;
+    //    One runner per device; enough jobs in flight for a full denoise batch plus the other stages
+    RunnerPool pool(models_dir, provider_cfg, gen.devices, tokenizer_json, width, height,
+                    std::max<size_t>(6, static_cast<size_t>(gen.batch) + 4));
+    pool.set_scheduler(gen.scheduler);
+    pool.warmup(width, height);
+    pool.set_denoise_batch(static_cast<size_t>(gen.batch));
 
-    // 3) Generate and present
-    if (!generate_and_present(prompt, width, height, models_dir, tokenizer_json, vkctx, renderer, &vw)) {
-        std::cerr << "generate_and_present failed" << std::endl;
+    // 4) Generate and present, one prompt per frame. Encode / denoise / decode / upload / write
+    //    run on their own threads, so frame N+1 denoises while frame N is decoded and written.
+    std::vector<std::string> prompts;
+    for (size_t pos = 0;;) {
+        size_t bar = prompt.find('|', pos);
+        prompts.push_back(prompt.substr(pos, bar == std::string::npos ? std::string::npos : bar - pos));
+        if (bar == std::string::npos) break;
+        pos = bar + 1;
+    }
+    // Zero-copy path: the decoder writes into Vulkan memory imported by CUDA. Only with a single
+    // runner, which must sit on the Vulkan device; other setups hand over host memory.
+    ONNXRunner &runner = pool.runner(0);
+    FramePipeline &pipeline = pool.pipeline(0);
+    std::vector<std::unique_ptr<InteropBuffer>> interop;
+    if (gpu_convert && display.interop && pool.size() == 1 && runner.supports_device_image() &&
+        InteropBuffer::supported(&vkctx, runner.device_id())) {
+        std::vector<void*> device_images;
+        for (size_t i = 0; i < pipeline.jobs(); ++i) {
+            auto buf = std::make_unique<InteropBuffer>(&vkctx);
+            if (!buf->create(runner.device_image_bytes(width, height), runner.device_id())) break;
+            device_images.push_back(buf->devicePtr());
+            interop.push_back(std::move(buf));
+        }
+        if (interop.size() == pipeline.jobs()) {
+            pipeline.set_device_images(device_images);
+            std::cout << "GPU interop: decoder output shared with Vulkan" << std::endl;
+        } else {
+            interop.clear();
+        }
+    }
+    // Otherwise the decoder hands over planar floats for the compute conversion
+    pool.set_planar_output(gpu_convert);
+    const bool fp16_image = runner.device_image_fp16();
+    // Every device's upload thread shares the one Renderer, which is not thread-safe
+    std::mutex render_mutex;
+    // Interpolation needs the keyframes in display order, which only a single device uploads in,
+    // and one prompt: with several, consecutive keyframes are unrelated images of different streams
+    FrameInterpolation interp;
+    if (display.interpolate > 0) {
+        if (pool.size() > 1)
+            std::cerr << "Frame interpolation needs a single device, disabled" << std::endl;
+        else if (prompts.size() > 1)
+            std::cerr << "Frame interpolation needs a single prompt, disabled" << std::endl;
+        else if (!renderer.initInterpolation())
+            std::cerr << "Frame interpolation unavailable, writing keyframes only" << std::endl;
+        else
+            interp.enabled = true;
+    }
+    pool.set_upload([&](FrameJob &job) {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        return upload_and_present(job, renderer, interop, fp16_image, interp);
+    });
+    QualityTargets targets;
+    targets.fps = gen.target_fps;
+    targets.latency_ms = gen.latency_ms;
+    targets.max_steps = gen.steps;
+    targets.min_steps = gen.min_steps > 0 ? gen.min_steps : std::max(1, gen.steps / 4);
+    targets.guidance = gen.guidance;
+    targets.allow_cfg_off = gen.adapt_cfg;
+    targets.strength = gen.strength;
+    targets.max_interpolate = interp.enabled ? display.interpolate : 0;
+    // Re-plan once the frames submitted under the previous settings have come out
+    QualityController quality(targets, pool.size(), pipeline.jobs());
+    if (quality.enabled())
+        std::cout << "Adaptive quality: " << gen.target_fps << " fps target" << std::endl;
+    pool.set_write([&](const FrameJob &job) {
+        for (const auto &frame : job.inbetween)
+            if (vw.writeFrame(frame.data()).empty()) return false;
+        if (vw.writeFrame(job.rgba.data()).empty()) return false;
+        quality.on_written(job);
+        return true;
+    });
+    // Warmup and session creation stay out of the trace
+    if (trace.enabled()) {
+        Trace::start(trace.path);
+        Trace::set_thread_name("main");
+        if (!renderer.initTiming()) std::cerr << "GPU timings unavailable, tracing CPU spans only" << std::endl;
+    }
+    if (!pool.start()) {
+        std::cerr << "FramePipeline start failed" << std::endl;
+        return -1;
+    }
+    const bool streaming = gen.strength < 1.f;
+    Overlay::Stats overlay_stats;
+    Overlay::Controls controls;
+    controls.editable = !quality.enabled();
+    controls.steps = gen.steps;
+    controls.maxSteps = std::max(50, gen.steps);
+    controls.streaming = streaming;
+    controls.strength = gen.strength;
+    for (int frame = 0; frame < gen.frames; ++frame) {
+        const size_t stream = static_cast<size_t>(frame) % prompts.size();
+        FrameRequest req;
+        req.prompt = prompts[stream];
+        req.steps = gen.steps;
+        req.seed = streaming ? gen.seed + static_cast<int>(stream) : gen.seed + frame;
+        req.guidance_scale = gen.guidance;
+        req.strength = gen.strength;
+        req.interpolate = interp.enabled ? display.interpolate : 0;
+        if (overlay.isActive() && controls.editable) {
+            req.steps = controls.steps;
+            if (streaming) req.strength = controls.strength;
+        }
+        if (quality.enabled()) {
+            std::array<FramePipeline::StageStats, FramePipeline::StageCount> stats;
+            for (int s = 0; s < FramePipeline::StageCount; ++s) stats[s] = pool.stats(static_cast<FramePipeline::Stage>(s));
+            quality.update(stats);
+            quality.apply(req);
+            quality.pace();
+        }
+        pool.submit(req, streaming ? static_cast<int>(stream) : -1);
+        if (overlay.isActive()) {
+            // ImGui's GLFW callbacks run inside pollEvents, and upload threads draw the overlay
+            std::lock_guard<std::mutex> lock(render_mutex);
+            window.pollEvents();
+            fill_overlay_stats(overlay_stats, pool, req);
+            overlay.update(overlay_stats, controls);
+        } else {
+            window.pollEvents();
+        }
+        if (trace.summary_every > 0 && (frame + 1) % trace.summary_every == 0) Trace::print_summary(std::cout);
+    }
+    pool.finish();
+    if (trace.enabled()) {
+        Trace::print_summary(std::cout);
+        Trace::stop();
+    }
+    if (interp.previous != VK_NULL_HANDLE) renderer.releaseImage(interp.previous);
+    vw.flush();
+    if (vw.failed() > 0) std::cerr << vw.failed() << " frame(s) could not be written" << std::endl;
+    if (pool.failed() > 0) {
+        std::cerr << pool.failed() << " frame(s) failed" << std::endl;
         return -1;
     }
+    uint64_t cache_hits = 0, cache_misses = 0;
+    size_t cache_bytes = 0;
+    for (size_t d = 0; d < pool.size(); ++d) {
+        const auto &cache = pool.runner(d).embedding_cache();
+        cache_hits += cache.hits();
+        cache_misses += cache.misses();
+        cache_bytes += cache.bytes();
+    }
+    std::cout << "Embedding cache: " << cache_hits << " hits, " << cache_misses << " misses, "
+              << cache_bytes / 1024 << " KiB" << std::endl;
 
-    // 4) Keep window open / loop (this depends on your existing app structure). For demo, sleep then cleanup
-    std::this_thread::sleep_for(std::chrono::seconds(3));
+    // 5) Keep the last frame on screen until the window is closed (at most 3 s for the demo)
+    auto shown = std::chrono::steady_clock::now();
+    while (window.isOpen() && !window.shouldClose() &&
+           std::chrono::steady_clock::now() - shown < std::chrono::seconds(3)) {
+        window.pollEvents();
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
 
+    interop.clear();
+    // The overlay's Vulkan objects and ImGui backends need the device, which
+    // vkctx.cleanup() destroys before the overlay itself goes out of scope
+    overlay.cleanup();
     renderer.cleanup();
     vkctx.cleanup();
+    window.destroy();
     return 0;
 }
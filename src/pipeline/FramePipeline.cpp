@@ -0,0 +1,220 @@
+#include "FramePipeline.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "../util/Trace.hpp"
+
+const char *FramePipeline::stage_name(Stage s) {
+    switch (s) {
+        case Encode: return "encode";
+        case Denoise: return "denoise";
+        case Decode: return "decode";
+        case Upload: return "upload";
+        case Write: return "write";
+        case StageCount: break;
+    }
+    return "?";
+}
+
+FramePipeline::FramePipeline(ONNXRunner &runner, int width, int height, size_t in_flight)
+: runner_(runner), width_(width), height_(height), free_(std::max<size_t>(in_flight, 1)) {
+    const size_t jobs = free_.capacity();
+    pool_.reserve(jobs);
+    for (size_t i = 0; i < jobs; ++i) {
+        pool_.push_back(std::make_unique<FrameJob>());
+        pool_.back()->slot = i;
+        free_.push(pool_.back().get());
+    }
+    // Every queue can hold the whole pool plus the end-of-stream marker, so a
+    // push between stages never waits; back-pressure comes from the free list.
+    for (auto &q : in_) q = std::make_unique<SpscQueue<Job>>(jobs + 1);
+}
+
+FramePipeline::~FramePipeline() {
+    finish();
+}
+
+void FramePipeline::set_device_images(const std::vector<void*> &images) {
+    for (size_t i = 0; i < pool_.size(); ++i)
+        pool_[i]->device_image = i < images.size() ? images[i] : nullptr;
+}
+
+void FramePipeline::set_planar_output(bool planar) {
+    for (auto &job : pool_) job->planar_output = planar;
+}
+
+void FramePipeline::set_denoise_batch(size_t batch) {
+    denoise_batch_ = std::clamp<size_t>(batch, 1, pool_.size());
+}
+
+bool FramePipeline::start() {
+    if (running_) return true;
+    denoise_batch_ = std::min(denoise_batch_, runner_.max_batch());
+    if (!runner_.prepare(width_, height_, denoise_batch_)) return false;
+    for (int s = 0; s < StageCount; ++s) {
+        if (s == Denoise && denoise_batch_ > 1) threads_[s] = std::thread(&FramePipeline::denoise_batch_loop, this);
+        else threads_[s] = std::thread(&FramePipeline::stage_loop, this, static_cast<Stage>(s));
+    }
+    running_ = true;
+    return true;
+}
+
+bool FramePipeline::submit(const std::string &prompt, int steps, int seed, float guidance_scale, float strength) {
+    FrameRequest req;
+    req.prompt = prompt;
+    req.steps = steps;
+    req.seed = seed;
+    req.guidance_scale = guidance_scale;
+    req.strength = strength;
+    const uint64_t index = next_index_++;
+    return submit(req, index, static_cast<size_t>(index % denoise_batch_));
+}
+
+bool FramePipeline::submit(const FrameRequest &req, uint64_t index, size_t lane) {
+    if (!running_ || closed_) return false;
+    FrameJob *job = free_.pop();
+    job->index = index;
+    job->prompt = req.prompt;
+    job->width = width_;
+    job->height = height_;
+    job->steps = req.steps;
+    job->seed = req.seed;
+    job->guidance_scale = req.guidance_scale;
+    job->strength = req.strength;
+    job->lane = lane;
+    job->interpolate = req.interpolate;
+    job->submitted = std::chrono::steady_clock::now();
+    job->ok = true;
+    in_[Encode]->push(job);
+    return true;
+}
+
+void FramePipeline::close() {
+    if (!running_ || closed_) return;
+    in_[Encode]->push(nullptr);
+    closed_ = true;
+}
+
+void FramePipeline::finish() {
+    if (!running_) return;
+    close();
+    for (auto &t : threads_) t.join();
+    running_ = false;
+    closed_ = false;
+
+    for (int s = 0; s < StageCount; ++s) {
+        StageStats st = stats(static_cast<Stage>(s));
+        std::cout << "  " << std::left << std::setw(8) << stage_name(static_cast<Stage>(s)) << std::right
+                  << st.frames << " frames, " << std::fixed << std::setprecision(1)
+                  << (st.frames ? st.busy_ms / st.frames : 0.0) << " ms/frame" << std::endl;
+    }
+}
+
+FramePipeline::StageStats FramePipeline::stats(Stage s) const {
+    StageStats st;
+    st.frames = frames_[s].load(std::memory_order_relaxed);
+    st.busy_ms = busy_us_[s].load(std::memory_order_relaxed) / 1000.0;
+    st.queued = in_[s]->size();
+    return st;
+}
+
+bool FramePipeline::run_stage(Stage s, FrameJob &job) {
+    switch (s) {
+        case Encode: return runner_.run_encode(job);
+        case Denoise: return runner_.run_denoise(job);
+        case Decode: return runner_.run_decode(job);
+        case Upload: return job.ok && (!upload_ || upload_(job));
+        case Write: return job.ok && (!write_ || write_(job));
+        case StageCount: break;
+    }
+    return false;
+}
+
+void FramePipeline::stage_loop(Stage s) {
+    SpscQueue<Job> &in = *in_[s];
+    SpscQueue<Job> &out = s + 1 < StageCount ? *in_[s + 1] : free_;
+    if (Trace::enabled()) Trace::set_thread_name(stage_name(s));
+    for (;;) {
+        FrameJob *job = in.pop();
+        if (!job) {
+            // The last stage owns the free list; submit() is done by now
+            if (s + 1 < StageCount) out.push(nullptr);
+            return;
+        }
+
+        const bool was_ok = job->ok;
+        auto t0 = std::chrono::steady_clock::now();
+        bool ran = false;
+        {
+            TraceScope span(stage_name(s), "stage");
+            ran = run_stage(s, *job);
+        }
+        if (!ran) {
+            job->ok = false;
+            if (was_ok) {
+                failed_.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "FramePipeline: frame " << job->index << " failed in " << stage_name(s) << std::endl;
+            }
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        if (was_ok) {
+            busy_us_[s].fetch_add(static_cast<uint64_t>(us), std::memory_order_relaxed);
+            frames_[s].fetch_add(1, std::memory_order_relaxed);
+        }
+        if (s + 1 == StageCount && retire_) retire_(*job);
+        out.push(job);
+    }
+}
+
+void FramePipeline::denoise_batch_loop() {
+    SpscQueue<Job> &in = *in_[Denoise];
+    SpscQueue<Job> &out = *in_[Denoise + 1];
+    std::vector<FrameJob*> batch;
+    std::vector<char> was_ok;
+    batch.reserve(denoise_batch_);
+    was_ok.reserve(denoise_batch_);
+    if (Trace::enabled()) Trace::set_thread_name(stage_name(Denoise));
+    for (bool done = false; !done;) {
+        // A full batch, or whatever is left when the stream ends or a flush is requested
+        batch.clear();
+        was_ok.clear();
+        while (batch.size() < denoise_batch_) {
+            FrameJob *job = nullptr;
+            if (!in.pop_unless(job, [&] { return !batch.empty() && flush_.load(std::memory_order_acquire); }))
+                break;
+            if (!job) {
+                done = true;
+                break;
+            }
+            batch.push_back(job);
+            was_ok.push_back(job->ok);
+        }
+        if (batch.empty()) break;
+
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            TraceScope span(stage_name(Denoise), "stage");
+            runner_.run_denoise_batch(batch.data(), batch.size());
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+        uint64_t frames = 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!was_ok[i]) continue;
+            ++frames;
+            if (!batch[i]->ok) {
+                failed_.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "FramePipeline: frame " << batch[i]->index << " failed in " << stage_name(Denoise) << std::endl;
+            }
+        }
+        if (frames) {
+            busy_us_[Denoise].fetch_add(static_cast<uint64_t>(us), std::memory_order_relaxed);
+            frames_[Denoise].fetch_add(frames, std::memory_order_relaxed);
+        }
+        for (FrameJob *job : batch) out.push(job);
+    }
+    out.push(nullptr);
+}
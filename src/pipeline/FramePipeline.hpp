@@ -0,0 +1,133 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../sd/ONNXRunner.hpp"
+#include "../util/SpscQueue.hpp"
+
+// One frame to generate, as handed to FramePipeline / RunnerPool
+struct FrameRequest {
+    std::string prompt;
+    int steps = 28;
+    int seed = 1337;
+    float guidance_scale = 7.5f;
+    float strength = 1.f;
+    int interpolate = 0; // see FrameJob::interpolate
+};
+
+// ------------------------- Frame pipeline ------------------------------------
+// Runs encode -> denoise -> decode -> upload -> write on one thread per stage,
+// connected by bounded SPSC queues. A fixed pool of FrameJobs circulates
+// through the stages and back to submit(), so at most `in_flight` frames are
+// in the pipeline and submit() blocks when the slowest stage falls behind.
+// Sustained throughput is set by the slowest stage instead of the sum of all.
+//
+// submit() and finish() must be called from the same thread. The upload and
+// write callbacks run on their own stage threads; upload may fill job.rgba
+// for the writer when the frame was decoded straight to GPU memory.
+class FramePipeline {
+public:
+    using Sink = std::function<bool(FrameJob &job)>;
+    using Retire = std::function<void(FrameJob &job)>;
+
+    enum Stage { Encode, Denoise, Decode, Upload, Write, StageCount };
+
+    struct StageStats {
+        uint64_t frames = 0;
+        double busy_ms = 0.0;
+        size_t queued = 0; // frames waiting in front of the stage right now
+    };
+
+    // in_flight below StageCount leaves stages idle; 5-6 keeps them all busy.
+    FramePipeline(ONNXRunner &runner, int width, int height, size_t in_flight = 6);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    void set_upload(Sink sink) { upload_ = std::move(sink); }
+    void set_write(Sink sink) { write_ = std::move(sink); }
+
+    // Called on the write thread for every frame, failed ones included, just
+    // before its job goes back to the pool
+    void set_retire(Retire retire) { retire_ = std::move(retire); }
+
+    // GPU interop: one CUDA buffer per job (jobs() of them, indexed by
+    // FrameJob::slot) for the decoder output. Call before start().
+    size_t jobs() const { return pool_.size(); }
+    void set_device_images(const std::vector<void*> &images);
+
+    // Leave the image as planar floats for GPU conversion (FrameJob::planar).
+    // Call before start().
+    void set_planar_output(bool planar);
+
+    // Denoise up to `batch` consecutive frames in one batched UNet run
+    // (ONNXRunner::run_denoise_batch). The stage waits for a full batch
+    // (unless flushing, see set_flush()), so frames only leave it in groups.
+    // With strength < 1 each frame continues its stream lane (see submit()),
+    // wherever it lands in the batch. Clamped to the job pool and to what the
+    // runner supports. Call before start().
+    void set_denoise_batch(size_t batch);
+
+    // Allocates the runner buffers and starts the stage threads.
+    bool start();
+
+    // Queues one frame; blocks while all jobs are in flight. strength < 1
+    // seeds the frame from the previous one (see FrameJob::strength); frames
+    // are denoised in submit order, so "previous" is the frame submitted one
+    // denoise batch earlier (lane index % batch).
+    bool submit(const std::string &prompt, int steps = 28, int seed = 1337, float guidance_scale = 7.5f,
+                float strength = 1.f);
+
+    // Same, with the frame index chosen by the caller (FrameJob::index), for
+    // frames numbered across several pipelines, and the stream lane
+    // (FrameJob::lane) the frame continues with strength < 1
+    bool submit(const FrameRequest &req, uint64_t index, size_t lane = 0);
+
+    // While set, a partial denoise batch runs as soon as the input runs dry
+    // instead of waiting to be filled. RunnerPool sets it before blocking on a
+    // full device: that device's writer may be waiting for a frame held in
+    // this pipeline's partial batch, which would otherwise never fill.
+    void set_flush(bool flush) { flush_.store(flush, std::memory_order_release); }
+
+    // Ends the input without waiting: no more submit() calls after it, and a
+    // partial denoise batch runs as it is. finish() does this first.
+    void close();
+
+    // Drains every submitted frame, joins the threads and prints stage timings.
+    void finish();
+
+    StageStats stats(Stage s) const;
+    static const char *stage_name(Stage s);
+    uint64_t failed() const { return failed_.load(std::memory_order_relaxed); }
+
+private:
+    using Job = FrameJob*; // nullptr = end of stream
+
+    ONNXRunner &runner_;
+    int width_, height_;
+    std::vector<std::unique_ptr<FrameJob>> pool_;
+    SpscQueue<Job> free_;
+    std::array<std::unique_ptr<SpscQueue<Job>>, StageCount> in_; // input queue of each stage
+    std::array<std::thread, StageCount> threads_;
+    std::array<std::atomic<uint64_t>, StageCount> frames_{};
+    std::array<std::atomic<uint64_t>, StageCount> busy_us_{};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<bool> flush_{false};
+    Sink upload_, write_;
+    Retire retire_;
+    uint64_t next_index_ = 0;
+    size_t denoise_batch_ = 1;
+    bool running_ = false;
+    bool closed_ = false;
+
+    void stage_loop(Stage s);
+    void denoise_batch_loop();
+    bool run_stage(Stage s, FrameJob &job);
+};
@@ -0,0 +1,147 @@
+#include "QualityController.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Weight of the newest window in the smoothed costs
+constexpr double kSmoothing = 0.5;
+
+// Settings better than the current ones must fit in this share of the budget
+constexpr double kUpgradeMargin = 0.85;
+
+} // namespace
+
+QualityController::QualityController(const QualityTargets &targets, size_t devices, size_t window)
+: targets_(targets), devices_(std::max<size_t>(devices, 1)), window_(std::max<size_t>(window, 1)) {
+    targets_.max_steps = std::max(targets_.max_steps, 1);
+    targets_.min_steps = std::clamp(targets_.min_steps, 1, targets_.max_steps);
+    targets_.max_interpolate = std::max(targets_.max_interpolate, 0);
+    targets_.allow_cfg_off = targets_.allow_cfg_off && targets_.guidance > 1.f;
+    current_.steps = targets_.max_steps;
+    current_.cfg = targets_.guidance > 1.f;
+    current_.interpolate = 0;
+}
+
+void QualityController::apply(FrameRequest &req) const {
+    if (!enabled()) return;
+    req.steps = current_.steps;
+    req.guidance_scale = current_.cfg ? targets_.guidance : 1.f;
+    req.interpolate = current_.interpolate;
+}
+
+void QualityController::pace() {
+    if (!enabled()) return;
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>((1.0 + current_.interpolate) / targets_.fps));
+    auto now = Clock::now();
+    if (now < next_due_) {
+        std::this_thread::sleep_until(next_due_);
+        now = next_due_;
+    }
+    // A late frame does not earn a burst of catch-up frames
+    next_due_ = std::max(next_due_, now - interval) + interval;
+}
+
+void QualityController::on_written(const FrameJob &job) {
+    if (!enabled()) return;
+    Settings s;
+    s.steps = job.steps;
+    s.cfg = job.guidance_scale > 1.f;
+    const double latency = std::chrono::duration<double, std::milli>(Clock::now() - job.submitted).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++written_;
+    evals_ += evals(s);
+    outputs_ += 1.0 + static_cast<double>(job.inbetween.size());
+    latency_ms_ += latency;
+}
+
+int QualityController::evals(const Settings &s) const {
+    const int steps = std::max(1, static_cast<int>(std::lround(s.steps * targets_.strength)));
+    return steps * (s.cfg ? 2 : 1);
+}
+
+bool QualityController::fits(const Settings &s, double margin) const {
+    // Stages overlap, so throughput is set by the slowest one. Encode, denoise
+    // and decode run side by side on every device; uploads share the renderer
+    // and writes go through one encoder in order, so those do not scale.
+    double slowest = 0.0, total = 0.0;
+    for (int st = 0; st < FramePipeline::StageCount; ++st) {
+        double ms = unit_ms_[st];
+        const bool shared = st == FramePipeline::Upload || st == FramePipeline::Write;
+        if (st == FramePipeline::Denoise) ms *= evals(s);
+        else if (shared) ms *= 1.0 + s.interpolate;
+        slowest = std::max(slowest, shared ? ms : ms / static_cast<double>(devices_));
+        total += ms;
+    }
+    const double budget_ms = 1000.0 * (1.0 + s.interpolate) / targets_.fps;
+    if (slowest > margin * budget_ms) return false;
+    return targets_.latency_ms <= 0.f || total * queue_factor_ <= margin * targets_.latency_ms;
+}
+
+void QualityController::update(const std::array<FramePipeline::StageStats, FramePipeline::StageCount> &stats) {
+    if (!enabled()) return;
+    double n = 0.0, evals = 0.0, outputs = 0.0, latency = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (written_ < window_) return;
+        n = static_cast<double>(written_);
+        evals = evals_;
+        outputs = outputs_;
+        latency = latency_ms_;
+        written_ = 0;
+        evals_ = outputs_ = latency_ms_ = 0.0;
+    }
+
+    // Stage time per frame over the window, normalized to what scales with the settings
+    double stage_sum = 0.0;
+    for (int st = 0; st < FramePipeline::StageCount; ++st) {
+        const uint64_t frames = stats[st].frames - last_stats_[st].frames;
+        if (frames == 0) continue;
+        double ms = (stats[st].busy_ms - last_stats_[st].busy_ms) / static_cast<double>(frames);
+        stage_sum += ms;
+        if (st == FramePipeline::Denoise) ms /= std::max(evals / n, 1.0);
+        else if (st == FramePipeline::Upload || st == FramePipeline::Write) ms /= std::max(outputs / n, 1.0);
+        unit_ms_[st] = measured_ ? (1.0 - kSmoothing) * unit_ms_[st] + kSmoothing * ms : ms;
+    }
+    last_stats_ = stats;
+    measured_ = true;
+    // Time spent queued between stages, as a multiple of the work itself
+    if (stage_sum > 0.0) queue_factor_ = std::max(1.0, latency / n / stage_sum);
+
+    // Candidates from best to cheapest; the first that fits wins
+    std::vector<Settings> candidates;
+    for (int interp = 0; interp <= targets_.max_interpolate; ++interp) {
+        for (int cfg = 1; cfg >= 0; --cfg) {
+            if (cfg ? targets_.guidance <= 1.f : (targets_.guidance > 1.f && !targets_.allow_cfg_off)) continue;
+            for (int steps = targets_.max_steps; steps >= targets_.min_steps; --steps)
+                candidates.push_back(Settings{steps, cfg != 0, interp});
+        }
+    }
+    if (candidates.empty()) return;
+    size_t current = candidates.size();
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const Settings &c = candidates[i];
+        if (c.steps == current_.steps && c.cfg == current_.cfg && c.interpolate == current_.interpolate) current = i;
+    }
+    size_t choice = candidates.size() - 1; // nothing fits: cheapest
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (fits(candidates[i], i < current ? kUpgradeMargin : 1.0)) {
+            choice = i;
+            break;
+        }
+    }
+    if (choice == current) return;
+
+    current_ = candidates[choice];
+    ++changes_;
+    std::cout << "Quality: " << current_.steps << " steps, CFG " << (current_.cfg ? "on" : "off") << ", "
+              << current_.interpolate << " in-between(s) for " << std::fixed << std::setprecision(1)
+              << targets_.fps << " fps" << std::endl;
+}
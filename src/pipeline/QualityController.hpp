@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "FramePipeline.hpp"
+
+// ------------------------- Quality controller --------------------------------
+// Feedback loop around the generation loop that holds a target output frame
+// rate (and optionally a submit-to-write latency budget) by trading quality
+// for speed instead of letting the pipeline fall behind.
+//
+// Every `window` written frames it turns the pipeline's stage timings into
+// per-unit costs (denoise per UNet evaluation, upload / write per output
+// frame) and picks the best settings predicted to fit. Quality order, best
+// first: fewer interpolated frames, then CFG on, then more steps. Moving to
+// better settings needs 15% headroom, so the choice does not flap.
+//
+// Resolution is not one of the knobs: runner buffers, TensorRT profiles and
+// the video writer are all sized for one resolution when the pipeline starts.
+//
+// apply(), pace() and update() run on the submit thread, on_written() on the
+// write thread.
+struct QualityTargets {
+    float fps = 0.f;          // output frames per second, in-betweens included; 0 = off
+    float latency_ms = 0.f;   // submit -> written, 0 = no budget
+    int min_steps = 1;
+    int max_steps = 28;
+    float guidance = 7.5f;    // used while CFG is on; above 1 allows dropping it
+    bool allow_cfg_off = true;
+    float strength = 1.f;     // img2img streaming runs steps * strength steps
+    int max_interpolate = 0;  // in-betweens per keyframe the controller may add
+};
+
+class QualityController {
+public:
+    struct Settings {
+        int steps = 28;
+        bool cfg = true;
+        int interpolate = 0;
+    };
+
+    QualityController(const QualityTargets &targets, size_t devices, size_t window);
+
+    bool enabled() const { return targets_.fps > 0.f; }
+
+    // Overwrites steps, guidance and interpolation of a frame about to be submitted
+    void apply(FrameRequest &req) const;
+
+    // Sleeps until the next keyframe is due, so frames are generated at the
+    // target rate rather than queued up (which only adds latency)
+    void pace();
+
+    // Re-plans when a window's worth of frames was written since the last time.
+    // `stats` are the totals of FramePipeline::stats() over every device.
+    void update(const std::array<FramePipeline::StageStats, FramePipeline::StageCount> &stats);
+
+    // One call per written keyframe
+    void on_written(const FrameJob &job);
+
+    Settings settings() const { return current_; }
+    uint64_t changes() const { return changes_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    QualityTargets targets_;
+    size_t devices_;
+    size_t window_;
+    Settings current_;
+    uint64_t changes_ = 0;
+    Clock::time_point next_due_{};
+
+    // Stage totals at the last re-plan, and smoothed per-unit costs
+    std::array<FramePipeline::StageStats, FramePipeline::StageCount> last_stats_{};
+    std::array<double, FramePipeline::StageCount> unit_ms_{};
+    bool measured_ = false;
+    double queue_factor_ = 1.0; // measured latency over the sum of stage times
+
+    // Written since the last re-plan (guarded by mutex_)
+    mutable std::mutex mutex_;
+    uint64_t written_ = 0;
+    double evals_ = 0.0, outputs_ = 0.0, latency_ms_ = 0.0;
+
+    // UNet evaluations of one frame
+    int evals(const Settings &s) const;
+    bool fits(const Settings &s, double margin) const;
+};
@@ -0,0 +1,160 @@
+#include "RunnerPool.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+RunnerPool::RunnerPool(const std::string &onnx_dir, const ProviderConfig &cfg, const std::vector<int> &devices,
+                       const std::string &tokenizer_json, int width, int height, size_t in_flight)
+: capacity_(std::max<size_t>(in_flight, 1)) {
+    std::vector<int> ids = devices;
+    if (ids.empty()) ids.push_back(cfg.device_id);
+    devices_.resize(ids.size());
+
+    auto load = [&](size_t i) {
+        ProviderConfig device_cfg = cfg;
+        device_cfg.device_id = ids[i];
+        devices_[i].id = ids[i];
+        devices_[i].runner = std::make_unique<ONNXRunner>(onnx_dir, device_cfg, tokenizer_json);
+    };
+    // Loading (and TensorRT engine builds) dominate startup, so devices load in
+    // parallel, but only after the first one: every runner on the provider
+    // would otherwise write the same ModelCache artifact (and its .data file)
+    // at once and could publish a torn one. The others then load it as cached.
+    load(0);
+    std::vector<std::thread> loaders;
+    for (size_t i = 1; i < ids.size(); ++i) loaders.emplace_back(load, i);
+    for (auto &t : loaders) t.join();
+
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        Device &d = devices_[i];
+        d.pipeline = std::make_unique<FramePipeline>(*d.runner, width, height, capacity_);
+        capacity_ = d.pipeline->jobs();
+        d.pipeline->set_write([this](FrameJob &job) { return write_in_order(job); });
+        d.pipeline->set_retire([this, i](FrameJob &job) { retire(i, job); });
+    }
+    if (devices_.size() > 1) std::cout << "RunnerPool: " << devices_.size() << " devices" << std::endl;
+}
+
+RunnerPool::~RunnerPool() {
+    finish();
+}
+
+void RunnerPool::set_scheduler(SchedulerKind kind) {
+    for (auto &d : devices_) d.runner->set_scheduler(kind);
+}
+
+void RunnerPool::set_denoise_batch(size_t batch) {
+    for (auto &d : devices_) d.pipeline->set_denoise_batch(batch);
+}
+
+void RunnerPool::set_planar_output(bool planar) {
+    for (auto &d : devices_) d.pipeline->set_planar_output(planar);
+}
+
+void RunnerPool::set_upload(FramePipeline::Sink sink) {
+    for (auto &d : devices_) d.pipeline->set_upload(sink);
+}
+
+void RunnerPool::warmup(int width, int height, int steps) {
+    std::vector<std::thread> threads;
+    for (auto &d : devices_) threads.emplace_back([&d, width, height, steps] { d.runner->warmup(width, height, steps); });
+    for (auto &t : threads) t.join();
+}
+
+bool RunnerPool::start() {
+    if (running_) return true;
+    for (auto &d : devices_) {
+        if (!d.pipeline->start()) {
+            std::cerr << "RunnerPool: pipeline for device " << d.id << " failed to start\n";
+            for (auto &started : devices_) started.pipeline->finish();
+            return false;
+        }
+    }
+    running_ = true;
+    return true;
+}
+
+bool RunnerPool::submit(const FrameRequest &req, int stream) {
+    if (!running_) return false;
+    size_t device = 0;
+    uint64_t index = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Before blocking, make every device run its partial batch: the frame the
+        // full device waits to write may sit in another device's batch, which
+        // only this thread could fill (streams are pinned, so shares are uneven)
+        bool flushing = false;
+        auto flush_all = [&] {
+            if (flushing || devices_.size() < 2) return;
+            flushing = true;
+            for (auto &d : devices_) d.pipeline->set_flush(true);
+        };
+        if (stream >= 0) {
+            device = static_cast<size_t>(stream) % devices_.size();
+            if (devices_[device].in_flight >= capacity_) flush_all();
+            changed_.wait(lock, [&] { return devices_[device].in_flight < capacity_; });
+        } else {
+            changed_.wait(lock, [&] {
+                auto it = std::min_element(devices_.begin(), devices_.end(),
+                                           [](const Device &a, const Device &b) { return a.in_flight < b.in_flight; });
+                device = static_cast<size_t>(it - devices_.begin());
+                if (it->in_flight >= capacity_) flush_all();
+                return it->in_flight < capacity_;
+            });
+        }
+        if (flushing)
+            for (auto &d : devices_) d.pipeline->set_flush(false);
+        ++devices_[device].in_flight;
+        index = next_index_++;
+    }
+    // Only this thread submits, so indices reach the pipelines in order
+    return devices_[device].pipeline->submit(req, index, stream >= 0 ? static_cast<size_t>(stream) : 0);
+}
+
+void RunnerPool::finish() {
+    if (!running_) return;
+    // Close every input before draining any device: a device's writer may be
+    // waiting for a frame still sitting in another device's partial batch.
+    for (auto &d : devices_) d.pipeline->close();
+    for (auto &d : devices_) {
+        if (devices_.size() > 1) std::cout << "Device " << d.id << ":" << std::endl;
+        d.pipeline->finish();
+    }
+    running_ = false;
+}
+
+uint64_t RunnerPool::failed() const {
+    uint64_t n = 0;
+    for (const auto &d : devices_) n += d.pipeline->failed();
+    return n;
+}
+
+FramePipeline::StageStats RunnerPool::stats(FramePipeline::Stage s) const {
+    FramePipeline::StageStats total;
+    for (const auto &d : devices_) {
+        const FramePipeline::StageStats st = d.pipeline->stats(s);
+        total.frames += st.frames;
+        total.busy_ms += st.busy_ms;
+        total.queued += st.queued;
+    }
+    return total;
+}
+
+bool RunnerPool::write_in_order(FrameJob &job) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return next_write_ == job.index; });
+    }
+    // Only the frame whose turn it is gets here; retire() passes the turn on
+    return !write_ || write_(job);
+}
+
+void RunnerPool::retire(size_t device, FrameJob &job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Frames that failed earlier never went through write_in_order
+    changed_.wait(lock, [&] { return next_write_ == job.index; });
+    ++next_write_;
+    --devices_[device].in_flight;
+    changed_.notify_all();
+}
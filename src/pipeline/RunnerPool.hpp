@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FramePipeline.hpp"
+
+// ------------------------- Runner pool ---------------------------------------
+// One ONNXRunner (its own sessions, allocator and buffers) and one
+// FramePipeline per GPU, all at the same resolution. submit() hands each frame
+// to the device with the fewest frames in flight, so a faster or less loaded
+// GPU pulls more of the work; streaming frames (stream >= 0) stay on device
+// stream % size() because they continue that device's latents.
+//
+// Frames are numbered in submit order across all devices and the write sink
+// sees them in that order, one at a time; upload sinks run on every device's
+// upload thread at once and must serialize access to anything shared.
+// submit() and finish() must be called from the same thread.
+class RunnerPool {
+public:
+    // devices: provider device ids (ProviderConfig::device_id); empty = cfg.device_id only.
+    // Sessions are created in parallel, one thread per device.
+    RunnerPool(const std::string &onnx_dir, const ProviderConfig &cfg, const std::vector<int> &devices,
+               const std::string &tokenizer_json, int width, int height, size_t in_flight = 6);
+    ~RunnerPool();
+
+    RunnerPool(const RunnerPool&) = delete;
+    RunnerPool& operator=(const RunnerPool&) = delete;
+
+    size_t size() const { return devices_.size(); }
+    ONNXRunner &runner(size_t i) { return *devices_[i].runner; }
+    FramePipeline &pipeline(size_t i) { return *devices_[i].pipeline; }
+
+    // Applied to every device; call before start()
+    void set_scheduler(SchedulerKind kind);
+    void set_denoise_batch(size_t batch);
+    void set_planar_output(bool planar);
+    void set_upload(FramePipeline::Sink sink);
+    void set_write(FramePipeline::Sink sink) { write_ = std::move(sink); }
+
+    // Warms every runner up concurrently
+    void warmup(int width, int height, int steps = 1);
+
+    bool start();
+
+    // Queues one frame on the least loaded device (or on the stream's device);
+    // blocks while that device has no free job.
+    bool submit(const FrameRequest &req, int stream = -1);
+
+    // Drains every device and prints its stage timings
+    void finish();
+
+    uint64_t failed() const;
+
+    // Stage totals over every device; safe to call while running
+    FramePipeline::StageStats stats(FramePipeline::Stage s) const;
+
+private:
+    struct Device {
+        int id = 0;
+        std::unique_ptr<ONNXRunner> runner;
+        std::unique_ptr<FramePipeline> pipeline;
+        size_t in_flight = 0;
+    };
+
+    std::vector<Device> devices_;
+    size_t capacity_; // jobs per device
+    FramePipeline::Sink write_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    uint64_t next_index_ = 0; // next frame to submit
+    uint64_t next_write_ = 0; // next frame the write sink may see
+    bool running_ = false;
+
+    bool write_in_order(FrameJob &job);
+    void retire(size_t device, FrameJob &job);
+};
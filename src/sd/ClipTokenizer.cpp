@@ -0,0 +1,426 @@
+#include "ClipTokenizer.hpp"
+
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view kEndOfWord = "</w>";
+constexpr std::string_view kStartOfText = "<|startoftext|>";
+constexpr std::string_view kEndOfText = "<|endoftext|>";
+constexpr size_t kMaxWord = 128; // longer words are split into chunks
+
+bool printable_byte(int b) {
+    return (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || (b >= 174 && b <= 255);
+}
+
+// Code point CLIP's bytes_to_unicode assigns to each byte
+uint32_t byte_codepoint(int b) {
+    if (printable_byte(b)) return static_cast<uint32_t>(b);
+    uint32_t n = 0;
+    for (int i = 0; i < b; ++i) if (!printable_byte(i)) ++n;
+    return 256 + n;
+}
+
+void append_utf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+uint8_t lower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + 32) : c;
+}
+bool is_space(uint8_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+bool is_digit(uint8_t c) { return c >= '0' && c <= '9'; }
+// Non-ASCII bytes are treated as letters so UTF-8 words stay together
+bool is_letter(uint8_t c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80; }
+
+bool starts_with(std::string_view s, size_t at, std::string_view prefix) {
+    return s.size() - at >= prefix.size() && s.compare(at, prefix.size(), prefix) == 0;
+}
+
+// Minimal JSON reader for the subset of tokenizer.json we need. Strings are
+// returned as raw views into the input; escaped ones are flagged.
+struct JsonReader {
+    const char *p;
+    const char *end;
+
+    void ws() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    }
+    bool peek(char c) {
+        ws();
+        return p < end && *p == c;
+    }
+    bool eat(char c) {
+        if (!peek(c)) return false;
+        ++p;
+        return true;
+    }
+    bool string(std::string_view &raw, bool &escaped) {
+        if (!eat('"')) return false;
+        const char *s = p;
+        escaped = false;
+        while (p < end && *p != '"') {
+            if (*p == '\\') {
+                escaped = true;
+                ++p;
+            }
+            ++p;
+        }
+        if (p >= end) return false;
+        raw = std::string_view(s, static_cast<size_t>(p - s));
+        ++p;
+        return true;
+    }
+    bool integer(int64_t &v) {
+        ws();
+        bool neg = p < end && *p == '-';
+        if (neg) ++p;
+        if (p >= end || !is_digit(static_cast<uint8_t>(*p))) return false;
+        v = 0;
+        while (p < end && is_digit(static_cast<uint8_t>(*p))) v = v * 10 + (*p++ - '0');
+        if (neg) v = -v;
+        return true;
+    }
+    // Skips any value, nested or not
+    bool skip() {
+        ws();
+        if (p >= end) return false;
+        if (*p == '"') {
+            std::string_view raw;
+            bool esc;
+            return string(raw, esc);
+        }
+        if (*p == '{' || *p == '[') {
+            int depth = 0;
+            while (p < end) {
+                char c = *p;
+                if (c == '"') {
+                    std::string_view raw;
+                    bool esc;
+                    if (!string(raw, esc)) return false;
+                    continue;
+                }
+                ++p;
+                if (c == '{' || c == '[') ++depth;
+                else if (c == '}' || c == ']') {
+                    if (--depth == 0) return true;
+                }
+            }
+            return false;
+        }
+        while (p < end && *p != ',' && *p != '}' && *p != ']') ++p;
+        return true;
+    }
+};
+
+std::string unescape(std::string_view raw) {
+    std::string out;
+    out.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        char c = raw[i];
+        if (c != '\\' || i + 1 >= raw.size()) {
+            out += c;
+            continue;
+        }
+        char e = raw[++i];
+        switch (e) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                auto hex4 = [&](size_t at, uint32_t &v) {
+                    if (at + 4 > raw.size()) return false;
+                    v = 0;
+                    for (size_t k = at; k < at + 4; ++k) {
+                        char h = raw[k];
+                        v <<= 4;
+                        if (h >= '0' && h <= '9') v |= static_cast<uint32_t>(h - '0');
+                        else if (h >= 'a' && h <= 'f') v |= static_cast<uint32_t>(h - 'a' + 10);
+                        else if (h >= 'A' && h <= 'F') v |= static_cast<uint32_t>(h - 'A' + 10);
+                        else return false;
+                    }
+                    return true;
+                };
+                uint32_t cp = 0;
+                if (!hex4(i + 1, cp)) break;
+                i += 4;
+                uint32_t lo = 0;
+                if (cp >= 0xD800 && cp <= 0xDBFF && i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+                    hex4(i + 3, lo)) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    i += 6;
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default: out += e; break; // \" \\ \/
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+ClipTokenizer::ClipTokenizer() {
+    // Byte-level fallback: vocab ids 0..255 are the bytes_to_unicode symbols in
+    // table order (printable bytes first), 256..511 the same with "</w>".
+    int32_t n = 0;
+    for (int b = 0; b < 256; ++b) if (printable_byte(b)) byte_id_[b] = n++;
+    for (int b = 0; b < 256; ++b) if (!printable_byte(b)) byte_id_[b] = n++;
+    for (int b = 0; b < 256; ++b) byte_id_eow_[b] = byte_id_[b] + 256;
+}
+
+bool ClipTokenizer::load(const std::string &tokenizer_json) {
+    *this = ClipTokenizer();
+    if (!file_.open(tokenizer_json)) {
+        std::cerr << "ClipTokenizer: cannot open " << tokenizer_json << ", using byte-level fallback" << std::endl;
+        return false;
+    }
+    std::string_view json(reinterpret_cast<const char*>(file_.data()), file_.size());
+    if (!parse(json)) {
+        std::cerr << "ClipTokenizer: " << tokenizer_json << " is not a CLIP BPE tokenizer.json" << std::endl;
+        *this = ClipTokenizer();
+        return false;
+    }
+    loaded_ = true;
+    return true;
+}
+
+bool ClipTokenizer::parse(std::string_view json) {
+    JsonReader r{json.data(), json.data() + json.size()};
+    auto key_of = [&](std::string_view raw, bool escaped) -> std::string_view {
+        if (!escaped) return raw;
+        owned_.push_back(unescape(raw));
+        return owned_.back();
+    };
+
+    // Merges are kept as string pairs until the whole vocab is known
+    std::vector<std::pair<std::string_view, std::string_view>> merges;
+
+    auto parse_vocab = [&]() {
+        if (!r.eat('{')) return false;
+        if (r.eat('}')) return true;
+        do {
+            std::string_view raw;
+            bool esc;
+            int64_t id;
+            if (!r.string(raw, esc) || !r.eat(':') || !r.integer(id)) return false;
+            vocab_[key_of(raw, esc)] = static_cast<int32_t>(id);
+        } while (r.eat(','));
+        return r.eat('}');
+    };
+
+    auto parse_merges = [&]() {
+        if (!r.eat('[')) return false;
+        if (r.eat(']')) return true;
+        do {
+            std::string_view a, b;
+            bool esc;
+            if (r.peek('[')) { // ["a", "b"]
+                r.eat('[');
+                std::string_view ra, rb;
+                bool ea, eb;
+                if (!r.string(ra, ea) || !r.eat(',') || !r.string(rb, eb) || !r.eat(']')) return false;
+                a = key_of(ra, ea);
+                b = key_of(rb, eb);
+            } else { // "a b"
+                std::string_view raw;
+                if (!r.string(raw, esc)) return false;
+                std::string_view s = key_of(raw, esc);
+                size_t sp = s.find(' ');
+                if (sp == std::string_view::npos) return false;
+                a = s.substr(0, sp);
+                b = s.substr(sp + 1);
+            }
+            merges.emplace_back(a, b);
+        } while (r.eat(','));
+        return r.eat(']');
+    };
+
+    auto parse_added_tokens = [&]() {
+        if (!r.eat('[')) return false;
+        if (r.eat(']')) return true;
+        do {
+            if (!r.eat('{')) return false;
+            int64_t id = -1;
+            std::string_view content;
+            do {
+                std::string_view k;
+                bool esc;
+                if (!r.string(k, esc) || !r.eat(':')) return false;
+                if (k == "id") {
+                    if (!r.integer(id)) return false;
+                } else if (k == "content") {
+                    std::string_view raw;
+                    if (!r.string(raw, esc)) return false;
+                    content = key_of(raw, esc);
+                } else if (!r.skip()) {
+                    return false;
+                }
+            } while (r.eat(','));
+            if (!r.eat('}')) return false;
+            if (content == kStartOfText) bos_id_ = id;
+            if (content == kEndOfText) eos_id_ = pad_id_ = id;
+        } while (r.eat(','));
+        return r.eat(']');
+    };
+
+    auto parse_model = [&]() {
+        if (!r.eat('{')) return false;
+        if (r.eat('}')) return true;
+        do {
+            std::string_view k;
+            bool esc;
+            if (!r.string(k, esc) || !r.eat(':')) return false;
+            bool ok = k == "vocab" ? parse_vocab() : k == "merges" ? parse_merges() : r.skip();
+            if (!ok) return false;
+        } while (r.eat(','));
+        return r.eat('}');
+    };
+
+    bool ok = r.eat('{');
+    if (ok && !r.eat('}')) {
+        do {
+            std::string_view k;
+            bool esc;
+            if (!r.string(k, esc) || !r.eat(':')) { ok = false; break; }
+            ok = k == "model" ? parse_model() : k == "added_tokens" ? parse_added_tokens() : r.skip();
+        } while (ok && r.eat(','));
+    }
+    return ok && !vocab_.empty() && build_tables(merges);
+}
+
+bool ClipTokenizer::build_tables(const std::vector<std::pair<std::string_view, std::string_view>> &pending) {
+    std::string sym;
+    for (int b = 0; b < 256; ++b) {
+        sym.clear();
+        append_utf8(sym, byte_codepoint(b));
+        auto it = vocab_.find(sym);
+        sym += kEndOfWord;
+        auto it_eow = vocab_.find(sym);
+        if (it == vocab_.end() || it_eow == vocab_.end()) return false;
+        byte_id_[b] = it->second;
+        byte_id_eow_[b] = it_eow->second;
+    }
+
+    merges_.reserve(pending.size());
+    for (size_t rank = 0; rank < pending.size(); ++rank) {
+        auto left = vocab_.find(pending[rank].first);
+        auto right = vocab_.find(pending[rank].second);
+        sym.assign(pending[rank].first);
+        sym += pending[rank].second;
+        auto merged = vocab_.find(sym);
+        if (left == vocab_.end() || right == vocab_.end() || merged == vocab_.end()) continue;
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(left->second)) << 32) |
+                       static_cast<uint32_t>(right->second);
+        merges_.emplace(key, Merge{static_cast<int32_t>(rank), merged->second});
+    }
+    return !merges_.empty();
+}
+
+size_t ClipTokenizer::encode_word(std::string_view word, int64_t *out, size_t room) const {
+    int32_t sym[kMaxWord];
+    size_t n = 0;
+    for (size_t i = 0; i < word.size(); ++i) {
+        uint8_t c = lower(static_cast<uint8_t>(word[i]));
+        sym[n++] = (i + 1 == word.size()) ? byte_id_eow_[c] : byte_id_[c];
+    }
+
+    // Repeatedly merge the adjacent pair with the lowest rank
+    while (n > 1 && !merges_.empty()) {
+        int32_t best_rank = INT_MAX;
+        size_t best = 0;
+        int32_t best_id = 0;
+        for (size_t i = 0; i + 1 < n; ++i) {
+            uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(sym[i])) << 32) | static_cast<uint32_t>(sym[i + 1]);
+            auto it = merges_.find(key);
+            if (it != merges_.end() && it->second.rank < best_rank) {
+                best_rank = it->second.rank;
+                best = i;
+                best_id = it->second.merged;
+            }
+        }
+        if (best_rank == INT_MAX) break;
+        sym[best] = best_id;
+        std::memmove(&sym[best + 1], &sym[best + 2], (n - best - 2) * sizeof(int32_t));
+        --n;
+    }
+
+    size_t written = n < room ? n : room;
+    for (size_t i = 0; i < written; ++i) out[i] = sym[i];
+    return written;
+}
+
+size_t ClipTokenizer::encode(std::string_view text, int64_t *out, size_t max_len) const {
+    if (max_len == 0) return 0;
+    size_t n = 0;
+    out[n++] = bos_id_;
+    if (max_len < 2) return n; // no room for <eos>
+    const size_t last = max_len - 1; // keep room for <eos>
+
+    // CLIP pre-tokenization: special tokens | 's 't 're 've 'm 'll 'd | letters+ | digit | other+
+    size_t i = 0;
+    while (i < text.size() && n < last) {
+        uint8_t c = static_cast<uint8_t>(text[i]);
+        if (is_space(c)) {
+            ++i;
+            continue;
+        }
+        if (starts_with(text, i, kStartOfText) || starts_with(text, i, kEndOfText)) {
+            bool start = starts_with(text, i, kStartOfText);
+            out[n++] = start ? bos_id_ : eos_id_;
+            i += start ? kStartOfText.size() : kEndOfText.size();
+            continue;
+        }
+
+        size_t end = i + 1;
+        if (c == '\'' && i + 1 < text.size()) {
+            uint8_t c1 = lower(static_cast<uint8_t>(text[i + 1]));
+            uint8_t c2 = i + 2 < text.size() ? lower(static_cast<uint8_t>(text[i + 2])) : 0;
+            if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) end = i + 3;
+            else if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') end = i + 2;
+        }
+        if (end == i + 1) {
+            if (is_letter(c)) {
+                while (end < text.size() && is_letter(static_cast<uint8_t>(text[end]))) ++end;
+            } else if (!is_digit(c)) {
+                while (end < text.size()) {
+                    uint8_t e = static_cast<uint8_t>(text[end]);
+                    if (is_space(e) || is_letter(e) || is_digit(e)) break;
+                    ++end;
+                }
+            }
+        }
+
+        for (size_t w = i; w < end && n < last; w += kMaxWord) {
+            size_t len = end - w < kMaxWord ? end - w : kMaxWord;
+            n += encode_word(text.substr(w, len), out + n, last - n);
+        }
+        i = end;
+    }
+
+    out[n++] = eos_id_;
+    const size_t used = n;
+    while (n < max_len) out[n++] = pad_id_;
+    return used;
+}
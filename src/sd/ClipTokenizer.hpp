@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../util/MappedFile.hpp"
+
+// ------------------------- CLIP BPE tokenizer --------------------------------
+// Byte-level BPE as used by the CLIP text encoder, loaded from a HuggingFace
+// tokenizer.json. The file is memory-mapped and the vocab keys point straight
+// into the mapping; only escaped strings are copied. encode() does not allocate.
+//
+// Without a loaded file encode() falls back to CLIP's unmerged byte-level
+// symbols, which are still valid vocab ids.
+class ClipTokenizer {
+public:
+    ClipTokenizer();
+
+    bool load(const std::string &tokenizer_json);
+    bool loaded() const { return loaded_; }
+
+    // Writes <bos> tokens <eos> into out and pads the rest of out[0..max_len)
+    // with pad_id(). Returns the number of ids before padding.
+    size_t encode(std::string_view text, int64_t *out, size_t max_len) const;
+
+    int64_t bos_id() const { return bos_id_; }
+    int64_t eos_id() const { return eos_id_; }
+    int64_t pad_id() const { return pad_id_; }
+    size_t vocab_size() const { return vocab_.size(); }
+
+private:
+    struct Merge {
+        int32_t rank;
+        int32_t merged;
+    };
+
+    MappedFile file_;
+    std::deque<std::string> owned_; // decoded copies of escaped strings
+    std::unordered_map<std::string_view, int32_t> vocab_;
+    std::unordered_map<uint64_t, Merge> merges_; // (left id << 32 | right id) -> merge
+    std::array<int32_t, 256> byte_id_{};         // byte -> id of its symbol
+    std::array<int32_t, 256> byte_id_eow_{};     // byte -> id of its symbol + "</w>"
+    int64_t bos_id_ = 49406;
+    int64_t eos_id_ = 49407;
+    int64_t pad_id_ = 49407;
+    bool loaded_ = false;
+
+    bool parse(std::string_view json);
+    bool build_tables(const std::vector<std::pair<std::string_view, std::string_view>> &merges);
+    size_t encode_word(std::string_view word, int64_t *out, size_t room) const;
+};
@@ -0,0 +1,72 @@
+#include "EmbeddingCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+EmbeddingCache::EmbeddingCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+bool EmbeddingCache::Key::operator==(const Key &o) const {
+    return n == o.n && std::memcmp(ids, o.ids, n * sizeof(int64_t)) == 0;
+}
+
+size_t EmbeddingCache::KeyHash::operator()(const Key &k) const {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < k.n; ++i) hash = (hash ^ static_cast<uint64_t>(k.ids[i])) * 1099511628211ull;
+    return static_cast<size_t>(hash);
+}
+
+size_t EmbeddingCache::entry_bytes(const Entry &e) {
+    return sizeof(Entry) + e.ids.size() * sizeof(int64_t) + e.data.size() * sizeof(float);
+}
+
+bool EmbeddingCache::lookup(const int64_t *ids, size_t n, float *out, size_t out_count) {
+    auto it = index_.find(Key{ids, n});
+    if (it == index_.end() || it->second->data.size() != out_count) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    std::copy(it->second->data.begin(), it->second->data.end(), out);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void EmbeddingCache::insert(const int64_t *ids, size_t n, const float *data, size_t count) {
+    auto it = index_.find(Key{ids, n});
+    if (it != index_.end()) {
+        bytes_ -= entry_bytes(*it->second);
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    Entry e;
+    e.ids.assign(ids, ids + n);
+    e.data.assign(data, data + count);
+    const size_t sz = entry_bytes(e);
+    if (sz > max_bytes_) return;
+
+    evict_to(max_bytes_ - sz);
+    lru_.push_front(std::move(e));
+    index_.emplace(Key{lru_.front().ids.data(), n}, lru_.begin());
+    bytes_ += sz;
+}
+
+void EmbeddingCache::set_max_bytes(size_t max_bytes) {
+    max_bytes_ = max_bytes;
+    evict_to(max_bytes_);
+}
+
+void EmbeddingCache::clear() {
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+void EmbeddingCache::evict_to(size_t budget) {
+    while (bytes_ > budget && !lru_.empty()) {
+        Entry &victim = lru_.back();
+        bytes_ -= entry_bytes(victim);
+        index_.erase(Key{victim.ids.data(), victim.ids.size()});
+        lru_.pop_back();
+    }
+}
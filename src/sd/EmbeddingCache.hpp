@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// ------------------------- Embedding cache -----------------------------------
+// LRU cache of text_encoder outputs keyed on the token ids that produced them.
+// Bounded by an approximate byte budget; the least recently used entries are
+// evicted first. Not thread-safe, it is owned by a single ONNXRunner; only
+// hits() and misses() may be read from other threads.
+class EmbeddingCache {
+public:
+    explicit EmbeddingCache(size_t max_bytes = 64ull << 20);
+
+    // Copies the cached embedding for ids[0..n) into out and marks it as most
+    // recently used. Returns false on a miss or when the size does not match.
+    bool lookup(const int64_t *ids, size_t n, float *out, size_t out_count);
+
+    // Stores a copy of data[0..count) for ids[0..n), evicting as needed.
+    void insert(const int64_t *ids, size_t n, const float *data, size_t count);
+
+    void set_max_bytes(size_t max_bytes);
+    void clear();
+
+    size_t max_bytes() const { return max_bytes_; }
+    size_t bytes() const { return bytes_; }
+    size_t size() const { return index_.size(); }
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        std::vector<int64_t> ids;
+        std::vector<float> data;
+    };
+
+    // Non-owning view of a token sequence; map keys point into Entry::ids so
+    // lookups do not allocate.
+    struct Key {
+        const int64_t *ids;
+        size_t n;
+        bool operator==(const Key &o) const;
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const;
+    };
+
+    std::list<Entry> lru_; // front = most recently used
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    static size_t entry_bytes(const Entry &e);
+    void evict_to(size_t budget);
+};
@@ -0,0 +1,162 @@
+#include "ModelCache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <onnxruntime_session_options_config_keys.h>
+
+#include "ModelLoader.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t kSampleBlock = 4096;
+constexpr size_t kSampleCount = 64;
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t n) {
+    const auto *p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < n; ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Folds the size and kSampleCount blocks spread over the file into `hash`
+uint64_t sample(uint64_t hash, const fs::path &file, uint64_t size) {
+    hash = fnv1a(hash, &size, sizeof(size));
+    std::ifstream f(file, std::ios::binary);
+    std::vector<char> block(kSampleBlock);
+    for (size_t i = 0; i < kSampleCount && f; ++i) {
+        uint64_t off = size > kSampleBlock ? (size - kSampleBlock) * i / (kSampleCount - 1) : 0;
+        f.seekg(static_cast<std::streamoff>(off));
+        f.read(block.data(), static_cast<std::streamsize>(block.size()));
+        hash = fnv1a(hash, block.data(), static_cast<size_t>(f.gcount()));
+        f.clear();
+    }
+    return hash;
+}
+
+} // namespace
+
+ModelCache::ModelCache(const fs::path &cache_dir, const ProviderConfig &cfg)
+: dir_(cache_dir), cfg_(cfg) {
+    // DirectML folds its own fused nodes at load time; an ORT-optimized model
+    // saved for it is not portable, so only the other providers are cached.
+    enabled_ = cfg.model_cache && cfg.provider != ExecutionProvider::DirectML;
+
+    std::string trt = "trt_" + std::to_string(cfg.shape_width) + "x" + std::to_string(cfg.shape_height) +
+                      (cfg.fp16 ? "_fp16" : "");
+    trt_dir_ = cfg.trt_cache_dir.empty() ? dir_ / trt : fs::path(cfg.trt_cache_dir);
+
+    std::error_code ec;
+    if (enabled_) fs::create_directories(dir_, ec);
+    if (cfg.provider == ExecutionProvider::TensorRT) fs::create_directories(trt_dir_, ec);
+    if (ec) {
+        std::cerr << "ModelCache: cannot create " << dir_ << ": " << ec.message() << std::endl;
+        enabled_ = false;
+    }
+}
+
+std::string ModelCache::fingerprint(const fs::path &model) {
+    std::error_code ec;
+    const uint64_t size = fs::file_size(model, ec);
+    if (ec) return "0000000000000000";
+
+    uint64_t hash = sample(1469598103934665603ull, model, size);
+
+    // Weights exported as external data live next to the graph; new weights
+    // there leave the .onnx itself unchanged
+    MappedFile proto;
+    if (proto.open(model.string())) {
+        const fs::path dir = model.parent_path();
+        for (const std::string &location : ModelLoader::external_data_files(proto.data(), proto.size())) {
+            const uint64_t data_size = fs::file_size(dir / location, ec);
+            hash = fnv1a(hash, location.data(), location.size());
+            if (!ec) hash = sample(hash, dir / location, data_size);
+        }
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+// Optimized ONNX graphs do not depend on the input shape; TensorRT engines do.
+std::string ModelCache::tag() const {
+    std::string t = provider_name(cfg_.provider);
+    if (cfg_.provider == ExecutionProvider::TensorRT)
+        t += "_" + std::to_string(cfg_.shape_width) + "x" + std::to_string(cfg_.shape_height);
+    if (cfg_.fp16) t += "_fp16";
+    return t;
+}
+
+fs::path ModelCache::artifact(const fs::path &model) const {
+    const char *ext = cfg_.provider == ExecutionProvider::TensorRT ? ".ctx.onnx" : ".opt.onnx";
+    return dir_ / (model.stem().string() + "." + fingerprint(model) + "." + tag() + ext);
+}
+
+fs::path ModelCache::pending(const fs::path &artifact) {
+    fs::path p = artifact;
+    p += ".tmp";
+    return p;
+}
+
+fs::path ModelCache::prepare(const fs::path &model, Ort::SessionOptions &opts) {
+    if (!enabled_) return model;
+
+    const fs::path art = artifact(model);
+    if (fs::exists(art)) {
+        // Already optimized for this provider: skip the optimizer passes
+        if (cfg_.provider != ExecutionProvider::TensorRT)
+            opts.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+        std::cout << "ModelCache: loading " << art.filename().string() << std::endl;
+        return art;
+    }
+
+    const fs::path tmp = pending(art);
+    if (cfg_.provider == ExecutionProvider::TensorRT) {
+        // EP-context model: the compiled engine is referenced instead of rebuilt
+        opts.AddConfigEntry(kOrtSessionOptionEpContextEnable, "1");
+        opts.AddConfigEntry(kOrtSessionOptionEpContextFilePath, tmp.string().c_str());
+        opts.AddConfigEntry(kOrtSessionOptionEpContextEmbedMode, "0");
+    } else {
+        // Weights go to a side file so UNets above the 2 GB protobuf limit can be saved
+        opts.SetOptimizedModelFilePath(tmp.c_str());
+        std::string data = art.filename().string() + ".data";
+        opts.AddConfigEntry(kOrtSessionOptionsOptimizedModelExternalInitializersFileName, data.c_str());
+        opts.AddConfigEntry(kOrtSessionOptionsOptimizedModelExternalInitializersMinSizeInBytes, "1024");
+    }
+    return model;
+}
+
+void ModelCache::commit(const fs::path &model) {
+    if (!enabled_) return;
+
+    const fs::path art = artifact(model);
+    const fs::path tmp = pending(art);
+    std::error_code ec;
+    if (fs::exists(tmp)) {
+        fs::rename(tmp, art, ec);
+        if (ec) {
+            std::cerr << "ModelCache: cannot publish " << art << ": " << ec.message() << std::endl;
+            return;
+        }
+        std::cout << "ModelCache: wrote " << art.filename().string() << std::endl;
+    }
+
+    // Drop artifacts of older versions of the same model for this provider
+    const std::string prefix = model.stem().string() + ".";
+    const std::string keep = art.filename().string();
+    const std::string marker = "." + tag() + ".";
+    for (const auto &entry : fs::directory_iterator(dir_, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind(prefix, 0) != 0 || name.rfind(keep, 0) == 0) continue;
+        if (name.find(marker) == std::string::npos || ends_with(name, ".tmp")) continue;
+        fs::remove(entry.path(), ec);
+    }
+}
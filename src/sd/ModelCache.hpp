@@ -0,0 +1,47 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "RunnerConfig.hpp"
+
+// ------------------------- Model artifact cache ------------------------------
+// Keeps ORT-optimized models (CPU/CUDA) and TensorRT EP-context models next to
+// models/, keyed on a fingerprint of the source file, the provider and the
+// target shape. The first run writes the artifacts while creating the sessions;
+// later runs load them directly and skip graph optimization / engine builds.
+class ModelCache {
+public:
+    ModelCache(const std::filesystem::path &cache_dir, const ProviderConfig &cfg);
+
+    bool enabled() const { return enabled_; }
+
+    // Directory for TensorRT engine and timing caches
+    const std::filesystem::path &trt_dir() const { return trt_dir_; }
+
+    // Returns the file the session should be created from. Either a cached
+    // artifact (and opts skip re-optimization), or `model` itself with opts set
+    // up to write the artifact during session creation.
+    std::filesystem::path prepare(const std::filesystem::path &model, Ort::SessionOptions &opts);
+
+    // Call once the session created from prepare()'s path is up: publishes the
+    // freshly written artifact and drops stale ones for the same model.
+    void commit(const std::filesystem::path &model);
+
+    // Cheap content fingerprint: size and a sample of blocks spread over the
+    // file and over each external-data file it references. Hashing every byte
+    // of a multi-GB UNet would cost seconds; mtime is left out so copies of
+    // models/ on fresh workers still hit the cache.
+    static std::string fingerprint(const std::filesystem::path &model);
+
+private:
+    std::filesystem::path dir_;
+    std::filesystem::path trt_dir_;
+    ProviderConfig cfg_;
+    bool enabled_ = false;
+
+    std::string tag() const;
+    std::filesystem::path artifact(const std::filesystem::path &model) const;
+    static std::filesystem::path pending(const std::filesystem::path &artifact);
+};
@@ -0,0 +1,90 @@
+#include "ModelLoader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <onnxruntime_session_options_config_keys.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Serialized StringStringEntryProto{key: "location", value: ...}: field 1
+// (tag 0x0a) of length 8, then field 2 (tag 0x12) with a varint length.
+constexpr char kLocationKey[] = "\x0a\x08location\x12";
+constexpr size_t kLocationKeySize = sizeof(kLocationKey) - 1;
+
+bool read_varint(const uint8_t *&p, const uint8_t *end, uint64_t &out) {
+    out = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t b = *p++;
+        out |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+Ort::PrepackedWeightsContainer &shared_prepacked_weights() {
+    static Ort::PrepackedWeightsContainer container;
+    return container;
+}
+
+std::vector<std::string> ModelLoader::external_data_files(const uint8_t *data, size_t size) {
+    std::vector<std::string> names;
+    const uint8_t *p = data, *end = data + size;
+    const auto *key = reinterpret_cast<const uint8_t*>(kLocationKey);
+    for (;;) {
+        p = std::search(p, end, key, key + kLocationKeySize);
+        if (p == end) break;
+        p += kLocationKeySize;
+        uint64_t len = 0;
+        if (!read_varint(p, end, len) || len == 0 || len > static_cast<uint64_t>(end - p)) continue;
+        std::string name(reinterpret_cast<const char*>(p), static_cast<size_t>(len));
+        p += len;
+        if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(std::move(name));
+    }
+    return names;
+}
+
+std::unique_ptr<Ort::Session> ModelLoader::open(Ort::Env &env, const fs::path &model, Ort::SessionOptions &opts) {
+    MappedFile proto;
+    if (!proto.open(model.string())) {
+        std::cerr << "ModelLoader: cannot map " << model << ", loading from the path\n";
+        return std::make_unique<Ort::Session>(env, model.c_str(), opts, shared_prepacked_weights());
+    }
+
+    // External data is looked up relative to the model, as when loading from the path
+    const fs::path dir = model.parent_path();
+    const std::string folder = dir.string();
+    opts.AddConfigEntry(kOrtSessionOptionsModelExternalInitializersFileFolderPath, folder.c_str());
+
+    std::vector<std::basic_string<ORTCHAR_T>> names;
+    std::vector<char*> buffers;
+    std::vector<size_t> lengths;
+    for (const std::string &location : external_data_files(proto.data(), proto.size())) {
+        MappedFile file;
+        if (!file.open((dir / location).string())) {
+            std::cerr << "ModelLoader: cannot map external data " << location << " of " << model.filename() << "\n";
+            continue;
+        }
+        // ORT only reads the buffers; the mapping itself is read-only
+        names.push_back(fs::path(location).native());
+        buffers.push_back(reinterpret_cast<char*>(const_cast<uint8_t*>(file.data())));
+        lengths.push_back(file.size());
+        files_.push_back(std::move(file));
+    }
+    if (!names.empty()) opts.AddExternalInitializersFromFilesInMemory(names, buffers, lengths);
+
+    // The graph itself is parsed into ORT's own structures; only the external
+    // data mappings have to stay
+    return std::make_unique<Ort::Session>(env, proto.data(), proto.size(), opts, shared_prepacked_weights());
+}
+
+size_t ModelLoader::mapped_bytes() const {
+    size_t n = 0;
+    for (const auto &f : files_) n += f.size();
+    return n;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "../util/MappedFile.hpp"
+
+// ------------------------- Mapped model loader -------------------------------
+// Creates sessions from memory-mapped .onnx files instead of paths. The model
+// and every external-data file it references are mapped read-only and shared,
+// and ORT gets the external data as in-memory files, so the CPU EP uses those
+// initializers in place: processes loading the same models/ directory share
+// one page-cache copy of the weights instead of a heap copy each. Weights
+// stored inline in the .onnx are still copied by the protobuf parser; export
+// with external data to share them.
+//
+// Prepacked CPU weights go to one container shared by every session of the
+// process. The mappings live as long as the loader, which must outlive the
+// sessions it created.
+class ModelLoader {
+public:
+    // Falls back to loading from the path when mapping fails
+    std::unique_ptr<Ort::Session> open(Ort::Env &env, const std::filesystem::path &model, Ort::SessionOptions &opts);
+
+    // Bytes currently mapped (models and external data)
+    size_t mapped_bytes() const;
+
+    // External-data locations referenced by a serialized ModelProto. Scans for
+    // the "location" entries of TensorProto.external_data instead of parsing
+    // the graph.
+    static std::vector<std::string> external_data_files(const uint8_t *data, size_t size);
+
+private:
+    std::vector<MappedFile> files_;
+};
+
+Ort::PrepackedWeightsContainer &shared_prepacked_weights();
@@ -0,0 +1,1012 @@
+#include "ONNXRunner.hpp"
+#include "ModelCache.hpp"
+#include "../util/Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+
+#include <onnxruntime_run_options_config_keys.h>
+#include <onnxruntime_session_options_config_keys.h>
+
+#ifdef USE_CUDA
+#include <cuda_runtime_api.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Latent scale factor of the SD 1.x VAE
+constexpr float kVaeScale = 0.18215f;
+
+// Rough peak activation memory of one SD VAE decode producing `pixels` image
+// pixels: the 128-channel full-resolution convolutions (about six tensors
+// live at once) plus the mid-block self-attention over the latent grid,
+// which grows with the square of the latent pixel count.
+constexpr size_t kVaeActivationsPerPixel = 128 * 6;
+constexpr int64_t kMinVaeTile = 32; // latent pixels, 256 image pixels
+
+size_t vae_decode_bytes(size_t pixels, size_t elem) {
+    const size_t latent = pixels / 64;
+    return (pixels * kVaeActivationsPerPixel + latent * latent) * elem;
+}
+
+// Tile origins along one axis: as few tiles as keep at least `overlap`
+// between neighbours, spread evenly with the last one flush with the edge,
+// so every tile has the same size
+std::vector<int64_t> tile_origins(int64_t dim, int64_t tile, int64_t overlap) {
+    if (tile >= dim) return {0};
+    const int64_t stride = tile - overlap;
+    const int64_t n = (dim - overlap + stride - 1) / stride;
+    std::vector<int64_t> o(static_cast<size_t>(n));
+    for (int64_t i = 0; i < n; ++i) o[i] = (i * (dim - tile) + (n - 1) / 2) / (n - 1);
+    return o;
+}
+
+// Blend weight along one axis of a tile, ramping over `ramp` image pixels at
+// the sides that overlap a neighbour
+void tile_ramp(float *w, int64_t size, int64_t ramp, bool lead, bool trail) {
+    if (ramp <= 0) lead = trail = false;
+    for (int64_t p = 0; p < size; ++p) {
+        float v = 1.f;
+        if (lead) v = std::min(v, (p + 0.5f) / ramp);
+        if (trail) v = std::min(v, (size - p - 0.5f) / ramp);
+        w[p] = v;
+    }
+}
+
+std::string io_name(Ort::Session &s, bool input, size_t index) {
+    Ort::AllocatorWithDefaultOptions alloc;
+    auto name = input ? s.GetInputNameAllocated(index, alloc) : s.GetOutputNameAllocated(index, alloc);
+    return name.get();
+}
+
+// Looks an input up by exact name, then by substring, then falls back to its position.
+size_t find_input(Ort::Session &s, const std::string &hint, size_t fallback) {
+    size_t n = s.GetInputCount();
+    for (size_t i = 0; i < n; ++i) if (io_name(s, true, i) == hint) return i;
+    for (size_t i = 0; i < n; ++i) if (io_name(s, true, i).find(hint) != std::string::npos) return i;
+    return fallback;
+}
+
+Ort::ConstTensorTypeAndShapeInfo input_info(Ort::Session &s, size_t index, Ort::TypeInfo &holder) {
+    holder = s.GetInputTypeInfo(index);
+    return holder.GetTensorTypeAndShapeInfo();
+}
+
+bool is_float_type(ONNXTensorElementDataType t) {
+    return t == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || t == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+}
+
+size_t element_size(ONNXTensorElementDataType t) {
+    switch (t) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return 2;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: return 4;
+        default: return 8;
+    }
+}
+
+// Host-side conversion between the pipeline's float/int64 buffers and the
+// element type a model declares (fp16 activations, int32 ids, int64 timestep).
+void convert_elements(const void *src, ONNXTensorElementDataType st, void *dst, ONNXTensorElementDataType dt, size_t n) {
+    constexpr auto F32 = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    constexpr auto F16 = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+    constexpr auto I32 = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
+    constexpr auto I64 = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+    if (st == F32 && dt == F16) {
+        auto *s = static_cast<const float*>(src);
+        auto *d = static_cast<Ort::Float16_t*>(dst);
+        for (size_t i = 0; i < n; ++i) d[i] = Ort::Float16_t(s[i]);
+    } else if (st == F16 && dt == F32) {
+        auto *s = static_cast<const Ort::Float16_t*>(src);
+        auto *d = static_cast<float*>(dst);
+        for (size_t i = 0; i < n; ++i) d[i] = s[i].ToFloat();
+    } else if (st == I64 && dt == I32) {
+        auto *s = static_cast<const int64_t*>(src);
+        auto *d = static_cast<int32_t*>(dst);
+        for (size_t i = 0; i < n; ++i) d[i] = static_cast<int32_t>(s[i]);
+    } else if (st == F32 && dt == I64) {
+        auto *s = static_cast<const float*>(src);
+        auto *d = static_cast<int64_t*>(dst);
+        for (size_t i = 0; i < n; ++i) d[i] = static_cast<int64_t>(std::lround(s[i]));
+    }
+}
+
+void copy_to_device(void *dst, const void *src, size_t bytes) {
+#ifdef USE_CUDA
+    cudaMemcpy(dst, src, bytes, cudaMemcpyHostToDevice);
+#else
+    (void)dst; (void)src; (void)bytes;
+#endif
+}
+
+void copy_from_device(void *dst, const void *src, size_t bytes) {
+#ifdef USE_CUDA
+    cudaMemcpy(dst, src, bytes, cudaMemcpyDeviceToHost);
+#else
+    (void)dst; (void)src; (void)bytes;
+#endif
+}
+
+// Ort::Env is a process-wide singleton, so arenas registered on it are shared
+// by every runner in the process and may only be registered once: the CPU
+// arena per process, a CUDA arena per device id. A second registration throws.
+struct EnvAllocators {
+    std::mutex mutex;
+    bool cpu = false;
+    std::set<int> cuda;
+};
+
+EnvAllocators &env_allocators() {
+    static EnvAllocators registry;
+    return registry;
+}
+
+} // namespace
+
+ONNXRunner::ONNXRunner(const std::string &onnx_dir, const ProviderConfig &cfg, const std::string &tokenizer_json)
+: env_(ORT_LOGGING_LEVEL_WARNING, "onnx_runner"),
+  cfg_(cfg),
+  cpu_mem_(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+  scheduler_(Scheduler::create(SchedulerKind::Euler)) {
+    onnx_dir_ = onnx_dir;
+    fs::path base(onnx_dir);
+    ModelCache cache(cfg_.cache_dir.empty() ? base / ".cache" : fs::path(cfg_.cache_dir), cfg_);
+    const std::string trt_cache = cache.trt_dir().string();
+
+    // CUDA graph capture needs a fixed-shape session with device-resident I/O,
+    // so it is only enabled for the UNet and only when device copies are available.
+    bool unet_graph = cfg_.cuda_graph &&
+                      (cfg_.provider == ExecutionProvider::CUDA || cfg_.provider == ExecutionProvider::TensorRT);
+#ifndef USE_CUDA
+    if (unet_graph) {
+        std::cerr << "cuda_graph needs a build with USE_CUDA (VIDEOGEN_WITH_CUDA); disabled" << std::endl;
+        unet_graph = false;
+    }
+#endif
+    cfg_.cuda_graph = unet_graph;
+
+    {
+        Ort::SessionOptions probe;
+        if (!configure_session_options(probe, cfg_, trt_cache, false)) {
+            std::cerr << "Execution provider '" << provider_name(cfg_.provider) << "' not available, using cpu" << std::endl;
+            cfg_.provider = ExecutionProvider::CPU;
+            cfg_.cuda_graph = false;
+            cache = ModelCache(cfg_.cache_dir.empty() ? base / ".cache" : fs::path(cfg_.cache_dir), cfg_);
+        }
+    }
+    if (cfg_.shared_arena) register_env_allocators();
+
+    // Try to load model files if present; otherwise we'll be in fallback mode.
+    // With fp16 enabled, <name>_fp16.onnx is preferred when it exists.
+    auto model = [&](const char *name) {
+        fs::path half = base / (std::string(name) + "_fp16.onnx");
+        if (cfg_.fp16 && fs::exists(half)) return half;
+        return base / (std::string(name) + ".onnx");
+    };
+    // Optimized / EP-context artifacts from a previous run are loaded when present.
+    // TensorRT context models point at their engine files relative to the model
+    // path, so those are always loaded from the path.
+    const auto load_start = std::chrono::steady_clock::now();
+    auto open_session = [&](const fs::path &path, bool cuda_graph) -> std::unique_ptr<Ort::Session> {
+        if (!fs::exists(path)) return nullptr;
+        Ort::SessionOptions opts;
+        configure_session_options(opts, cfg_, trt_cache, cuda_graph);
+        if (env_allocators_) opts.AddConfigEntry(kOrtSessionOptionsConfigUseEnvAllocators, "1");
+        if (!cfg_.ort_profile.empty()) {
+            const fs::path prefix = cfg_.ort_profile + "_" + path.stem().string() + "_dev" + std::to_string(cfg_.device_id);
+            opts.EnableProfiling(prefix.c_str());
+        }
+        fs::path load = cache.prepare(path, opts);
+        const bool trt_context = cfg_.provider == ExecutionProvider::TensorRT && load != path;
+        auto session = cfg_.mmap_models && !trt_context ? loader_.open(env_, load, opts)
+                                                        : std::make_unique<Ort::Session>(env_, load.c_str(), opts);
+        cache.commit(path);
+        return session;
+    };
+
+    // Tokenizer is loaded once; its vocab stays memory-mapped for the runner's lifetime
+    tokenizer_.load(tokenizer_json.empty() ? (base / "tokenizer.json").string() : tokenizer_json);
+
+    try {
+        session_text_ = open_session(model("text_encoder"), false);
+        session_unet_ = open_session(model("unet"), cfg_.cuda_graph);
+        session_vae_  = open_session(model("vae_decoder"), false);
+        if (session_text_ && session_unet_ && session_vae_) io_ok_ = inspect_models();
+        if (io_ok_ && cfg_.cuda_graph) setup_device_io();
+        // CUDA graphs replay fixed shapes, so they keep the two-call CFG path
+        unet_batched_ = io_ok_ && io_.batch_dynamic && !cfg_.cuda_graph;
+    } catch (const std::exception &e) {
+        std::cerr << "ONNX load error: " << e.what() << std::endl;
+    }
+    const auto load_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - load_start).count();
+    std::cout << "ONNXRunner: sessions loaded in " << load_ms << " ms";
+    if (loader_.mapped_bytes() > 0) std::cout << ", " << (loader_.mapped_bytes() >> 20) << " MiB of weights mapped";
+    std::cout << std::endl;
+    std::cout << "ONNXRunner: provider " << provider_name(cfg_.provider)
+              << (cfg_.cuda_graph ? " (cuda graph)" : "") << (unet_batched_ ? ", batched unet" : "") << std::endl;
+}
+
+ONNXRunner::~ONNXRunner() {
+    // Device slots must go back to the allocator before it is destroyed
+    buffers_.reset();
+    if (!cfg_.ort_profile.empty()) {
+        Ort::AllocatorWithDefaultOptions alloc;
+        for (Ort::Session *s : {session_text_.get(), session_unet_.get(), session_vae_.get()}) {
+            if (!s) continue;
+            try {
+                auto file = s->EndProfilingAllocated(alloc);
+                std::cout << "ONNXRunner: ORT profile written to " << file.get() << std::endl;
+            } catch (const std::exception &e) {
+                std::cerr << "ONNXRunner: ORT profiling error: " << e.what() << std::endl;
+            }
+        }
+    }
+}
+
+ONNXRunner::Buffers::~Buffers() {
+#ifdef USE_CUDA
+    for (void *p : pinned) cudaHostUnregister(p);
+#endif
+    Slot *slots[] = {&sample, &timestep_in, &hidden_in, &unet_out,
+                     &hidden_cond, &hidden_uncond, &unet_cond_out, &unet_uncond_out};
+    for (Slot *s : slots) {
+        if (s->device && device_alloc) device_alloc->Free(s->device);
+        s->device = nullptr;
+    }
+}
+
+bool ONNXRunner::inspect_models() {
+    Ort::TypeInfo holder{nullptr};
+    auto output_type = [&](Ort::Session &s, size_t index) {
+        holder = s.GetOutputTypeInfo(index);
+        return holder.GetTensorTypeAndShapeInfo().GetElementType();
+    };
+
+    // text_encoder: input_ids [1, 77] -> last_hidden_state [1, 77, 768]
+    io_.text_ids = io_name(*session_text_, true, 0);
+    io_.text_hidden = io_name(*session_text_, false, 0);
+    auto ids = input_info(*session_text_, 0, holder);
+    io_.text_ids_type = ids.GetElementType();
+    if (io_.text_ids_type != ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64 && io_.text_ids_type != ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32) {
+        std::cerr << "text_encoder: unsupported input_ids type" << std::endl;
+        return false;
+    }
+    auto ids_shape = ids.GetShape();
+    if (ids_shape.size() == 2 && ids_shape[1] > 0) io_.max_tokens = ids_shape[1];
+    io_.text_hidden_type = output_type(*session_text_, 0);
+
+    // unet: sample [1, 4, h/8, w/8], timestep [1], encoder_hidden_states [1, 77, 768] -> out_sample
+    size_t i_sample = find_input(*session_unet_, "sample", 0);
+    size_t i_time = find_input(*session_unet_, "timestep", 1);
+    size_t i_hidden = find_input(*session_unet_, "encoder_hidden_states", 2);
+    io_.unet_sample = io_name(*session_unet_, true, i_sample);
+    io_.unet_timestep = io_name(*session_unet_, true, i_time);
+    io_.unet_hidden = io_name(*session_unet_, true, i_hidden);
+    io_.unet_out = io_name(*session_unet_, false, 0);
+    auto sample = input_info(*session_unet_, i_sample, holder);
+    io_.unet_sample_type = sample.GetElementType();
+    auto sample_shape = sample.GetShape();
+    io_.batch_dynamic = !sample_shape.empty() && sample_shape[0] < 0;
+    auto ts = input_info(*session_unet_, i_time, holder);
+    io_.timestep_type = ts.GetElementType();
+    auto ts_shape = ts.GetShape();
+    io_.timestep_scalar = ts_shape.empty();
+    io_.timestep_batched = !ts_shape.empty() && ts_shape[0] < 0;
+    if (io_.timestep_type != ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64 && !is_float_type(io_.timestep_type)) {
+        std::cerr << "unet: unsupported timestep type" << std::endl;
+        return false;
+    }
+    auto hidden = input_info(*session_unet_, i_hidden, holder);
+    io_.unet_hidden_type = hidden.GetElementType();
+    auto hidden_shape = hidden.GetShape();
+    if (hidden_shape.size() == 3 && hidden_shape[2] > 0) io_.hidden_dim = hidden_shape[2];
+    io_.unet_out_type = output_type(*session_unet_, 0);
+
+    // vae_decoder: latent_sample [1, 4, h/8, w/8] -> sample [1, 3, h, w]
+    io_.vae_latent = io_name(*session_vae_, true, 0);
+    io_.vae_image = io_name(*session_vae_, false, 0);
+    auto vae_latent = input_info(*session_vae_, 0, holder);
+    io_.vae_latent_type = vae_latent.GetElementType();
+    auto vae_shape = vae_latent.GetShape();
+    io_.vae_dynamic = vae_shape.size() == 4 && vae_shape[2] < 0 && vae_shape[3] < 0;
+    io_.vae_image_type = output_type(*session_vae_, 0);
+
+    for (auto t : {io_.text_hidden_type, io_.unet_sample_type, io_.unet_hidden_type, io_.unet_out_type,
+                   io_.vae_latent_type, io_.vae_image_type}) {
+        if (!is_float_type(t)) {
+            std::cerr << "ONNXRunner: only float32/float16 activations are supported" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The env owns the arenas; sessions created with use_env_allocators take them
+// instead of building their own. Runners after the first reuse what is
+// already registered (the arena settings of the first one apply).
+void ONNXRunner::register_env_allocators() {
+    const size_t mb = 1ull << 20;
+    const size_t max_mem = static_cast<size_t>(cfg_.arena_max_mb) * mb;
+    const int initial = static_cast<int>(std::min<size_t>(static_cast<size_t>(cfg_.arena_initial_mb) * mb, INT_MAX));
+    const bool cuda = cfg_.provider == ExecutionProvider::CUDA || cfg_.provider == ExecutionProvider::TensorRT;
+    EnvAllocators &registry = env_allocators();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    try {
+        // -1 leaves ORT's default in place
+        Ort::ArenaCfg arena(max_mem, cfg_.arena_exact ? 1 : 0, initial > 0 ? initial : -1, -1);
+        if (!registry.cpu) {
+            env_.CreateAndRegisterAllocator(cpu_mem_, arena);
+            registry.cpu = true;
+        }
+        if (cuda && !registry.cuda.count(cfg_.device_id)) {
+            Ort::MemoryInfo cuda_mem("Cuda", OrtArenaAllocator, cfg_.device_id, OrtMemTypeDefault);
+            env_.CreateAndRegisterAllocatorV2("CUDAExecutionProvider", cuda_mem,
+                                              {{"device_id", std::to_string(cfg_.device_id)}}, arena);
+            registry.cuda.insert(cfg_.device_id);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Shared arena not available, sessions keep their own: " << e.what() << std::endl;
+    }
+    env_allocators_ = registry.cpu && (!cuda || registry.cuda.count(cfg_.device_id) > 0);
+}
+
+// Device-resident UNet I/O for CUDA graphs: the captured graph replays with the
+// same addresses every step, so those tensors live in session-owned device memory.
+void ONNXRunner::setup_device_io() {
+    device_mem_ = std::make_unique<Ort::MemoryInfo>("Cuda", OrtDeviceAllocator, cfg_.device_id, OrtMemTypeDefault);
+    device_alloc_ = std::make_unique<Ort::Allocator>(*session_unet_, *device_mem_);
+    unet_cond_opts_.AddConfigEntry(kOrtRunOptionsConfigCudaGraphAnnotation, "1");
+    unet_uncond_opts_.AddConfigEntry(kOrtRunOptionsConfigCudaGraphAnnotation, "2");
+}
+
+void ONNXRunner::bind_slot(Buffers &b, Slot &s, void *host, ONNXTensorElementDataType host_type, size_t count,
+                           ONNXTensorElementDataType type, const int64_t *shape, size_t rank, bool on_device) {
+    s.host = host;
+    s.host_type = host_type;
+    s.count = count;
+    s.type = type;
+    const size_t bytes = count * element_size(type);
+    if (type != host_type) s.stage.assign(bytes, 0);
+
+    if (on_device && device_alloc_) {
+        s.device = device_alloc_->Alloc(bytes);
+        b.device_alloc = device_alloc_.get();
+        s.value = Ort::Value::CreateTensor(*device_mem_, s.device, bytes, shape, rank, type);
+    } else {
+        void *data = s.stage.empty() ? host : s.stage.data();
+        s.value = Ort::Value::CreateTensor(cpu_mem_, data, bytes, shape, rank, type);
+    }
+}
+
+void ONNXRunner::to_model(Slot &s) {
+    const void *src = s.host;
+    if (s.type != s.host_type) {
+        convert_elements(s.host, s.host_type, s.stage.data(), s.type, s.count);
+        src = s.stage.data();
+    }
+    if (s.device) copy_to_device(s.device, src, s.count * element_size(s.type));
+}
+
+void ONNXRunner::from_model(Slot &s) {
+    void *dst = s.type != s.host_type ? static_cast<void*>(s.stage.data()) : s.host;
+    if (s.device) copy_from_device(dst, s.device, s.count * element_size(s.type));
+    if (s.type != s.host_type) convert_elements(s.stage.data(), s.type, s.host, s.host_type, s.count);
+}
+
+ONNXRunner::Buffers &ONNXRunner::buffers_for(int width, int height, size_t max_jobs) {
+    max_jobs = std::max<size_t>(max_jobs, 1);
+    if (buffers_ && buffers_->width == width && buffers_->height == height && buffers_->max_jobs >= max_jobs)
+        return *buffers_;
+
+    buffers_.reset();
+    auto b = std::make_unique<Buffers>();
+    b->width = width;
+    b->height = height;
+    b->latent_h = height / 8;
+    b->latent_w = width / 8;
+    b->max_jobs = max_jobs;
+
+    const size_t tokens = static_cast<size_t>(io_.max_tokens);
+    const size_t hidden = tokens * static_cast<size_t>(io_.hidden_dim);
+    const size_t latent = 4 * static_cast<size_t>(b->latent_h * b->latent_w);
+    const size_t pixels = 3 * static_cast<size_t>(width) * static_cast<size_t>(height);
+    const size_t batch = 2 * max_jobs; // cond + uncond
+
+    b->cond_ids.assign(tokens, tokenizer_.pad_id());
+    b->uncond_ids.assign(tokens, tokenizer_.pad_id());
+    b->enc_cond.assign(hidden, 0.f);
+    b->enc_uncond.assign(hidden, 0.f);
+    b->hidden.assign(batch * hidden, 0.f);
+    b->latents.assign(max_jobs * latent, 0.f);
+    b->model_in.assign(batch * latent, 0.f);
+    b->noise.assign(batch * latent, 0.f);
+    b->vae_in.assign(latent, 0.f);
+    b->image.assign(pixels, 0.f);
+    b->timestep.assign(batch, 0.f);
+    b->rngs.resize(max_jobs);
+    b->lane_latents.resize(max_jobs);
+    for (auto &lane : b->lane_latents) lane.reserve(latent);
+
+    const int64_t ids_shape[] = {1, io_.max_tokens};
+    const int64_t hidden_shape[] = {1, io_.max_tokens, io_.hidden_dim};
+    const int64_t latent_shape[] = {1, 4, b->latent_h, b->latent_w};
+    const int64_t image_shape[] = {1, 3, height, width};
+    constexpr auto F32 = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    constexpr auto I64 = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+
+    bind_slot(*b, b->ids_cond, b->cond_ids.data(), I64, tokens, io_.text_ids_type, ids_shape, 2, false);
+    bind_slot(*b, b->ids_uncond, b->uncond_ids.data(), I64, tokens, io_.text_ids_type, ids_shape, 2, false);
+    bind_slot(*b, b->text_cond_out, b->enc_cond.data(), F32, hidden, io_.text_hidden_type, hidden_shape, 3, false);
+    bind_slot(*b, b->text_uncond_out, b->enc_uncond.data(), F32, hidden, io_.text_hidden_type, hidden_shape, 3, false);
+
+    if (unet_batched_) {
+        b->unet = std::make_unique<Ort::IoBinding>(*session_unet_);
+        // Shaped once at full capacity first, so later (smaller) rebinds never
+        // reallocate the staging copies and they stay pinned
+        bind_unet_batch(*b, batch);
+        bind_unet_batch(*b, 2);
+    } else {
+        // One job at a time: sample and timestep are shared by the cond and
+        // uncond runs, the halves of hidden / noise are the batch layout for N = 1
+        const int64_t ts_shape[] = {1};
+        const size_t ts_rank = io_.timestep_scalar ? 0 : 1;
+        const bool dev = cfg_.cuda_graph;
+        bind_slot(*b, b->sample, b->model_in.data(), F32, latent, io_.unet_sample_type, latent_shape, 4, dev);
+        bind_slot(*b, b->timestep_in, b->timestep.data(), F32, 1, io_.timestep_type, ts_shape, ts_rank, dev);
+        bind_slot(*b, b->hidden_cond, b->hidden.data(), F32, hidden, io_.unet_hidden_type, hidden_shape, 3, dev);
+        bind_slot(*b, b->hidden_uncond, b->hidden.data() + hidden, F32, hidden, io_.unet_hidden_type, hidden_shape, 3, dev);
+        bind_slot(*b, b->unet_cond_out, b->noise.data(), F32, latent, io_.unet_out_type, latent_shape, 4, dev);
+        bind_slot(*b, b->unet_uncond_out, b->noise.data() + latent, F32, latent, io_.unet_out_type, latent_shape, 4, dev);
+
+        b->unet_cond = std::make_unique<Ort::IoBinding>(*session_unet_);
+        b->unet_cond->BindInput(io_.unet_sample.c_str(), b->sample.value);
+        b->unet_cond->BindInput(io_.unet_timestep.c_str(), b->timestep_in.value);
+        b->unet_cond->BindInput(io_.unet_hidden.c_str(), b->hidden_cond.value);
+        b->unet_cond->BindOutput(io_.unet_out.c_str(), b->unet_cond_out.value);
+
+        b->unet_uncond = std::make_unique<Ort::IoBinding>(*session_unet_);
+        b->unet_uncond->BindInput(io_.unet_sample.c_str(), b->sample.value);
+        b->unet_uncond->BindInput(io_.unet_timestep.c_str(), b->timestep_in.value);
+        b->unet_uncond->BindInput(io_.unet_hidden.c_str(), b->hidden_uncond.value);
+        b->unet_uncond->BindOutput(io_.unet_out.c_str(), b->unet_uncond_out.value);
+    }
+
+    choose_vae_tiles(*b);
+    if (b->tile_h > 0) {
+        const int64_t tile_latent_shape[] = {1, 4, b->tile_h, b->tile_w};
+        const int64_t tile_image_shape[] = {1, 3, b->tile_h * 8, b->tile_w * 8};
+        const size_t tile_latent = 4 * static_cast<size_t>(b->tile_h * b->tile_w);
+        const size_t tile_pixels = 3 * 64 * static_cast<size_t>(b->tile_h * b->tile_w);
+        b->tile_in.assign(tile_latent, 0.f);
+        b->tile_out.assign(tile_pixels, 0.f);
+        b->tile_weight.assign(static_cast<size_t>(width) * static_cast<size_t>(height), 0.f);
+        b->vae_in.clear();
+        bind_slot(*b, b->tile_latent, b->tile_in.data(), F32, tile_latent, io_.vae_latent_type, tile_latent_shape, 4, false);
+        bind_slot(*b, b->tile_image, b->tile_out.data(), F32, tile_pixels, io_.vae_image_type, tile_image_shape, 4, false);
+        b->vae_tile = std::make_unique<Ort::IoBinding>(*session_vae_);
+        b->vae_tile->BindInput(io_.vae_latent.c_str(), b->tile_latent.value);
+        b->vae_tile->BindOutput(io_.vae_image.c_str(), b->tile_image.value);
+    } else {
+        bind_slot(*b, b->vae_latent, b->vae_in.data(), F32, latent, io_.vae_latent_type, latent_shape, 4, false);
+        bind_slot(*b, b->vae_image, b->image.data(), F32, pixels, io_.vae_image_type, image_shape, 4, false);
+        b->vae = std::make_unique<Ort::IoBinding>(*session_vae_);
+        b->vae->BindInput(io_.vae_latent.c_str(), b->vae_latent.value);
+        b->vae->BindOutput(io_.vae_image.c_str(), b->vae_image.value);
+    }
+
+    b->text_cond = std::make_unique<Ort::IoBinding>(*session_text_);
+    b->text_cond->BindInput(io_.text_ids.c_str(), b->ids_cond.value);
+    b->text_cond->BindOutput(io_.text_hidden.c_str(), b->text_cond_out.value);
+
+    b->text_uncond = std::make_unique<Ort::IoBinding>(*session_text_);
+    b->text_uncond->BindInput(io_.text_ids.c_str(), b->ids_uncond.value);
+    b->text_uncond->BindOutput(io_.text_hidden.c_str(), b->text_uncond_out.value);
+
+    pin_host_buffers(*b);
+    buffers_ = std::move(b);
+    return *buffers_;
+}
+
+// Page-locks every host buffer ORT copies to or from the GPU, so those copies
+// DMA straight from it instead of bouncing through a driver staging buffer.
+// Only the buffers bound to the sessions; scheduler state stays pageable.
+void ONNXRunner::pin_host_buffers(Buffers &b) {
+#ifdef USE_CUDA
+    if (!cfg_.pinned_io || (cfg_.provider != ExecutionProvider::CUDA && cfg_.provider != ExecutionProvider::TensorRT))
+        return;
+    auto pin = [&](void *p, size_t bytes) {
+        if (!p || bytes == 0) return;
+        if (cudaHostRegister(p, bytes, cudaHostRegisterPortable) == cudaSuccess) b.pinned.push_back(p);
+    };
+    pin(b.hidden.data(), b.hidden.size() * sizeof(float));
+    pin(b.model_in.data(), b.model_in.size() * sizeof(float));
+    pin(b.noise.data(), b.noise.size() * sizeof(float));
+    pin(b.vae_in.data(), b.vae_in.size() * sizeof(float));
+    pin(b.tile_in.data(), b.tile_in.size() * sizeof(float));
+    pin(b.tile_out.data(), b.tile_out.size() * sizeof(float));
+    pin(b.image.data(), b.image.size() * sizeof(float));
+    pin(b.enc_cond.data(), b.enc_cond.size() * sizeof(float));
+    pin(b.enc_uncond.data(), b.enc_uncond.size() * sizeof(float));
+    Slot *staged[] = {&b.text_cond_out, &b.text_uncond_out, &b.sample, &b.hidden_in, &b.unet_out,
+                      &b.hidden_cond, &b.hidden_uncond, &b.unet_cond_out, &b.unet_uncond_out,
+                      &b.vae_latent, &b.vae_image, &b.tile_latent, &b.tile_image};
+    for (Slot *s : staged) pin(s->stage.data(), s->stage.capacity());
+#else
+    (void)b;
+#endif
+}
+
+// Reshapes the batched UNet binding to `batch` entries over the same host
+// buffers. Only happens when the batch size changes (CFG toggled, a short
+// final batch), not per step.
+void ONNXRunner::bind_unet_batch(Buffers &b, size_t batch) {
+    if (b.unet_batch == batch) return;
+    const int64_t n = static_cast<int64_t>(batch);
+    const size_t latent = 4 * static_cast<size_t>(b.latent_h * b.latent_w);
+    const size_t hidden = static_cast<size_t>(io_.max_tokens * io_.hidden_dim);
+    const int64_t latent_shape[] = {n, 4, b.latent_h, b.latent_w};
+    const int64_t hidden_shape[] = {n, io_.max_tokens, io_.hidden_dim};
+    const int64_t ts_shape[] = {io_.timestep_batched ? n : 1};
+    const size_t ts_count = io_.timestep_batched ? batch : 1;
+    const size_t ts_rank = io_.timestep_scalar ? 0 : 1;
+    constexpr auto F32 = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+
+    bind_slot(b, b.sample, b.model_in.data(), F32, batch * latent, io_.unet_sample_type, latent_shape, 4, false);
+    bind_slot(b, b.timestep_in, b.timestep.data(), F32, ts_count, io_.timestep_type, ts_shape, ts_rank, false);
+    bind_slot(b, b.hidden_in, b.hidden.data(), F32, batch * hidden, io_.unet_hidden_type, hidden_shape, 3, false);
+    bind_slot(b, b.unet_out, b.noise.data(), F32, batch * latent, io_.unet_out_type, latent_shape, 4, false);
+    b.unet->BindInput(io_.unet_sample.c_str(), b.sample.value);
+    b.unet->BindInput(io_.unet_timestep.c_str(), b.timestep_in.value);
+    b.unet->BindInput(io_.unet_hidden.c_str(), b.hidden_in.value);
+    b.unet->BindOutput(io_.unet_out.c_str(), b.unet_out.value);
+    b.unet_batch = batch;
+}
+
+void ONNXRunner::set_scheduler(SchedulerKind kind) {
+    if (scheduler_ && scheduler_->kind() == kind) return;
+    scheduler_ = Scheduler::create(kind);
+}
+
+ONNXRunner::Buffers *ONNXRunner::prepared(const FrameJob &job) {
+    if (buffers_ && buffers_->width == job.width && buffers_->height == job.height) return buffers_.get();
+    std::cerr << "ONNXRunner: frame " << job.index << " (" << job.width << "x" << job.height
+              << ") does not match the prepared resolution" << std::endl;
+    return nullptr;
+}
+
+void ONNXRunner::encode_prompt(Buffers &b, const std::string &prompt, bool cond, std::vector<float> &hidden) {
+    auto &ids = cond ? b.cond_ids : b.uncond_ids;
+    auto &enc = cond ? b.enc_cond : b.enc_uncond;
+    {
+        TraceScope span("tokenize");
+        tokenizer_.encode(prompt, ids.data(), ids.size());
+    }
+    hidden.resize(enc.size());
+
+    // Same tokens -> same embedding: only run the text encoder when the prompt changes
+    if (!embed_cache_.lookup(ids.data(), ids.size(), hidden.data(), hidden.size())) {
+        TraceScope span("text_encoder");
+        to_model(cond ? b.ids_cond : b.ids_uncond);
+        session_text_->Run(run_opts_, cond ? *b.text_cond : *b.text_uncond);
+        from_model(cond ? b.text_cond_out : b.text_uncond_out);
+        embed_cache_.insert(ids.data(), ids.size(), enc.data(), enc.size());
+        std::copy(enc.begin(), enc.end(), hidden.begin());
+    }
+}
+
+// Sampling with classifier-free guidance for `count` jobs with the same steps,
+// strength and CFG on/off; the scheduler owns the update rule. Everything below
+// works on the preallocated buffers and the scheduler's precomputed tables, so
+// the loop itself does not allocate.
+void ONNXRunner::denoise(Buffers &b, FrameJob *const *jobs, size_t count) {
+    Scheduler &sched = *scheduler_;
+    const FrameJob &lead = *jobs[0];
+    sched.set_steps(lead.steps);
+    const bool cfg = lead.guidance_scale > 1.f;
+    const size_t n = 4 * static_cast<size_t>(b.latent_h * b.latent_w); // one job
+    const size_t hidden = static_cast<size_t>(io_.max_tokens * io_.hidden_dim);
+    const size_t active = count * n;
+    float *latents = b.latents.data();
+    float *noise = b.noise.data();
+
+    // Once per frame, not per step: cond rows first, then uncond rows
+    for (size_t j = 0; j < count; ++j) {
+        std::copy(jobs[j]->cond_hidden.begin(), jobs[j]->cond_hidden.end(), b.hidden.begin() + j * hidden);
+        if (cfg) std::copy(jobs[j]->uncond_hidden.begin(), jobs[j]->uncond_hidden.end(),
+                           b.hidden.begin() + (count + j) * hidden);
+    }
+    if (unet_batched_) {
+        bind_unet_batch(b, cfg ? 2 * count : count);
+        to_model(b.hidden_in);
+    } else {
+        to_model(b.hidden_cond);
+        if (cfg) to_model(b.hidden_uncond);
+    }
+
+    // img2img: every job starts from the last result of its stream lane,
+    // noised up to the sigma where the shortened schedule starts. The batch
+    // shares one schedule, so unless every lane has a predecessor all of them
+    // start from noise.
+    std::normal_distribution<float> normal(0.f, 1.f);
+    const bool img2img = lead.strength < 1.f;
+    auto seeded = [&b](const FrameJob *job) {
+        return job->lane < b.lane_latents.size() && !b.lane_latents[job->lane].empty();
+    };
+    int first = 0;
+    if (img2img && std::all_of(jobs, jobs + count, seeded)) {
+        const int run = std::clamp(static_cast<int>(std::lround(lead.steps * lead.strength)), 1, lead.steps);
+        first = lead.steps - run;
+    }
+    for (size_t j = 0; j < count; ++j) {
+        std::mt19937 &rng = b.rngs[j];
+        rng.seed(static_cast<uint32_t>(jobs[j]->seed));
+        float *x = latents + j * n;
+        if (first > 0) {
+            const std::vector<float> &prev = b.lane_latents[jobs[j]->lane];
+            std::copy(prev.begin(), prev.end(), x);
+            const float start_sigma = sched.sigma(first);
+            for (size_t i = 0; i < n; ++i) x[i] += normal(rng) * start_sigma;
+        } else {
+            const float init_sigma = sched.sigma(0);
+            for (size_t i = 0; i < n; ++i) x[i] = normal(rng) * init_sigma;
+        }
+    }
+    sched.begin(n, count);
+
+    for (int k = first; k < lead.steps; ++k) {
+        TraceScope span("unet_step");
+        const float in_scale = sched.input_scale(k);
+        for (size_t i = 0; i < active; ++i) b.model_in[i] = latents[i] * in_scale;
+        std::fill(b.timestep.begin(), b.timestep.end(), sched.timestep(k));
+
+        if (unet_batched_) {
+            if (cfg) std::copy(b.model_in.begin(), b.model_in.begin() + active, b.model_in.begin() + active);
+            to_model(b.sample);
+            to_model(b.timestep_in);
+            session_unet_->Run(run_opts_, *b.unet);
+            from_model(b.unet_out);
+        } else {
+            to_model(b.sample);
+            to_model(b.timestep_in);
+            session_unet_->Run(unet_cond_opts_, *b.unet_cond);
+            from_model(b.unet_cond_out);
+            if (cfg) {
+                session_unet_->Run(unet_uncond_opts_, *b.unet_uncond);
+                from_model(b.unet_uncond_out);
+            }
+        }
+
+        // Guided eps goes into the cond half; the next UNet run overwrites it anyway
+        for (size_t j = 0; j < count; ++j) {
+            float *eps = noise + j * n;
+            if (cfg) {
+                const float g = jobs[j]->guidance_scale;
+                const float *uncond = noise + (count + j) * n;
+                for (size_t i = 0; i < n; ++i) eps[i] = uncond[i] + g * (eps[i] - uncond[i]);
+            }
+            sched.step(k, j, eps, latents + j * n, n, b.rngs[j]);
+        }
+    }
+    // Hand the results over so the next frame can start denoising right away
+    for (size_t j = 0; j < count; ++j) jobs[j]->latents.assign(latents + j * n, latents + (j + 1) * n);
+    if (!img2img) return;
+    for (size_t j = 0; j < count; ++j) {
+        const size_t lane = jobs[j]->lane;
+        if (lane >= b.lane_latents.size()) b.lane_latents.resize(lane + 1);
+        b.lane_latents[lane].assign(latents + j * n, latents + (j + 1) * n);
+    }
+}
+
+// Tiles only when asked to, or (auto) when the whole frame would not decode
+// within the budget; the tile is then the largest square that does.
+void ONNXRunner::choose_vae_tiles(Buffers &b) const {
+    b.tile_h = b.tile_w = 0;
+    if (cfg_.vae_tiling == 0) return;
+    const size_t elem = element_size(io_.vae_image_type);
+    const size_t budget = static_cast<size_t>(cfg_.vae_budget_mb) << 20;
+    const size_t frame = static_cast<size_t>(b.width) * static_cast<size_t>(b.height);
+    if (cfg_.vae_tiling < 0 && vae_decode_bytes(frame, elem) <= budget) return;
+    if (!io_.vae_dynamic) {
+        std::cerr << "ONNXRunner: vae_decoder has a fixed latent size, tiled decode disabled" << std::endl;
+        return;
+    }
+
+    int64_t tile = cfg_.vae_tile > 0 ? cfg_.vae_tile : std::max(b.latent_h, b.latent_w);
+    if (cfg_.vae_tile <= 0) {
+        tile = tile / 8 * 8;
+        while (tile > kMinVaeTile && vae_decode_bytes(static_cast<size_t>(tile * tile) * 64, elem) > budget) tile -= 8;
+    }
+    tile = std::max<int64_t>(tile, 8);
+    b.tile_h = std::min(tile, b.latent_h);
+    b.tile_w = std::min(tile, b.latent_w);
+    b.overlap = std::min<int64_t>(cfg_.vae_overlap, std::min(b.tile_h, b.tile_w) / 4);
+    b.tile_ys = tile_origins(b.latent_h, b.tile_h, b.overlap);
+    b.tile_xs = tile_origins(b.latent_w, b.tile_w, b.overlap);
+    std::cout << "ONNXRunner: tiled VAE decode, " << b.tile_xs.size() << "x" << b.tile_ys.size() << " tiles of "
+              << b.tile_w * 8 << "x" << b.tile_h * 8 << " px" << std::endl;
+}
+
+// Decodes job.latents into b.image (NCHW [-1,1], whole frame)
+void ONNXRunner::run_vae(Buffers &b, const FrameJob &job) {
+    TraceScope span("vae_decode");
+    if (b.tile_h > 0) {
+        decode_tiled(b, job);
+        return;
+    }
+    vae_input(b, job);
+    session_vae_->Run(run_opts_, *b.vae);
+    from_model(b.vae_image);
+}
+
+// Tiles run in raster order, each blended into the accumulated frame; the
+// decoder activations never exceed one tile's worth.
+void ONNXRunner::decode_tiled(Buffers &b, const FrameJob &job) {
+    const int64_t th = b.tile_h, tw = b.tile_w;
+    const int64_t ph = th * 8, pw = tw * 8;
+    const int64_t lh = b.latent_h, lw = b.latent_w;
+    const int64_t H = b.height, W = b.width;
+    const size_t plane = static_cast<size_t>(H * W);
+    std::fill(b.image.begin(), b.image.end(), 0.f);
+    std::fill(b.tile_weight.begin(), b.tile_weight.end(), 0.f);
+    std::vector<float> wy(static_cast<size_t>(ph)), wx(static_cast<size_t>(pw));
+
+    for (size_t iy = 0; iy < b.tile_ys.size(); ++iy) {
+        const int64_t ty = b.tile_ys[iy];
+        tile_ramp(wy.data(), ph, b.overlap * 8, ty > 0, ty + th < lh);
+        for (size_t ix = 0; ix < b.tile_xs.size(); ++ix) {
+            const int64_t tx = b.tile_xs[ix];
+            tile_ramp(wx.data(), pw, b.overlap * 8, tx > 0, tx + tw < lw);
+
+            for (int64_t c = 0; c < 4; ++c)
+                for (int64_t y = 0; y < th; ++y) {
+                    const float *src = job.latents.data() + (c * lh + ty + y) * lw + tx;
+                    float *dst = b.tile_in.data() + (c * th + y) * tw;
+                    for (int64_t x = 0; x < tw; ++x) dst[x] = src[x] / kVaeScale;
+                }
+            TraceScope tile_span("vae_tile");
+            to_model(b.tile_latent);
+            session_vae_->Run(run_opts_, *b.vae_tile);
+            from_model(b.tile_image);
+
+            const int64_t oy = ty * 8, ox = tx * 8;
+            for (int64_t y = 0; y < ph; ++y) {
+                float *weight = b.tile_weight.data() + (oy + y) * W + ox;
+                for (int64_t x = 0; x < pw; ++x) weight[x] += wy[y] * wx[x];
+                for (int64_t c = 0; c < 3; ++c) {
+                    const float *src = b.tile_out.data() + (c * ph + y) * pw;
+                    float *dst = b.image.data() + c * plane + (oy + y) * W + ox;
+                    for (int64_t x = 0; x < pw; ++x) dst[x] += src[x] * wy[y] * wx[x];
+                }
+            }
+        }
+    }
+    for (size_t p = 0; p < plane; ++p) {
+        const float inv = 1.f / b.tile_weight[p];
+        for (size_t c = 0; c < 3; ++c) b.image[c * plane + p] *= inv;
+    }
+}
+
+void ONNXRunner::vae_input(Buffers &b, const FrameJob &job) {
+    const size_t n = b.vae_in.size();
+    for (size_t i = 0; i < n; ++i) b.vae_in[i] = job.latents[i] / kVaeScale;
+    to_model(b.vae_latent);
+}
+
+void ONNXRunner::decode(Buffers &b, const FrameJob &job, uint8_t *rgba) {
+    run_vae(b, job);
+
+    // NCHW [-1,1] -> interleaved RGBA8
+    const size_t plane = static_cast<size_t>(b.width) * static_cast<size_t>(b.height);
+    const float *r = b.image.data();
+    const float *g = r + plane;
+    const float *bl = g + plane;
+    auto to_u8 = [](float v) {
+        float x = (v * 0.5f + 0.5f) * 255.f + 0.5f;
+        return static_cast<uint8_t>(std::clamp(x, 0.f, 255.f));
+    };
+    for (size_t p = 0; p < plane; ++p) {
+        rgba[p * 4 + 0] = to_u8(r[p]);
+        rgba[p * 4 + 1] = to_u8(g[p]);
+        rgba[p * 4 + 2] = to_u8(bl[p]);
+        rgba[p * 4 + 3] = 255;
+    }
+}
+
+// Decoder output handed over as-is; the [-1,1] -> RGBA8 conversion runs on the GPU
+void ONNXRunner::decode_planar(Buffers &b, FrameJob &job) {
+    run_vae(b, job);
+    job.planar.assign(b.image.begin(), b.image.end());
+}
+
+// Same decoder run, but the output is bound to the caller's CUDA buffer, so
+// the image never comes back to the host. IoBinding keeps the device tensor
+// only for this run; the host binding is restored for the next job.
+void ONNXRunner::decode_to_device(Buffers &b, const FrameJob &job) {
+    TraceScope span("vae_decode");
+    vae_input(b, job);
+
+    Ort::MemoryInfo cuda_mem("Cuda", OrtDeviceAllocator, cfg_.device_id, OrtMemTypeDefault);
+    const int64_t image_shape[] = {1, 3, b.height, b.width};
+    Ort::Value out = Ort::Value::CreateTensor(cuda_mem, job.device_image, device_image_bytes(b.width, b.height),
+                                              image_shape, 4, io_.vae_image_type);
+    b.vae->BindOutput(io_.vae_image.c_str(), out);
+    try {
+        session_vae_->Run(run_opts_, *b.vae);
+    } catch (...) {
+        b.vae->BindOutput(io_.vae_image.c_str(), b.vae_image.value);
+        throw;
+    }
+    b.vae->BindOutput(io_.vae_image.c_str(), b.vae_image.value);
+}
+
+bool ONNXRunner::supports_device_image() const {
+#ifdef USE_CUDA
+    return ready() && (cfg_.provider == ExecutionProvider::CUDA || cfg_.provider == ExecutionProvider::TensorRT);
+#else
+    return false;
+#endif
+}
+
+size_t ONNXRunner::device_image_bytes(int width, int height) const {
+    return 3 * static_cast<size_t>(width) * static_cast<size_t>(height) * element_size(io_.vae_image_type);
+}
+
+bool ONNXRunner::prepare(int width, int height, size_t max_batch) {
+    if (width % 8 != 0 || height % 8 != 0 || width <= 0 || height <= 0) {
+        std::cerr << "ONNXRunner: width/height must be positive multiples of 8" << std::endl;
+        return false;
+    }
+    if (!ready()) return true;
+    try {
+        Buffers &b = buffers_for(width, height, std::min(max_batch, this->max_batch()));
+        for (auto &lane : b.lane_latents) lane.clear();
+        denoise_jobs_.reserve(b.max_jobs);
+    } catch (const std::exception &e) {
+        std::cerr << "ONNX buffer setup error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ONNXRunner::run_encode(FrameJob &job) {
+    if (!job.ok || !ready()) return job.ok;
+    Buffers *b = prepared(job);
+    if (!b || job.steps < 1) {
+        if (b) std::cerr << "ONNXRunner: steps must be >= 1" << std::endl;
+        return job.ok = false;
+    }
+    const bool cfg = job.guidance_scale > 1.f;
+    if (job.prompt == job.encoded_prompt && !job.cond_hidden.empty() && (!cfg || job.encoded_uncond)) return true;
+    job.encoded_prompt.clear();
+    job.encoded_uncond = false;
+    try {
+        encode_prompt(*b, job.prompt, true, job.cond_hidden);
+        if (cfg) encode_prompt(*b, "", false, job.uncond_hidden);
+    } catch (const std::exception &e) {
+        std::cerr << "ONNX text_encoder error: " << e.what() << std::endl;
+        return job.ok = false;
+    }
+    job.encoded_prompt = job.prompt;
+    job.encoded_uncond = cfg;
+    return true;
+}
+
+bool ONNXRunner::run_denoise(FrameJob &job) {
+    FrameJob *jobs[] = {&job};
+    return run_denoise_batch(jobs, 1);
+}
+
+bool ONNXRunner::run_denoise_batch(FrameJob *const *jobs, size_t count) {
+    bool all_ok = true;
+    std::vector<FrameJob*> &batch = denoise_jobs_;
+    batch.clear();
+    for (size_t i = 0; i < count; ++i) {
+        FrameJob &job = *jobs[i];
+        if (job.ok && ready() && !prepared(job)) job.ok = false;
+        if (!job.ok) all_ok = false;
+        else if (ready()) batch.push_back(&job);
+    }
+
+    // Consecutive jobs that can step together share one UNet batch
+    auto same_batch = [](const FrameJob &a, const FrameJob &b) {
+        return a.steps == b.steps && a.strength == b.strength && (a.guidance_scale > 1.f) == (b.guidance_scale > 1.f);
+    };
+    size_t begin = 0;
+    while (begin < batch.size()) {
+        size_t end = begin + 1;
+        while (end < batch.size() && end - begin < buffers_->max_jobs && same_batch(*batch[begin], *batch[end])) ++end;
+        try {
+            denoise(*buffers_, batch.data() + begin, end - begin);
+        } catch (const std::exception &e) {
+            std::cerr << "ONNX unet error: " << e.what() << std::endl;
+            for (size_t i = begin; i < end; ++i) batch[i]->ok = false;
+            all_ok = false;
+        }
+        begin = end;
+    }
+    return all_ok;
+}
+
+bool ONNXRunner::run_decode(FrameJob &job) {
+    if (!job.ok) return false;
+    job.image_on_device = false;
+    job.planar.clear();
+    if (!ready()) {
+        job.rgba = make_test_image(job.width, job.height, job.prompt);
+        return true;
+    }
+    Buffers *b = prepared(job);
+    if (!b) return job.ok = false;
+    try {
+        // Tiles are blended on the host, so a tiled frame is never decoded to the device
+        job.image_on_device = job.device_image && supports_device_image() && b->tile_h == 0;
+        if (job.image_on_device) {
+            decode_to_device(*b, job);
+        } else if (job.planar_output) {
+            decode_planar(*b, job);
+        } else {
+            job.rgba.resize(static_cast<size_t>(job.width) * static_cast<size_t>(job.height) * 4);
+            decode(*b, job, job.rgba.data());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "ONNX vae_decoder error: " << e.what() << std::endl;
+        return job.ok = false;
+    }
+    return true;
+}
+
+void ONNXRunner::warmup(int width, int height, int steps) {
+    auto t0 = std::chrono::steady_clock::now();
+    generate_image_rgba("", width, height, steps);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "ONNXRunner warm-up " << width << "x" << height << " took " << ms << " ms"
+              << (ready() ? "" : " (fallback mode, models not loaded)") << std::endl;
+}
+
+std::vector<uint8_t> ONNXRunner::generate_image_rgba(const std::string &prompt, int width, int height, int steps, int seed,
+                                                     float guidance_scale) {
+    if (!ready()) {
+        return make_test_image(width, height, prompt);
+    }
+
+    // text_encoder -> embeddings, diffusion loop (unet) -> latents, vae decode -> image
+    FrameJob job;
+    job.prompt = prompt;
+    job.width = width;
+    job.height = height;
+    job.steps = steps;
+    job.seed = seed;
+    job.guidance_scale = guidance_scale;
+    if (!prepare(width, height) || !run_encode(job) || !run_denoise(job) || !run_decode(job)) return {};
+    return std::move(job.rgba);
+}
+
+std::vector<uint8_t> ONNXRunner::make_test_image(int w, int h, const std::string &seed_text) {
+    std::vector<uint8_t> img(static_cast<size_t>(w) * static_cast<size_t>(h) * 4);
+    // Gradient + text hash color
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char c : seed_text) hash = (hash ^ c) * 1099511628211ull;
+    uint8_t r = static_cast<uint8_t>((hash >> 0) & 0xFF);
+    uint8_t g = static_cast<uint8_t>((hash >> 8) & 0xFF);
+    uint8_t b = static_cast<uint8_t>((hash >> 16) & 0xFF);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            size_t i = (static_cast<size_t>(y) * static_cast<size_t>(w) + static_cast<size_t>(x)) * 4;
+            img[i+0] = static_cast<uint8_t>(((x * 255) / std::max(1, w-1)) ^ r); // R
+            img[i+1] = static_cast<uint8_t>(((y * 255) / std::max(1, h-1)) ^ g); // G
+            img[i+2] = static_cast<uint8_t>(((((x+y)/2) * 255) / std::max(1, (w+h)/2-1)) ^ b); // B
+            img[i+3] = 255;
+        }
+    }
+    return img;
+}
@@ -0,0 +1,265 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "ClipTokenizer.hpp"
+#include "EmbeddingCache.hpp"
+#include "ModelLoader.hpp"
+#include "RunnerConfig.hpp"
+#include "Scheduler.hpp"
+
+// ------------------------- Frame job ----------------------------------------
+// State of one frame as it moves through the pipeline stages. Each stage only
+// reads what the previous one produced, so consecutive frames can be in
+// different stages at the same time.
+struct FrameJob {
+    uint64_t index = 0;
+    std::string prompt;
+    int width = 512, height = 512;
+    int steps = 28;
+    int seed = 1337;
+    float guidance_scale = 7.5f;
+    // Below 1: img2img streaming. The frame starts from the previous frame's
+    // latents, re-noised to the sigma of step steps * (1 - strength), and
+    // only runs the last steps * strength steps of the schedule.
+    float strength = 1.f;
+    // img2img stream: the frame continues the last result denoised on this
+    // lane, wherever the job sits in its batch
+    size_t lane = 0;
+    int interpolate = 0; // in-betweens to synthesize before this frame, when interpolation is on
+    std::chrono::steady_clock::time_point submitted;
+    bool ok = true;
+
+    std::vector<float> cond_hidden, uncond_hidden; // encode  -> denoise
+    // Prompt the hidden states above belong to; jobs are recycled, so a job
+    // that comes round with the same prompt skips the text encoder entirely
+    std::string encoded_prompt;
+    bool encoded_uncond = false;
+    std::vector<float> latents;                    // denoise -> decode
+    std::vector<uint8_t> rgba;                     // decode  -> upload / write
+    // Frames interpolated between the previous keyframe and this one, in
+    // display order (upload -> write); written before rgba
+    std::vector<std::vector<uint8_t>> inbetween;
+
+    // GPU interop: when set and supported, run_decode writes the decoder output
+    // (NCHW [-1,1], see ONNXRunner::device_image_bytes) to this CUDA address
+    // and sets image_on_device instead of filling rgba.
+    void *device_image = nullptr;
+    bool image_on_device = false;
+
+    // GPU conversion: when set, run_decode leaves the decoder output as NCHW
+    // floats in `planar` (for Renderer::uploadImageNCHW) instead of rgba.
+    bool planar_output = false;
+    std::vector<float> planar;
+    size_t slot = 0; // position in the owner's job pool, to find per-job resources
+};
+
+// ------------------------- ONNX Runner --------------------------------------
+// Owns the text_encoder / unet / vae_decoder sessions for the whole lifetime of
+// the application. Build it once at startup, call warmup() with the target
+// resolution, and then call generate_image_rgba() once per frame.
+class ONNXRunner {
+public:
+    // tokenizer_json defaults to <onnx_dir>/tokenizer.json
+    explicit ONNXRunner(const std::string &onnx_dir, const ProviderConfig &cfg = {}, const std::string &tokenizer_json = "");
+    ~ONNXRunner();
+
+    ONNXRunner(const ONNXRunner&) = delete;
+    ONNXRunner& operator=(const ONNXRunner&) = delete;
+
+    // True when all three sessions were loaded and expose the expected
+    // inputs/outputs; otherwise the runner only produces test images.
+    bool ready() const { return session_text_ && session_unet_ && session_vae_ && io_ok_; }
+
+    // Provider actually in use (falls back to CPU when the requested one is missing)
+    ExecutionProvider provider() const { return cfg_.provider; }
+
+    // Runs one dummy generation at the target resolution so that lazy EP
+    // initialization and the per-resolution buffers are set up before the first frame.
+    void warmup(int width, int height, int steps = 1);
+
+    // Gera uma imagem RGBA width*height*4 bytes. Se modelos não estiverem prontos, gera padrão.
+    std::vector<uint8_t> generate_image_rgba(const std::string &prompt, int width, int height, int steps = 28, int seed = 1337,
+                                             float guidance_scale = 7.5f);
+
+    // Stage API used by FramePipeline. prepare() allocates the buffers for one
+    // resolution and must be called before the stages run concurrently. After
+    // that run_encode, run_denoise and run_decode may each be called from their
+    // own thread (one thread per stage): they touch disjoint buffers. Each
+    // returns false and clears job.ok on failure; later stages skip such jobs.
+    // prepare() also starts a new sequence: the first streaming frame
+    // (strength < 1) of every lane after it denoises from noise, since it has
+    // no predecessor.
+    // max_batch is the most jobs run_denoise_batch() will be given.
+    bool prepare(int width, int height, size_t max_batch = 1);
+    bool run_encode(FrameJob &job);
+    bool run_denoise(FrameJob &job);
+    bool run_decode(FrameJob &job);
+
+    // Denoises several jobs as one UNet batch, cond and uncond included. The
+    // jobs must match the prepared resolution; runs of jobs with the same
+    // steps, strength and CFG on/off share a batch, others are split off.
+    // With strength < 1, each job continues from the last result of its
+    // FrameJob::lane; failed jobs leave their lane as it was.
+    bool run_denoise_batch(FrameJob *const *jobs, size_t count);
+
+    // Largest batch prepare() accepts: 1 unless the UNet has a dynamic batch
+    // axis (and CUDA graphs, which need fixed shapes, are off)
+    static constexpr size_t kMaxBatch = 16;
+    size_t max_batch() const { return unet_batched_ ? kMaxBatch : 1; }
+
+    // True when run_decode can write straight into CUDA memory (FrameJob::device_image):
+    // needs a USE_CUDA build with the CUDA or TensorRT provider.
+    bool supports_device_image() const;
+    size_t device_image_bytes(int width, int height) const;
+    bool device_image_fp16() const { return io_.vae_image_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16; }
+    int device_id() const { return cfg_.device_id; }
+
+    // Sampler used by run_denoise (Euler by default). Call before prepare(),
+    // not while the pipeline is running.
+    void set_scheduler(SchedulerKind kind);
+    SchedulerKind scheduler() const { return scheduler_->kind(); }
+
+    // Text-encoder output cache (memory cap, hit/miss counters)
+    EmbeddingCache &embedding_cache() { return embed_cache_; }
+    const EmbeddingCache &embedding_cache() const { return embed_cache_; }
+
+private:
+    // Input/output names and element types read from the loaded sessions.
+    struct ModelIO {
+        std::string text_ids, text_hidden;
+        std::string unet_sample, unet_timestep, unet_hidden, unet_out;
+        std::string vae_latent, vae_image;
+        ONNXTensorElementDataType text_ids_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
+        ONNXTensorElementDataType text_hidden_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        ONNXTensorElementDataType unet_sample_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        ONNXTensorElementDataType timestep_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+        ONNXTensorElementDataType unet_hidden_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        ONNXTensorElementDataType unet_out_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        ONNXTensorElementDataType vae_latent_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        ONNXTensorElementDataType vae_image_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        bool timestep_scalar = false;
+        bool batch_dynamic = false;    // UNet sample has a free batch axis
+        bool timestep_batched = false; // timestep is [batch] rather than [1] / scalar
+        bool vae_dynamic = false;      // decoder accepts any latent height / width (needed for tiles)
+        int64_t max_tokens = 77;
+        int64_t hidden_dim = 768;
+    };
+
+    // One bound tensor. The pipeline always works on `host` (float or int64);
+    // when the model expects another element type (fp16, int32) `stage` holds the
+    // converted copy, and with CUDA graphs `device` is the fixed device address
+    // the captured graph reads or writes.
+    struct Slot {
+        ONNXTensorElementDataType host_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        void *host = nullptr;
+        size_t count = 0;
+        ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        std::vector<uint8_t> stage;
+        void *device = nullptr;
+        Ort::Value value{nullptr};
+    };
+
+    // Every tensor the pipeline touches, allocated once per resolution and
+    // batch capacity and bound to the sessions through IoBinding. The
+    // denoising loop only writes into these buffers.
+    //
+    // UNet tensors are laid out as one batch: [cond_0 .. cond_N-1, uncond_0 ..
+    // uncond_N-1] for N jobs. With a dynamic batch axis they go through one
+    // `unet` run; otherwise (fixed batch 1, CUDA graphs) `unet_cond` and
+    // `unet_uncond` run the two halves of a single job separately.
+    struct Buffers {
+        int width = 0, height = 0;
+        int64_t latent_h = 0, latent_w = 0;
+        size_t max_jobs = 1;
+
+        std::vector<int64_t> cond_ids, uncond_ids;
+        std::vector<float> enc_cond, enc_uncond; // text_encoder outputs
+        std::vector<float> hidden;       // UNet encoder_hidden_states
+        std::vector<float> latents;      // x_t per job, updated in place by the scheduler
+        std::vector<std::vector<float>> lane_latents; // last result per stream lane, empty = none (img2img seeds)
+        std::vector<float> model_in;     // scaled x_t fed to the UNet
+        std::vector<float> noise;        // UNet output, guided eps in the cond half
+        std::vector<float> vae_in;       // latents / vae scale factor
+        std::vector<float> image;        // NCHW [-1,1] decoder output (whole frame, also when tiled)
+        std::vector<float> timestep;     // one per batch entry
+        std::vector<std::mt19937> rngs;  // one per job
+        size_t unet_batch = 0;           // batch the `unet` binding is currently shaped for
+
+        Slot ids_cond, ids_uncond, text_cond_out, text_uncond_out;
+        Slot sample, timestep_in, hidden_in, unet_out;                       // batched
+        Slot hidden_cond, hidden_uncond, unet_cond_out, unet_uncond_out;     // one job
+        Slot vae_latent, vae_image;
+
+        // Tiled decode (tile_h > 0): the decoder runs on tile_h x tile_w latent
+        // tiles at the origins below, each blended into `image` with weights
+        // that ramp down over the `overlap` latent pixels shared with a neighbour
+        int64_t tile_h = 0, tile_w = 0, overlap = 0;
+        std::vector<int64_t> tile_ys, tile_xs;
+        std::vector<float> tile_in, tile_out;
+        std::vector<float> tile_weight; // per-pixel sum of blend weights
+        Slot tile_latent, tile_image;
+
+        Ort::Allocator *device_alloc = nullptr; // owns Slot::device memory
+        std::vector<void*> pinned;              // page-locked host ranges, unregistered on destruction
+        std::unique_ptr<Ort::IoBinding> text_cond, text_uncond;
+        std::unique_ptr<Ort::IoBinding> unet, unet_cond, unet_uncond;
+        std::unique_ptr<Ort::IoBinding> vae, vae_tile;
+
+        ~Buffers();
+    };
+
+    Ort::Env env_;
+    ModelLoader loader_; // mapped weights, declared before the sessions that use them
+    std::unique_ptr<Ort::Session> session_text_;
+    std::unique_ptr<Ort::Session> session_unet_;
+    std::unique_ptr<Ort::Session> session_vae_;
+    std::string onnx_dir_;
+    ProviderConfig cfg_;
+
+    Ort::MemoryInfo cpu_mem_;
+    Ort::RunOptions run_opts_;
+    Ort::RunOptions unet_cond_opts_, unet_uncond_opts_; // separate CUDA graph ids per binding
+    std::unique_ptr<Ort::MemoryInfo> device_mem_;
+    std::unique_ptr<Ort::Allocator> device_alloc_;
+    ModelIO io_;
+    bool io_ok_ = false;
+    bool env_allocators_ = false; // sessions share the arenas registered on env_
+    bool unet_batched_ = false; // cond/uncond (and several jobs) in one UNet run
+    std::unique_ptr<Buffers> buffers_;
+    std::vector<FrameJob*> denoise_jobs_; // run_denoise_batch scratch, reserved in prepare()
+    std::unique_ptr<Scheduler> scheduler_;
+    ClipTokenizer tokenizer_;
+    EmbeddingCache embed_cache_;
+
+    bool inspect_models();
+    void register_env_allocators();
+    void setup_device_io();
+    void pin_host_buffers(Buffers &b);
+    Buffers &buffers_for(int width, int height, size_t max_jobs);
+    void bind_unet_batch(Buffers &b, size_t batch);
+    Buffers *prepared(const FrameJob &job);
+    void bind_slot(Buffers &b, Slot &s, void *host, ONNXTensorElementDataType host_type, size_t count,
+                   ONNXTensorElementDataType type, const int64_t *shape, size_t rank, bool on_device);
+
+    void encode_prompt(Buffers &b, const std::string &prompt, bool cond, std::vector<float> &hidden);
+    void denoise(Buffers &b, FrameJob *const *jobs, size_t count);
+    void choose_vae_tiles(Buffers &b) const;
+    void run_vae(Buffers &b, const FrameJob &job);
+    void decode_tiled(Buffers &b, const FrameJob &job);
+    void vae_input(Buffers &b, const FrameJob &job);
+    void decode(Buffers &b, const FrameJob &job, uint8_t *rgba);
+    void decode_planar(Buffers &b, FrameJob &job);
+    void decode_to_device(Buffers &b, const FrameJob &job);
+
+    static void to_model(Slot &s);
+    static void from_model(Slot &s);
+
+    std::vector<uint8_t> make_test_image(int w, int h, const std::string &seed_text);
+};
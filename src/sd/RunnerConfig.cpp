@@ -0,0 +1,194 @@
+#include "RunnerConfig.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+bool parse_bool(const std::string &v, bool &out) {
+    std::string l = lowercase(v);
+    if (l == "1" || l == "true" || l == "on" || l == "yes") { out = true; return true; }
+    if (l == "0" || l == "false" || l == "off" || l == "no") { out = false; return true; }
+    return false;
+}
+
+bool parse_int(const std::string &v, int &out) {
+    try {
+        size_t pos = 0;
+        out = std::stoi(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+bool has_provider(const char *ort_name) {
+    auto providers = Ort::GetAvailableProviders();
+    return std::find(providers.begin(), providers.end(), ort_name) != providers.end();
+}
+
+} // namespace
+
+const char *provider_name(ExecutionProvider p) {
+    switch (p) {
+        case ExecutionProvider::CUDA: return "cuda";
+        case ExecutionProvider::TensorRT: return "tensorrt";
+        case ExecutionProvider::DirectML: return "directml";
+        case ExecutionProvider::CPU: break;
+    }
+    return "cpu";
+}
+
+bool parse_provider(const std::string &name, ExecutionProvider &out) {
+    std::string l = lowercase(name);
+    if (l == "cpu") out = ExecutionProvider::CPU;
+    else if (l == "cuda") out = ExecutionProvider::CUDA;
+    else if (l == "tensorrt" || l == "trt") out = ExecutionProvider::TensorRT;
+    else if (l == "directml" || l == "dml") out = ExecutionProvider::DirectML;
+    else return false;
+    return true;
+}
+
+bool apply_provider_option(ProviderConfig &cfg, const std::string &key, const std::string &value) {
+    if (key == "provider") return parse_provider(value, cfg.provider);
+    if (key == "device") return parse_int(value, cfg.device_id);
+    if (key == "threads") return parse_int(value, cfg.intra_op_threads);
+    if (key == "inter_threads") return parse_int(value, cfg.inter_op_threads);
+    if (key == "fp16") return parse_bool(value, cfg.fp16);
+    if (key == "cuda_graph") return parse_bool(value, cfg.cuda_graph);
+    if (key == "trt_cache") { cfg.trt_cache_dir = value; return true; }
+    if (key == "cache") { cfg.cache_dir = value; return true; }
+    if (key == "model_cache") return parse_bool(value, cfg.model_cache);
+    if (key == "mmap") return parse_bool(value, cfg.mmap_models);
+    if (key == "arena") return parse_bool(value, cfg.shared_arena);
+    if (key == "arena_max_mb") return parse_int(value, cfg.arena_max_mb) && cfg.arena_max_mb >= 0;
+    if (key == "arena_initial_mb") return parse_int(value, cfg.arena_initial_mb) && cfg.arena_initial_mb >= 0;
+    if (key == "arena_extend") {
+        std::string l = lowercase(value);
+        if (l == "power") cfg.arena_exact = false;
+        else if (l == "exact") cfg.arena_exact = true;
+        else return false;
+        return true;
+    }
+    if (key == "pinned") return parse_bool(value, cfg.pinned_io);
+    if (key == "vae_tiling") {
+        bool on = false;
+        if (lowercase(value) == "auto") cfg.vae_tiling = -1;
+        else if (parse_bool(value, on)) cfg.vae_tiling = on ? 1 : 0;
+        else return false;
+        return true;
+    }
+    if (key == "vae_budget_mb") return parse_int(value, cfg.vae_budget_mb) && cfg.vae_budget_mb > 0;
+    if (key == "vae_tile") return parse_int(value, cfg.vae_tile) && cfg.vae_tile >= 0;
+    if (key == "vae_overlap") return parse_int(value, cfg.vae_overlap) && cfg.vae_overlap >= 0;
+    if (key == "ort_profile") { cfg.ort_profile = value; return true; }
+    if (key == "opt") {
+        std::string l = lowercase(value);
+        if (l == "disable") cfg.graph_opt = GraphOptimizationLevel::ORT_DISABLE_ALL;
+        else if (l == "basic") cfg.graph_opt = GraphOptimizationLevel::ORT_ENABLE_BASIC;
+        else if (l == "extended") cfg.graph_opt = GraphOptimizationLevel::ORT_ENABLE_EXTENDED;
+        else if (l == "all") cfg.graph_opt = GraphOptimizationLevel::ORT_ENABLE_ALL;
+        else return false;
+        return true;
+    }
+    return false;
+}
+
+bool load_provider_config(const std::string &path, ProviderConfig &cfg) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Cannot open provider config " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    bool ok = true;
+    while (std::getline(f, line)) {
+        ++lineno;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos || !apply_provider_option(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+            std::cerr << path << ":" << lineno << ": invalid option '" << line << "'" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool configure_session_options(Ort::SessionOptions &opts, const ProviderConfig &cfg,
+                               const std::string &trt_cache_dir, bool cuda_graph) {
+    opts.SetIntraOpNumThreads(cfg.intra_op_threads);
+    opts.SetInterOpNumThreads(cfg.inter_op_threads);
+    opts.SetGraphOptimizationLevel(cfg.graph_opt);
+
+    const std::string device = std::to_string(cfg.device_id);
+    try {
+        switch (cfg.provider) {
+            case ExecutionProvider::CPU:
+                return true;
+
+            case ExecutionProvider::TensorRT: {
+                if (!has_provider("TensorrtExecutionProvider")) return false;
+                Ort::TensorRTProviderOptions trt;
+                trt.Update({
+                    {"device_id", device},
+                    {"trt_fp16_enable", cfg.fp16 ? "1" : "0"},
+                    {"trt_engine_cache_enable", "1"},
+                    {"trt_engine_cache_path", trt_cache_dir},
+                    {"trt_timing_cache_enable", "1"},
+                    {"trt_timing_cache_path", trt_cache_dir},
+                    {"trt_cuda_graph_enable", cuda_graph ? "1" : "0"},
+                });
+                opts.AppendExecutionProvider_TensorRT_V2(*trt);
+                // Nodes TensorRT rejects fall back to CUDA, not CPU
+                if (has_provider("CUDAExecutionProvider")) {
+                    Ort::CUDAProviderOptions cuda;
+                    cuda.Update({{"device_id", device}});
+                    opts.AppendExecutionProvider_CUDA_V2(*cuda);
+                }
+                return true;
+            }
+
+            case ExecutionProvider::CUDA: {
+                if (!has_provider("CUDAExecutionProvider")) return false;
+                Ort::CUDAProviderOptions cuda;
+                cuda.Update({
+                    {"device_id", device},
+                    {"cudnn_conv_algo_search", "EXHAUSTIVE"},
+                    {"do_copy_in_default_stream", "1"},
+                    {"enable_cuda_graph", cuda_graph ? "1" : "0"},
+                });
+                opts.AppendExecutionProvider_CUDA_V2(*cuda);
+                return true;
+            }
+
+            case ExecutionProvider::DirectML: {
+                if (!has_provider("DmlExecutionProvider")) return false;
+                // DirectML does not support memory patterns or parallel execution
+                opts.DisableMemPattern();
+                opts.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+                opts.AppendExecutionProvider("DML", {{"device_id", device}});
+                return true;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to enable " << provider_name(cfg.provider) << " provider: " << e.what() << std::endl;
+    }
+    return false;
+}
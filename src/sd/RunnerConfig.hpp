@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include <onnxruntime_cxx_api.h>
+
+// ------------------------- Execution provider config -------------------------
+// Runtime selection of the ORT execution provider and session tuning. Filled
+// from the command line (--key=value) or a config file with key=value lines.
+//
+// Keys: provider (cpu|cuda|tensorrt|directml), device, threads, inter_threads,
+//       opt (disable|basic|extended|all), fp16 (0|1), cuda_graph (0|1), trt_cache,
+//       cache (artifact dir), model_cache (0|1), mmap (0|1), arena (0|1), arena_max_mb,
+//       arena_initial_mb, arena_extend (power|exact), pinned (0|1), vae_tiling (auto|on|off),
+//       vae_budget_mb, vae_tile, vae_overlap, ort_profile (output prefix)
+enum class ExecutionProvider { CPU, CUDA, TensorRT, DirectML };
+
+struct ProviderConfig {
+    ExecutionProvider provider = ExecutionProvider::CPU;
+    int device_id = 0;
+    int intra_op_threads = 4;  // 0 = let ORT decide
+    int inter_op_threads = 1;
+    GraphOptimizationLevel graph_opt = GraphOptimizationLevel::ORT_ENABLE_ALL;
+    bool fp16 = false;         // prefer <name>_fp16.onnx models and fp16 TensorRT kernels
+    bool cuda_graph = false;   // capture the fixed-shape UNet loop (CUDA/TensorRT)
+    std::string trt_cache_dir; // empty = <cache>/trt_<w>x<h>
+    std::string cache_dir;     // optimized models / EP contexts, empty = <models>/.cache
+    bool model_cache = true;
+    bool mmap_models = true;   // build sessions from mapped model / external-data files (see ModelLoader.hpp)
+    // One env-level arena shared by the three sessions (plus one on the GPU for
+    // CUDA / TensorRT) instead of an arena per session, so peak memory is one
+    // high-water mark rather than the sum of three
+    bool shared_arena = true;
+    int arena_max_mb = 0;      // cap of each shared arena, 0 = unlimited
+    int arena_initial_mb = 0;  // first chunk, 0 = ORT default; size it to the steady-state footprint
+    bool arena_exact = true;   // grow by the requested size instead of the next power of two
+    bool pinned_io = true;     // page-lock the host I/O buffers (USE_CUDA builds, CUDA / TensorRT)
+    // Tiled VAE decode: overlapping latent tiles blended into the frame, so
+    // large outputs decode within a fixed activation budget. -1 = auto (tile
+    // only when a whole-frame decode would exceed vae_budget_mb), 0 = off, 1 = on
+    int vae_tiling = -1;
+    int vae_budget_mb = 2048;
+    int vae_tile = 0;          // latent pixels per tile side, 0 = largest that fits the budget
+    int vae_overlap = 8;       // latent pixels shared by neighbouring tiles (x8 image pixels)
+    // ORT's built-in profiler: one Chrome trace JSON per session, named
+    // <prefix>_<model>_dev<device>_<timestamp>.json. Empty = off.
+    std::string ort_profile;
+    int shape_width = 512;     // target resolution, part of the TensorRT cache key
+    int shape_height = 512;
+};
+
+const char *provider_name(ExecutionProvider p);
+bool parse_provider(const std::string &name, ExecutionProvider &out);
+
+// Applies one key=value option; returns false for unknown keys or bad values.
+bool apply_provider_option(ProviderConfig &cfg, const std::string &key, const std::string &value);
+
+// Reads key=value lines, '#' starts a comment.
+bool load_provider_config(const std::string &path, ProviderConfig &cfg);
+
+// Sets threads/optimization level and appends the configured EP to opts.
+// cuda_graph enables graph capture for this session only (the UNet).
+// Returns false when the provider is not available in the loaded ORT build.
+bool configure_session_options(Ort::SessionOptions &opts, const ProviderConfig &cfg,
+                               const std::string &trt_cache_dir, bool cuda_graph);
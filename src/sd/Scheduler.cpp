@@ -0,0 +1,240 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Stable Diffusion training schedule (scaled_linear betas)
+constexpr int kTrainSteps = 1000;
+constexpr double kBetaStart = 0.00085;
+constexpr double kBetaEnd = 0.012;
+
+// LCM distillation: 50 original inference steps, boundary condition constants
+constexpr int kLcmOriginalSteps = 50;
+constexpr double kLcmTimestepScaling = 10.0;
+constexpr double kLcmSigmaData = 0.5;
+
+class EulerScheduler : public Scheduler {
+public:
+    EulerScheduler() : Scheduler(SchedulerKind::Euler) {}
+
+    void step(int k, size_t, const float *eps, float *x, size_t n, std::mt19937 &) override {
+        const float dt = dt_[k];
+        for (size_t i = 0; i < n; ++i) x[i] += eps[i] * dt;
+    }
+
+private:
+    std::vector<float> dt_;
+
+    void build_coefficients() override {
+        dt_.resize(steps());
+        for (int k = 0; k < steps(); ++k) dt_[k] = sigmas_[k + 1] - sigmas_[k];
+    }
+};
+
+// Each step goes down to sigma_down deterministically and adds fresh noise
+// of sigma_up, with sigma_down^2 + sigma_up^2 = sigma_next^2.
+class EulerAncestralScheduler : public Scheduler {
+public:
+    EulerAncestralScheduler() : Scheduler(SchedulerKind::EulerAncestral) {}
+
+    void step(int k, size_t, const float *eps, float *x, size_t n, std::mt19937 &rng) override {
+        const float dt = dt_[k], up = up_[k];
+        if (up > 0.f) {
+            std::normal_distribution<float> normal(0.f, 1.f);
+            for (size_t i = 0; i < n; ++i) x[i] += eps[i] * dt + normal(rng) * up;
+        } else {
+            for (size_t i = 0; i < n; ++i) x[i] += eps[i] * dt;
+        }
+    }
+
+private:
+    std::vector<float> dt_, up_;
+
+    void build_coefficients() override {
+        dt_.resize(steps());
+        up_.resize(steps());
+        for (int k = 0; k < steps(); ++k) {
+            const double s = sigmas_[k], sn = sigmas_[k + 1];
+            const double up = sn > 0.0 ? std::sqrt(std::max(sn * sn * (s * s - sn * sn) / (s * s), 0.0)) : 0.0;
+            const double down = std::sqrt(std::max(sn * sn - up * up, 0.0));
+            dt_[k] = static_cast<float>(down - s);
+            up_[k] = static_cast<float>(up);
+        }
+    }
+};
+
+// DPM-Solver++(2M): works on the denoised prediction D = x - sigma * eps in
+// log-sigma time. The first step of a frame and the final step to sigma 0
+// are first order; the others extrapolate D from the previous step.
+class DpmSolverPPScheduler : public Scheduler {
+public:
+    DpmSolverPPScheduler() : Scheduler(SchedulerKind::DpmSolverPP) {}
+
+    void begin(size_t n, size_t lanes) override {
+        if (prev_.size() != n * lanes) prev_.assign(n * lanes, 0.f);
+        has_prev_.assign(lanes, 0);
+    }
+
+    void step(int k, size_t lane, const float *eps, float *x, size_t n, std::mt19937 &) override {
+        const float sigma = sigmas_[k], ratio = ratio_[k], coef = coef_[k];
+        const bool second_order = has_prev_[lane] && sigmas_[k + 1] > 0.f;
+        const float w_cur = second_order ? w_cur_[k] : 1.f, w_prev = second_order ? w_prev_[k] : 0.f;
+        float *prev = prev_.data() + lane * n;
+        for (size_t i = 0; i < n; ++i) {
+            const float d = x[i] - sigma * eps[i];
+            x[i] = ratio * x[i] + coef * (w_cur * d + w_prev * prev[i]);
+            prev[i] = d;
+        }
+        has_prev_[lane] = 1;
+    }
+
+private:
+    std::vector<float> ratio_, coef_, w_cur_, w_prev_;
+    std::vector<float> prev_;          // last denoised prediction, per lane
+    std::vector<uint8_t> has_prev_;
+
+    void build_coefficients() override {
+        const int n = steps();
+        ratio_.assign(n, 0.f);
+        coef_.assign(n, 1.f);
+        w_cur_.assign(n, 1.f);
+        w_prev_.assign(n, 0.f);
+        for (int k = 0; k < n; ++k) {
+            const double s = sigmas_[k], sn = sigmas_[k + 1];
+            if (sn <= 0.0) continue; // x = D
+            const double h = std::log(s / sn);
+            ratio_[k] = static_cast<float>(sn / s);
+            coef_[k] = static_cast<float>(-std::expm1(-h));
+            if (k > 0) {
+                const double r = std::log(sigmas_[k - 1] / s) / h;
+                w_cur_[k] = static_cast<float>(1.0 + 1.0 / (2.0 * r));
+                w_prev_[k] = static_cast<float>(-1.0 / (2.0 * r));
+            }
+        }
+    }
+};
+
+// Each step predicts the clean latent with the consistency boundary
+// conditions, then (except on the last step) re-noises it to the next sigma.
+class LcmScheduler : public Scheduler {
+public:
+    LcmScheduler() : Scheduler(SchedulerKind::Lcm) {}
+
+    void step(int k, size_t, const float *eps, float *x, size_t n, std::mt19937 &rng) override {
+        const float sigma = sigmas_[k], c_out = c_out_[k], c_skip = c_skip_[k] * in_scale_[k];
+        const float next = sigmas_[k + 1];
+        std::normal_distribution<float> normal(0.f, 1.f);
+        for (size_t i = 0; i < n; ++i) {
+            const float denoised = c_out * (x[i] - sigma * eps[i]) + c_skip * x[i];
+            x[i] = next > 0.f ? denoised + normal(rng) * next : denoised;
+        }
+    }
+
+private:
+    std::vector<float> c_skip_, c_out_;
+
+    // Timesteps come from the distillation grid (19, 39, ..., 999)
+    void build_schedule(int steps) override {
+        if (steps > kLcmOriginalSteps) {
+            Scheduler::build_schedule(steps);
+            return;
+        }
+        const int stride = kTrainSteps / kLcmOriginalSteps;
+        const int skip = kLcmOriginalSteps / steps;
+        timesteps_.resize(steps);
+        sigmas_.resize(steps + 1);
+        for (int k = 0; k < steps; ++k) {
+            const int t = (kLcmOriginalSteps - k * skip) * stride - 1;
+            timesteps_[k] = static_cast<float>(t);
+            sigmas_[k] = train_sigma(t);
+        }
+        sigmas_[steps] = 0.f;
+    }
+
+    void build_coefficients() override {
+        c_skip_.resize(steps());
+        c_out_.resize(steps());
+        const double sd2 = kLcmSigmaData * kLcmSigmaData;
+        for (int k = 0; k < steps(); ++k) {
+            const double t = timesteps_[k] * kLcmTimestepScaling;
+            c_skip_[k] = static_cast<float>(sd2 / (t * t + sd2));
+            c_out_[k] = static_cast<float>(t / std::sqrt(t * t + sd2));
+        }
+    }
+};
+
+} // namespace
+
+const char *scheduler_name(SchedulerKind kind) {
+    switch (kind) {
+        case SchedulerKind::Euler: return "euler";
+        case SchedulerKind::EulerAncestral: return "euler_a";
+        case SchedulerKind::DpmSolverPP: return "dpmpp";
+        case SchedulerKind::Lcm: return "lcm";
+    }
+    return "?";
+}
+
+bool scheduler_preset(const std::string &name, SchedulerPreset &out) {
+    if (name == "euler") out = {SchedulerKind::Euler, 28, 7.5f};
+    else if (name == "euler_a") out = {SchedulerKind::EulerAncestral, 28, 7.5f};
+    else if (name == "dpmpp" || name == "dpm++") out = {SchedulerKind::DpmSolverPP, 16, 7.5f};
+    else if (name == "lcm") out = {SchedulerKind::Lcm, 4, 1.f};
+    else if (name == "turbo") out = {SchedulerKind::EulerAncestral, 1, 0.f};
+    else return false;
+    return true;
+}
+
+std::unique_ptr<Scheduler> Scheduler::create(SchedulerKind kind) {
+    switch (kind) {
+        case SchedulerKind::EulerAncestral: return std::make_unique<EulerAncestralScheduler>();
+        case SchedulerKind::DpmSolverPP: return std::make_unique<DpmSolverPPScheduler>();
+        case SchedulerKind::Lcm: return std::make_unique<LcmScheduler>();
+        case SchedulerKind::Euler: break;
+    }
+    return std::make_unique<EulerScheduler>();
+}
+
+void Scheduler::set_steps(int steps) {
+    if (steps == steps_) return;
+    steps_ = steps;
+    build_schedule(steps);
+    in_scale_.resize(steps + 1);
+    for (int k = 0; k <= steps; ++k) in_scale_[k] = 1.f / std::sqrt(sigmas_[k] * sigmas_[k] + 1.f);
+    build_coefficients();
+}
+
+float Scheduler::train_sigma(double t) {
+    // sigma_t = sqrt((1 - alpha_bar_t) / alpha_bar_t) over the training schedule
+    static const std::vector<double> table = [] {
+        std::vector<double> sigmas(kTrainSteps);
+        double alpha_bar = 1.0;
+        const double s0 = std::sqrt(kBetaStart), s1 = std::sqrt(kBetaEnd);
+        for (int i = 0; i < kTrainSteps; ++i) {
+            double s = s0 + (s1 - s0) * i / (kTrainSteps - 1);
+            alpha_bar *= 1.0 - s * s;
+            sigmas[i] = std::sqrt((1.0 - alpha_bar) / alpha_bar);
+        }
+        return sigmas;
+    }();
+    t = std::clamp(t, 0.0, double(kTrainSteps - 1));
+    int lo = static_cast<int>(std::floor(t));
+    int hi = std::min(lo + 1, kTrainSteps - 1);
+    double frac = t - lo;
+    return static_cast<float>(table[lo] * (1.0 - frac) + table[hi] * frac);
+}
+
+// "linspace" spacing from T-1 down to 0, sigmas interpolated between training steps
+void Scheduler::build_schedule(int steps) {
+    timesteps_.resize(steps);
+    sigmas_.resize(steps + 1);
+    for (int k = 0; k < steps; ++k) {
+        double t = steps > 1 ? (kTrainSteps - 1) * double(steps - 1 - k) / (steps - 1) : kTrainSteps - 1;
+        timesteps_[k] = static_cast<float>(t);
+        sigmas_[k] = train_sigma(t);
+    }
+    sigmas_[steps] = 0.f;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// ------------------------- Schedulers ----------------------------------------
+// Samplers for the UNet loop, all in k-diffusion form: x = x0 + sigma * eps,
+// the UNet sees x * input_scale(k) at timestep(k) and predicts eps.
+// set_steps() builds every per-step table (timesteps, sigmas, input scales
+// and the sampler's own coefficients) once per step count; step() then only
+// indexes into them. Not thread-safe, owned by a single ONNXRunner.
+//
+//   euler    Euler discrete (the original sampler)
+//   euler_a  Euler ancestral, re-injects noise every step
+//   dpmpp    DPM-Solver++(2M), second order multistep
+//   lcm      Latent Consistency Model sampling, for LCM / LCM-LoRA UNets
+enum class SchedulerKind { Euler, EulerAncestral, DpmSolverPP, Lcm };
+
+const char *scheduler_name(SchedulerKind kind);
+
+// Step count and guidance to use with a scheduler when none are given.
+// "turbo" is Euler ancestral with one step and no CFG (SD-Turbo / SDXL-Turbo).
+struct SchedulerPreset {
+    SchedulerKind kind = SchedulerKind::Euler;
+    int steps = 28;
+    float guidance = 7.5f;
+};
+bool scheduler_preset(const std::string &name, SchedulerPreset &out);
+
+class Scheduler {
+public:
+    virtual ~Scheduler() = default;
+
+    static std::unique_ptr<Scheduler> create(SchedulerKind kind);
+
+    SchedulerKind kind() const { return kind_; }
+
+    // Rebuilds the tables when the step count changes
+    void set_steps(int steps);
+    int steps() const { return steps_; }
+
+    float timestep(int k) const { return timesteps_[k]; }
+    float sigma(int k) const { return sigmas_[k]; } // k in [0, steps], sigma(steps) = 0
+    float input_scale(int k) const { return in_scale_[k]; }
+
+    // Resets multistep history; called before the first step of a frame.
+    // n is the latent size of one lane (one frame of a batch); scratch
+    // buffers are only reallocated when n or the lane count changes.
+    virtual void begin(size_t n, size_t lanes = 1) { (void)n; (void)lanes; }
+
+    // Advances lane `lane` of x (n floats) from sigma(k) to sigma(k + 1)
+    // given its guided eps. All lanes of a batch step through the same k.
+    virtual void step(int k, size_t lane, const float *eps, float *x, size_t n, std::mt19937 &rng) = 0;
+
+protected:
+    explicit Scheduler(SchedulerKind kind) : kind_(kind) {}
+
+    std::vector<float> timesteps_; // steps entries
+    std::vector<float> sigmas_;    // steps + 1 entries
+    std::vector<float> in_scale_;  // 1 / sqrt(sigma^2 + 1)
+
+    // Fills timesteps_ / sigmas_ (default: linspace over the training schedule)
+    virtual void build_schedule(int steps);
+    // Per-step coefficients of the sampler, after timesteps_ / sigmas_
+    virtual void build_coefficients() {}
+
+    // sigma of an integer or fractional training timestep
+    static float train_sigma(double t);
+
+private:
+    SchedulerKind kind_;
+    int steps_ = 0;
+};
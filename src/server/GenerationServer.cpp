@@ -0,0 +1,441 @@
+#include "GenerationServer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "stb_image_write.h"
+
+#include "HttpServer.hpp"
+
+namespace {
+
+bool parse_int(const std::string &v, int &out) {
+    try {
+        size_t pos = 0;
+        out = std::stoi(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+bool parse_float(const std::string &v, float &out) {
+    try {
+        size_t pos = 0;
+        out = std::stof(v, &pos);
+        return pos == v.size();
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+void append_png(void *context, void *data, int size) {
+    static_cast<std::string *>(context)->append(static_cast<const char *>(data), static_cast<size_t>(size));
+}
+
+bool encode_png(const std::vector<uint8_t> &rgba, int width, int height, std::string &png) {
+    png.clear();
+    if (rgba.size() != static_cast<size_t>(width) * height * 4) return false;
+    return stbi_write_png_to_func(append_png, &png, width, height, 4, rgba.data(), width * 4) != 0;
+}
+
+} // namespace
+
+// ----- Ticket -----
+
+bool GenerationServer::Ticket::next(std::vector<uint8_t> &rgba) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return failed_ || !frames_.empty() || remaining_ == 0; });
+    if (failed_ || frames_.empty()) return false;
+    rgba = std::move(frames_.front());
+    frames_.pop_front();
+    return true;
+}
+
+bool GenerationServer::Ticket::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+void GenerationServer::Ticket::deliver(const std::vector<uint8_t> &rgba) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (remaining_ > 0) --remaining_;
+        if (!cancelled_ && frames_.size() >= max_buffered_) {
+            // The reader stalled; drop the request like a failed one
+            failed_ = true;
+            frames_.clear();
+            cancelled_ = true;
+        }
+        if (!cancelled_) frames_.push_back(rgba);
+    }
+    ready_.notify_all();
+}
+
+void GenerationServer::Ticket::fail() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        frames_.clear();
+    }
+    // Nobody reads the rest, so the batcher skips it like a cancelled request
+    cancelled_ = true;
+    ready_.notify_all();
+}
+
+// ----- GenerationServer -----
+
+GenerationServer::GenerationServer(ONNXRunner &runner, const ServerConfig &cfg) : runner_(runner), cfg_(cfg) {}
+
+GenerationServer::~GenerationServer() {
+    stop();
+}
+
+bool GenerationServer::start() {
+    if (worker_.joinable()) return false;
+    cfg_.max_batch = std::max<size_t>(1, std::min(cfg_.max_batch, runner_.max_batch()));
+    cfg_.queue_capacity = std::max<size_t>(1, cfg_.queue_capacity);
+    jobs_.clear();
+    for (size_t i = 0; i < cfg_.max_batch; ++i) {
+        jobs_.push_back(std::make_unique<FrameJob>());
+        jobs_.back()->slot = i;
+    }
+    prepared_width_ = prepared_height_ = 0;
+    stopping_ = false;
+    worker_ = std::thread(&GenerationServer::worker_loop, this);
+    return true;
+}
+
+void GenerationServer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    if (worker_.joinable()) worker_.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Pending &p : queue_) p.ticket->fail();
+    queue_.clear();
+}
+
+std::shared_ptr<GenerationServer::Ticket> GenerationServer::submit(const GenerationRequest &req, std::string &error) {
+    auto ticket = std::make_shared<Ticket>();
+    ticket->remaining_ = req.frames;
+    ticket->max_buffered_ = std::max(Ticket::kMinBuffered, 2 * cfg_.max_batch);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || !worker_.joinable()) {
+            ++rejected_;
+            error = "server is not running";
+            return nullptr;
+        }
+        if (queue_.size() >= cfg_.queue_capacity) {
+            ++rejected_;
+            error = "queue full (" + std::to_string(cfg_.queue_capacity) + " requests), retry later";
+            return nullptr;
+        }
+        Pending p;
+        p.ticket = ticket;
+        p.req = req;
+        queue_.push_back(std::move(p));
+    }
+    ++requests_;
+    changed_.notify_all();
+    return ticket;
+}
+
+GenerationServer::Stats GenerationServer::stats() const {
+    Stats s;
+    s.requests = requests_;
+    s.rejected = rejected_;
+    s.frames = frames_;
+    s.batches = batches_;
+    s.failed = failed_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    s.queued = queue_.size();
+    return s;
+}
+
+// ----- Batcher -----
+
+// Same UNet batch: run_denoise_batch() splits on steps, strength and CFG on/off
+bool GenerationServer::compatible(const GenerationRequest &a, const GenerationRequest &b) {
+    return a.width == b.width && a.height == b.height && a.steps == b.steps && a.strength == b.strength &&
+           (a.guidance_scale > 1.f) == (b.guidance_scale > 1.f);
+}
+
+// The caller holds mutex_ for all of the queue helpers below
+void GenerationServer::drop_cancelled() {
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(), [](const Pending &p) { return p.ticket->cancelled(); }),
+                 queue_.end());
+}
+
+size_t GenerationServer::compatible_frames(const GenerationRequest &lead) const {
+    size_t frames = 0;
+    for (const Pending &p : queue_)
+        if (!is_stream(p.req) && !p.ticket->cancelled() && compatible(p.req, lead))
+            frames += static_cast<size_t>(p.req.frames - p.next_frame);
+    return frames;
+}
+
+// Frames are taken in queue order, so a long request fills a batch on its own
+// and short ones behind it join the remainder
+void GenerationServer::take_frames(const GenerationRequest &lead, std::vector<Work> &batch) {
+    for (size_t i = 0; i < queue_.size() && batch.size() < cfg_.max_batch;) {
+        Pending &p = queue_[i];
+        if (is_stream(p.req) || p.ticket->cancelled() || !compatible(p.req, lead)) {
+            ++i;
+            continue;
+        }
+        while (p.next_frame < p.req.frames && batch.size() < cfg_.max_batch) {
+            Work w;
+            w.ticket = p.ticket;
+            w.req = p.req;
+            w.frame = p.next_frame++;
+            batch.push_back(std::move(w));
+        }
+        if (p.next_frame == p.req.frames) queue_.erase(queue_.begin() + static_cast<std::ptrdiff_t>(i));
+        else ++i;
+    }
+}
+
+void GenerationServer::take_streams(std::vector<Pending> &streams) {
+    const GenerationRequest lead = queue_.front().req;
+    for (size_t i = 0; i < queue_.size() && streams.size() < cfg_.max_batch;) {
+        const Pending &p = queue_[i];
+        if (is_stream(p.req) && !p.ticket->cancelled() && compatible(p.req, lead) && p.req.frames == lead.frames) {
+            streams.push_back(p);
+            queue_.erase(queue_.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            ++i;
+        }
+    }
+}
+
+void GenerationServer::worker_loop() {
+    for (;;) {
+        std::vector<Work> batch;
+        std::vector<Pending> streams;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) break;
+            drop_cancelled();
+            if (queue_.empty()) continue;
+            const GenerationRequest lead = queue_.front().req;
+            if (is_stream(lead)) {
+                take_streams(streams);
+            } else {
+                // Give a partial batch a moment to fill up before running it
+                const auto deadline = Clock::now() + std::chrono::milliseconds(cfg_.batch_window_ms);
+                while (!stopping_ && compatible_frames(lead) < cfg_.max_batch &&
+                       changed_.wait_until(lock, deadline) != std::cv_status::timeout) {
+                }
+                if (stopping_) break;
+                take_frames(lead, batch);
+            }
+        }
+        if (!streams.empty()) run_streams(streams);
+        else if (!batch.empty()) run_batch(batch);
+    }
+}
+
+// Buffers for one resolution; `restart` also rewinds the stream lanes
+bool GenerationServer::prepare(int width, int height, bool restart) {
+    if (!restart && width == prepared_width_ && height == prepared_height_) return true;
+    if (!runner_.prepare(width, height, cfg_.max_batch)) {
+        std::cerr << "GenerationServer: prepare failed for " << width << "x" << height << "\n";
+        prepared_width_ = prepared_height_ = 0;
+        return false;
+    }
+    prepared_width_ = width;
+    prepared_height_ = height;
+    return true;
+}
+
+void GenerationServer::finish(FrameJob &job, Ticket &ticket) {
+    if (job.ok) runner_.run_decode(job);
+    if (job.ok && postprocess_ && !postprocess_(job)) job.ok = false;
+    if (job.ok) {
+        ticket.deliver(job.rgba);
+        ++frames_;
+    } else {
+        ticket.fail();
+        ++failed_;
+    }
+}
+
+static void fill_job(FrameJob &job, const GenerationRequest &req, int seed, bool planar) {
+    job.prompt = req.prompt;
+    job.width = req.width;
+    job.height = req.height;
+    job.steps = req.steps;
+    job.seed = seed;
+    job.guidance_scale = req.guidance_scale;
+    job.strength = req.strength;
+    job.planar_output = planar;
+    job.ok = true;
+}
+
+void GenerationServer::run_batch(std::vector<Work> &batch) {
+    const GenerationRequest &lead = batch.front().req;
+    if (!prepare(lead.width, lead.height, false)) {
+        for (Work &w : batch) w.ticket->fail();
+        failed_ += batch.size();
+        return;
+    }
+    std::vector<FrameJob *> jobs;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        FrameJob &job = *jobs_[i];
+        fill_job(job, batch[i].req, batch[i].req.seed + batch[i].frame, planar_);
+        runner_.run_encode(job);
+        jobs.push_back(&job);
+    }
+    runner_.run_denoise_batch(jobs.data(), jobs.size());
+    ++batches_;
+    for (size_t i = 0; i < batch.size(); ++i) finish(*jobs[i], *batch[i].ticket);
+}
+
+// Stream i runs on lane i and job i, so the group stays together (cancelled
+// lanes included) until its last frame
+void GenerationServer::run_streams(std::vector<Pending> &streams) {
+    const GenerationRequest &lead = streams.front().req;
+    // Fresh lanes: frame 0 of every stream starts from noise
+    if (!prepare(lead.width, lead.height, true)) {
+        for (Pending &p : streams) p.ticket->fail();
+        failed_ += streams.size();
+        return;
+    }
+    std::vector<FrameJob *> jobs;
+    for (int frame = 0; frame < lead.frames; ++frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                for (Pending &p : streams) p.ticket->fail();
+                return;
+            }
+        }
+        if (std::all_of(streams.begin(), streams.end(), [](const Pending &p) { return p.ticket->cancelled(); }))
+            return;
+        jobs.clear();
+        for (size_t i = 0; i < streams.size(); ++i) {
+            FrameJob &job = *jobs_[i];
+            // Same noise seed every frame keeps the stream coherent, as in the CLI
+            fill_job(job, streams[i].req, streams[i].req.seed, planar_);
+            job.lane = i;
+            runner_.run_encode(job);
+            jobs.push_back(&job);
+        }
+        runner_.run_denoise_batch(jobs.data(), jobs.size());
+        ++batches_;
+        for (size_t i = 0; i < streams.size(); ++i) finish(*jobs[i], *streams[i].ticket);
+    }
+}
+
+// ----- HTTP front end -----
+
+bool GenerationServer::parse_request(const HttpRequest &http, GenerationRequest &out, std::string &error) const {
+    out = defaults_;
+    for (const auto &[key, value] : http.params) {
+        bool ok = true;
+        if (key == "prompt") out.prompt = value;
+        else if (key == "steps") ok = parse_int(value, out.steps) && out.steps > 0 && out.steps <= 150;
+        else if (key == "seed") ok = parse_int(value, out.seed);
+        else if (key == "guidance") ok = parse_float(value, out.guidance_scale) && out.guidance_scale >= 0.f;
+        else if (key == "strength") ok = parse_float(value, out.strength) && out.strength > 0.f && out.strength <= 1.f;
+        else if (key == "frames") ok = parse_int(value, out.frames) && out.frames > 0 && out.frames <= cfg_.max_frames;
+        else if (key == "width") ok = parse_int(value, out.width) && out.width >= 64 && out.width <= 2048 && out.width % 8 == 0;
+        else if (key == "height") ok = parse_int(value, out.height) && out.height >= 64 && out.height <= 2048 && out.height % 8 == 0;
+        else {
+            error = "unknown parameter '" + key + "'";
+            return false;
+        }
+        if (!ok) {
+            error = "invalid value for '" + key + "': '" + value + "'";
+            return false;
+        }
+    }
+    if (out.prompt.empty()) {
+        error = "missing 'prompt'";
+        return false;
+    }
+    return true;
+}
+
+void GenerationServer::handle(const HttpRequest &http, HttpResponse &res) {
+    if (http.path == "/health") {
+        if (http.method != "GET") {
+            res.send(405, "text/plain", "use GET\n");
+            return;
+        }
+        const Stats s = stats();
+        std::ostringstream json;
+        json << "{\"queued\": " << s.queued << ", \"capacity\": " << cfg_.queue_capacity
+             << ", \"max_batch\": " << cfg_.max_batch << ", \"requests\": " << s.requests
+             << ", \"rejected\": " << s.rejected << ", \"frames\": " << s.frames << ", \"batches\": " << s.batches
+             << ", \"failed\": " << s.failed << ", \"models_ready\": " << (runner_.ready() ? "true" : "false") << "}\n";
+        res.send(200, "application/json", json.str());
+        return;
+    }
+    if (http.path != "/generate") {
+        res.send(404, "text/plain", "not found\n");
+        return;
+    }
+    if (http.method != "GET" && http.method != "POST") {
+        res.send(405, "text/plain", "use GET or POST\n");
+        return;
+    }
+    GenerationRequest req;
+    std::string error;
+    if (!parse_request(http, req, error)) {
+        res.send(400, "text/plain", error + "\n");
+        return;
+    }
+    auto ticket = submit(req, error);
+    if (!ticket) {
+        res.send(503, "text/plain", error + "\n");
+        return;
+    }
+
+    std::vector<uint8_t> rgba;
+    std::string png;
+    if (req.frames == 1) {
+        if (!ticket->next(rgba) || !encode_png(rgba, req.width, req.height, png)) {
+            res.send(500, "text/plain", "generation failed\n");
+            return;
+        }
+        res.send(200, "image/png", png);
+        return;
+    }
+
+    // One PNG part per frame as it comes out. A failed frame drops the
+    // connection without the closing boundary and terminating chunk, so the
+    // client sees a truncated response rather than a complete shorter one.
+    if (!res.begin_stream(200, "multipart/x-mixed-replace; boundary=frame")) {
+        ticket->cancel();
+        return;
+    }
+    std::string part;
+    while (ticket->next(rgba)) {
+        if (!encode_png(rgba, req.width, req.height, png)) {
+            ticket->cancel();
+            res.abort();
+            return;
+        }
+        part = "--frame\r\nContent-Type: image/png\r\nContent-Length: " + std::to_string(png.size()) + "\r\n\r\n";
+        part += png;
+        part += "\r\n";
+        if (!res.write_chunk(part.data(), part.size())) {
+            ticket->cancel();
+            return;
+        }
+    }
+    if (ticket->failed()) {
+        res.abort();
+        return;
+    }
+    const std::string close = "--frame--\r\n";
+    res.write_chunk(close.data(), close.size());
+    res.end_stream();
+}
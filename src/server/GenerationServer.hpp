@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../sd/ONNXRunner.hpp"
+
+struct HttpRequest;
+class HttpResponse;
+
+// One client request: `frames` images of the same prompt. With strength == 1
+// every frame is independent (seed + frame index); below 1 it is an img2img
+// stream where each frame continues the previous one's latents, as in the CLI.
+struct GenerationRequest {
+    std::string prompt;
+    int width = 512, height = 512;
+    int steps = 28;
+    int seed = 1337;
+    float guidance_scale = 7.5f;
+    float strength = 1.f;
+    int frames = 1;
+};
+
+struct ServerConfig {
+    size_t queue_capacity = 32; // requests waiting for the batcher; submit() refuses beyond it
+    size_t max_batch = 4;       // frames per UNet run (clamped to ONNXRunner::max_batch())
+    int batch_window_ms = 10;   // how long a partial batch waits for compatible frames
+    int max_frames = 600;       // per request
+};
+
+// ------------------------- Generation server ---------------------------------
+// Keeps one ONNXRunner resident and serves requests from any number of client
+// threads through a bounded queue, so model load and warmup are paid once per
+// process instead of once per request.
+//
+// A single batcher thread drives the runner's stage API. Queued frames with
+// the same resolution, steps, strength and CFG on/off are denoised together
+// (up to max_batch per run_denoise_batch(), waiting at most batch_window_ms
+// for a batch to fill), taking frames from several requests in FIFO order.
+// Streams (strength < 1) continue their runner lane, so up to max_batch
+// streams with identical settings and frame counts run in lockstep, one lane
+// each, and nothing else runs on the runner until they are done. A request at
+// another resolution re-prepares the runner; TensorRT engines are built for
+// the warmup resolution only, so clients should stick to it.
+//
+// Each request gets a Ticket its client thread reads the frames from, so PNG
+// encoding and slow sockets never hold the batcher up; a reader more than
+// two batches (at least Ticket::kMinBuffered frames) behind has its request
+// failed.
+class GenerationServer {
+public:
+    // Same contract as FramePipeline::Sink: runs on the batcher thread after
+    // run_decode, may turn job.planar into job.rgba (GPU conversion)
+    using Sink = std::function<bool(FrameJob &job)>;
+
+    class Ticket {
+    public:
+        // Least number of frames produced but not yet read before the
+        // request is dropped; the server allows at least two batches, so a
+        // burst from one run_denoise_batch() never trips it. A client that
+        // falls further behind is dropped rather than buffered without
+        // limit; the batcher never waits on a reader.
+        static constexpr size_t kMinBuffered = 8;
+
+        // Blocks for the next frame in order; false once every frame was
+        // handed out or the request failed / was dropped
+        bool next(std::vector<uint8_t> &rgba);
+
+        // The client went away; its remaining frames are skipped
+        void cancel() { cancelled_ = true; }
+        bool cancelled() const { return cancelled_; }
+        bool failed() const;
+
+    private:
+        friend class GenerationServer;
+
+        mutable std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<std::vector<uint8_t>> frames_;
+        int remaining_ = 0; // frames not yet produced
+        size_t max_buffered_ = kMinBuffered;
+        bool failed_ = false;
+        std::atomic<bool> cancelled_{false};
+
+        void deliver(const std::vector<uint8_t> &rgba);
+        void fail();
+    };
+
+    struct Stats {
+        uint64_t requests = 0;  // accepted
+        uint64_t rejected = 0;  // queue full or shutting down
+        uint64_t frames = 0;    // delivered
+        uint64_t batches = 0;   // run_denoise_batch() calls
+        uint64_t failed = 0;    // frames the runner failed
+        size_t queued = 0;      // requests in the queue right now
+    };
+
+    GenerationServer(ONNXRunner &runner, const ServerConfig &cfg = {});
+    ~GenerationServer();
+
+    GenerationServer(const GenerationServer&) = delete;
+    GenerationServer& operator=(const GenerationServer&) = delete;
+
+    // Call before start()
+    void set_defaults(const GenerationRequest &defaults) { defaults_ = defaults; }
+    void set_planar_output(bool planar) { planar_ = planar; }
+    void set_postprocess(Sink sink) { postprocess_ = std::move(sink); }
+
+    bool start();
+
+    // Fails whatever is still queued and joins the batcher; the frame in
+    // flight is finished first
+    void stop();
+
+    // Queues `req`; null (with `error`) when the queue is full or stopping.
+    // The request must already be valid, see parse_request().
+    std::shared_ptr<Ticket> submit(const GenerationRequest &req, std::string &error);
+
+    // Fills `out` from HTTP parameters on top of the defaults; false with a
+    // message on a missing prompt or an out-of-range value
+    bool parse_request(const HttpRequest &http, GenerationRequest &out, std::string &error) const;
+
+    // HTTP front end, for HttpServer:
+    //   POST|GET /generate?prompt=..&steps=..&seed=..&guidance=..&strength=..&frames=..&width=..&height=..
+    //     one frame: image/png; more: a multipart/x-mixed-replace stream of
+    //     PNG parts (plays in a browser <img>), sent as the frames come out
+    //   GET /health: queue and throughput counters as JSON
+    void handle(const HttpRequest &http, HttpResponse &res);
+
+    Stats stats() const;
+
+private:
+    struct Pending {
+        std::shared_ptr<Ticket> ticket;
+        GenerationRequest req;
+        int next_frame = 0; // first frame not yet taken into a batch
+    };
+
+    // One frame of one request inside a batch
+    struct Work {
+        std::shared_ptr<Ticket> ticket;
+        GenerationRequest req;
+        int frame = 0;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    ONNXRunner &runner_;
+    ServerConfig cfg_;
+    GenerationRequest defaults_;
+    bool planar_ = false;
+    Sink postprocess_;
+
+    // Recycled across batches so repeated prompts hit the encoded-prompt
+    // check and the output vectors keep their capacity
+    std::vector<std::unique_ptr<FrameJob>> jobs_;
+    int prepared_width_ = 0, prepared_height_ = 0;
+
+    mutable std::mutex mutex_; // guards queue_ and stopping_
+    std::condition_variable changed_;
+    std::deque<Pending> queue_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    std::atomic<uint64_t> requests_{0}, rejected_{0}, frames_{0}, batches_{0}, failed_{0};
+
+    static bool compatible(const GenerationRequest &a, const GenerationRequest &b);
+    static bool is_stream(const GenerationRequest &r) { return r.strength < 1.f; }
+
+    void worker_loop();
+    size_t compatible_frames(const GenerationRequest &lead) const;
+    void take_frames(const GenerationRequest &lead, std::vector<Work> &batch);
+    void take_streams(std::vector<Pending> &streams);
+    void drop_cancelled();
+    bool prepare(int width, int height, bool restart);
+    void run_batch(std::vector<Work> &batch);
+    void run_streams(std::vector<Pending> &streams);
+    void finish(FrameJob &job, Ticket &ticket);
+};
@@ -0,0 +1,317 @@
+#include "HttpServer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char *reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// application/x-www-form-urlencoded: '+' is a space, %XX a byte
+std::string url_decode(const std::string &s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && hex_digit(s[i + 1]) >= 0 && hex_digit(s[i + 2]) >= 0) {
+            out += static_cast<char>(hex_digit(s[i + 1]) * 16 + hex_digit(s[i + 2]));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+void parse_params(const std::string &s, std::map<std::string, std::string> &out) {
+    for (size_t pos = 0; pos < s.size();) {
+        size_t amp = s.find('&', pos);
+        if (amp == std::string::npos) amp = s.size();
+        const std::string pair = s.substr(pos, amp - pos);
+        const size_t eq = pair.find('=');
+        if (!pair.empty())
+            out[url_decode(pair.substr(0, eq))] = eq == std::string::npos ? "" : url_decode(pair.substr(eq + 1));
+        pos = amp + 1;
+    }
+}
+
+} // namespace
+
+// ----- HttpResponse -----
+
+bool HttpResponse::write_all(const void *data, size_t size) {
+#ifndef _WIN32
+    const char *p = static_cast<const char *>(data);
+    while (!broken_ && size > 0) {
+        // MSG_NOSIGNAL: a client that hung up must not SIGPIPE the server
+        const ssize_t n = ::send(fd_, p, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            broken_ = true;
+            break;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+#else
+    (void)data;
+    (void)size;
+    broken_ = true;
+#endif
+    return !broken_;
+}
+
+bool HttpResponse::write_head(int status, const std::string &content_type, const std::string &extra) {
+    started_ = true;
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n";
+    head += "Content-Type: " + content_type + "\r\n";
+    head += extra;
+    head += "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    return write_all(head.data(), head.size());
+}
+
+bool HttpResponse::send(int status, const std::string &content_type, const std::string &body) {
+    if (started_) return false;
+    return write_head(status, content_type, "Content-Length: " + std::to_string(body.size()) + "\r\n") &&
+           write_all(body.data(), body.size());
+}
+
+bool HttpResponse::begin_stream(int status, const std::string &content_type) {
+    if (started_) return false;
+    return write_head(status, content_type, "Transfer-Encoding: chunked\r\n");
+}
+
+bool HttpResponse::write_chunk(const void *data, size_t size) {
+    if (size == 0) return !broken_; // an empty chunk would end the stream
+    char len[24];
+    std::snprintf(len, sizeof(len), "%zx\r\n", size);
+    return write_all(len, std::strlen(len)) && write_all(data, size) && write_all("\r\n", 2);
+}
+
+bool HttpResponse::end_stream() {
+    return write_all("0\r\n\r\n", 5);
+}
+
+void HttpResponse::abort() {
+#ifndef _WIN32
+    if (!broken_) ::shutdown(fd_, SHUT_RDWR);
+#endif
+    broken_ = true;
+}
+
+// ----- HttpServer -----
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+#ifndef _WIN32
+
+bool HttpServer::start(const std::string &host, int port, Handler handler) {
+    if (listen_fd_ >= 0) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "HttpServer: invalid IPv4 address '" << host << "'\n";
+        return false;
+    }
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "HttpServer: socket() failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    const int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd_, 64) != 0) {
+        std::cerr << "HttpServer: cannot listen on " << host << ":" << port << ": " << std::strerror(errno) << "\n";
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    handler_ = std::move(handler);
+    stopping_ = false;
+    accept_thread_ = std::thread(&HttpServer::accept_loop, this);
+    return true;
+}
+
+void HttpServer::stop() {
+    if (listen_fd_ < 0) return;
+    stopping_ = true;
+    // Wakes accept() up; the socket is closed once the thread is gone
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    if (accept_thread_.joinable()) accept_thread_.join();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &conn : connections_)
+            if (!conn->done) ::shutdown(conn->fd, SHUT_RDWR);
+    }
+    reap(true);
+}
+
+void HttpServer::accept_loop() {
+    while (!stopping_) {
+        const int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (stopping_) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "HttpServer: accept() failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        // A client that never finishes its request, or stops reading the
+        // response, must not hold a thread forever: a timed-out send() breaks
+        // the response and the handler sees its writes fail
+        timeval timeout{10, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        reap(false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        Connection &c = *conn;
+        connections_.push_back(std::move(conn));
+        c.thread = std::thread([this, &c] {
+            serve(c);
+            c.done = true;
+        });
+    }
+}
+
+// Joins (and closes) finished connections, or all of them
+void HttpServer::reap(bool all) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        Connection &conn = **it;
+        if (!all && !conn.done) {
+            ++it;
+            continue;
+        }
+        if (conn.thread.joinable()) conn.thread.join();
+        ::close(conn.fd);
+        it = connections_.erase(it);
+    }
+}
+
+void HttpServer::serve(Connection &conn) {
+    HttpResponse res(conn.fd);
+    std::string data;
+    char buf[4096];
+    size_t header_end = std::string::npos;
+    while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > kMaxHeader) {
+            res.send(413, "text/plain", "request header too large\n");
+            return;
+        }
+        const ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        data.append(buf, static_cast<size_t>(n));
+    }
+
+    HttpRequest req;
+    const size_t line_end = data.find("\r\n");
+    const std::string line = data.substr(0, line_end);
+    const size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1 || line.compare(sp2 + 1, 5, "HTTP/") != 0) {
+        res.send(400, "text/plain", "malformed request line\n");
+        return;
+    }
+    req.method = line.substr(0, sp1);
+    const std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const size_t query = target.find('?');
+    req.path = url_decode(target.substr(0, query));
+    if (query != std::string::npos) parse_params(target.substr(query + 1), req.params);
+
+    size_t content_length = 0;
+    std::string content_type;
+    for (size_t pos = line_end + 2; pos < header_end;) {
+        const size_t end = data.find("\r\n", pos);
+        const std::string header = data.substr(pos, end - pos);
+        pos = end + 2;
+        const size_t colon = header.find(':');
+        if (colon == std::string::npos) continue;
+        const std::string name = lower(header.substr(0, colon));
+        std::string value = header.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        if (name == "content-length") {
+            try {
+                content_length = std::stoul(value);
+            } catch (const std::exception &) {
+                res.send(400, "text/plain", "bad Content-Length\n");
+                return;
+            }
+        } else if (name == "content-type") {
+            content_type = lower(value);
+        }
+    }
+    if (content_length > kMaxBody) {
+        res.send(413, "text/plain", "request body too large\n");
+        return;
+    }
+    req.body = data.substr(header_end + 4);
+    while (req.body.size() < content_length) {
+        const ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        req.body.append(buf, static_cast<size_t>(n));
+    }
+    req.body.resize(content_length);
+    if (content_type.rfind("application/x-www-form-urlencoded", 0) == 0) parse_params(req.body, req.params);
+
+    handler_(req, res);
+    if (!res.sent()) res.send(500, "text/plain", "no response\n");
+}
+
+#else
+
+bool HttpServer::start(const std::string &, int, Handler) {
+    std::cerr << "HttpServer: not supported on this platform\n";
+    return false;
+}
+
+void HttpServer::stop() {}
+void HttpServer::accept_loop() {}
+void HttpServer::serve(Connection &) {}
+void HttpServer::reap(bool) {}
+
+#endif
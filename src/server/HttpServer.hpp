@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One parsed request. Query-string parameters and an
+// application/x-www-form-urlencoded body both end up in `params`,
+// percent-decoded (the body wins when a key is in both).
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> params;
+    std::string body;
+};
+
+// Reply side of one connection: either send() a whole body, or
+// begin_stream() followed by any number of write_chunk() and end_stream()
+// (Transfer-Encoding: chunked). Writes return false once the peer is gone.
+class HttpResponse {
+public:
+    explicit HttpResponse(int fd) : fd_(fd) {}
+
+    bool send(int status, const std::string &content_type, const std::string &body);
+    bool begin_stream(int status, const std::string &content_type);
+    bool write_chunk(const void *data, size_t size);
+    bool end_stream();
+
+    // Shuts the connection down mid-response: a stream ended this way has no
+    // terminating chunk, so the client sees it truncated instead of complete
+    void abort();
+
+    bool sent() const { return started_; }
+
+private:
+    int fd_;
+    bool started_ = false;
+    bool broken_ = false;
+
+    bool write_all(const void *data, size_t size);
+    bool write_head(int status, const std::string &content_type, const std::string &extra);
+};
+
+// ------------------------- HTTP server ---------------------------------------
+// Minimal HTTP/1.1 server on POSIX sockets for the generation service: one
+// accept thread and one thread per connection, one request per connection
+// (Connection: close), request bodies up to kMaxBody. The handler runs on the
+// connection's thread and may block for as long as it streams.
+// Not available on Windows: start() reports it and fails.
+class HttpServer {
+public:
+    using Handler = std::function<void(const HttpRequest &req, HttpResponse &res)>;
+
+    static constexpr size_t kMaxHeader = 16 * 1024;
+    static constexpr size_t kMaxBody = 1024 * 1024;
+
+    HttpServer() = default;
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Binds host:port (port 0 picks a free one, see port()) and starts accepting
+    bool start(const std::string &host, int port, Handler handler);
+
+    // Stops accepting, shuts the open connections down and joins their
+    // threads; handlers blocked on something else must be released first
+    void stop();
+
+    int port() const { return port_; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    Handler handler_;
+    int listen_fd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread accept_thread_;
+    std::mutex mutex_; // guards connections_
+    std::vector<std::unique_ptr<Connection>> connections_;
+
+    void accept_loop();
+    void serve(Connection &conn);
+    void reap(bool all);
+};
@@ -0,0 +1,200 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept {
+    swap(o);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+    if (this != &o) {
+        close();
+        swap(o);
+    }
+    return *this;
+}
+
+void MappedFile::swap(MappedFile &o) noexcept {
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+    std::swap(writable_, o.writable_);
+#ifdef _WIN32
+    std::swap(file_, o.file_);
+    std::swap(mapping_, o.mapping_);
+#else
+    std::swap(fd_, o.fd_);
+#endif
+}
+
+bool MappedFile::resize(size_t size) {
+    if (!writable_) return false;
+    if (size == size_) return true;
+    unmap();
+    return map_writable(size);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = view;
+    size_ = static_cast<size_t>(sz.QuadPart);
+    return true;
+}
+
+bool MappedFile::create(const std::string &path, size_t size) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    file_ = file;
+    writable_ = true;
+    if (!map_writable(size)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::map_writable(size_t size) {
+    if (size == 0) return false;
+    // Set the exact length first: a mapping can grow a file but not shrink it
+    LARGE_INTEGER sz;
+    sz.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(static_cast<HANDLE>(file_), sz, nullptr, FILE_BEGIN) ||
+        !SetEndOfFile(static_cast<HANDLE>(file_)))
+        return false;
+    HANDLE mapping = CreateFileMappingA(static_cast<HANDLE>(file_), nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                        static_cast<DWORD>(size & 0xffffffffu), nullptr);
+    if (!mapping) return false;
+    void *view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+    mapping_ = mapping;
+    data_ = view;
+    size_ = size;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (!writable_ || !data_) return false;
+    return FlushViewOfFile(data_, 0) && FlushFileBuffers(static_cast<HANDLE>(file_));
+}
+
+void MappedFile::unmap() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+    data_ = nullptr;
+    mapping_ = nullptr;
+    size_ = 0;
+}
+
+void MappedFile::close() {
+    unmap();
+    if (file_) CloseHandle(static_cast<HANDLE>(file_));
+    file_ = nullptr;
+    writable_ = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    data_ = p;
+    size_ = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+bool MappedFile::create(const std::string &path, size_t size) {
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    fd_ = fd;
+    writable_ = true;
+    if (!map_writable(size)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::map_writable(size_t size) {
+    if (size == 0 || ftruncate(fd_, static_cast<off_t>(size)) != 0) return false;
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) return false;
+    data_ = p;
+    size_ = size;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (!writable_ || !data_) return false;
+    return msync(data_, size_, MS_SYNC) == 0;
+}
+
+void MappedFile::unmap() {
+    if (data_) munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+void MappedFile::close() {
+    unmap();
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    writable_ = false;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ------------------------- Memory-mapped file --------------------------------
+// Read-only mapping of a whole file (mmap on POSIX, file mapping on Windows),
+// or a read-write mapping of a file created with create(). The bytes stay
+// valid until close(), resize() or destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept;
+    MappedFile& operator=(MappedFile&& o) noexcept;
+
+    bool open(const std::string &path);
+
+    // Creates (or truncates) `path` with `size` bytes and maps it writable
+    bool create(const std::string &path, size_t size);
+
+    // Grows or shrinks a writable mapping, remapping it (data() may move)
+    bool resize(size_t size);
+
+    // Writes dirty pages of a writable mapping back to the file
+    bool flush();
+
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    bool is_writable() const { return writable_; }
+    const uint8_t *data() const { return static_cast<const uint8_t*>(data_); }
+    uint8_t *writable_data() { return writable_ ? static_cast<uint8_t*>(data_) : nullptr; }
+    size_t size() const { return size_; }
+
+private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+    bool writable_ = false;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    void swap(MappedFile &o) noexcept;
+    bool map_writable(size_t size);
+    void unmap();
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ------------------------- SPSC queue ----------------------------------------
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. try_push/try_pop never block; push/pop back off (spin, yield, then
+// short sleeps) until there is room or an element, which is what gives the
+// pipeline its back-pressure.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    size_t capacity() const { return slots_.size() - 1; }
+
+    bool try_push(T &&value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = tail + 1 == slots_.size() ? 0 : tail + 1;
+        if (next == head_.load(std::memory_order_acquire)) return false;
+        slots_[tail] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &out) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        out = std::move(slots_[head]);
+        head_.store(head + 1 == slots_.size() ? 0 : head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T value) {
+        for (unsigned spins = 0; !try_push(std::move(value)); ++spins) backoff(spins);
+    }
+
+    T pop() {
+        T out{};
+        for (unsigned spins = 0; !try_pop(out); ++spins) backoff(spins);
+        return out;
+    }
+
+    // pop() that gives up, returning false, once stop() holds while the queue is empty
+    template <typename Stop>
+    bool pop_unless(T &out, Stop stop) {
+        for (unsigned spins = 0; !try_pop(out); ++spins) {
+            if (stop()) return false;
+            backoff(spins);
+        }
+        return true;
+    }
+
+    // Approximate, only meant for stats
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + slots_.size() - head;
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    std::vector<T> slots_;
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+
+    static void backoff(unsigned spins) {
+        if (spins < 64) return;
+        if (spins < 256) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+};
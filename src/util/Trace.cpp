@@ -0,0 +1,212 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Per-thread cap, about 32 MiB of events; later spans only feed the summary
+constexpr size_t kMaxEvents = 1u << 20;
+
+struct Event {
+    const char *name;
+    const char *category;
+    int64_t ts_us;
+    int64_t dur_us;
+};
+
+// Ring of the latest durations of one span name
+struct Window {
+    std::vector<int64_t> samples;
+    size_t next = 0;
+    uint64_t count = 0;
+};
+
+// One track: a CPU thread or a GPU queue. Only its owner appends; the mutex
+// is contended only while a summary or the JSON is being produced.
+struct Track {
+    std::mutex mutex;
+    uint32_t tid = 0;
+    std::string name;
+    std::vector<Event> events;
+    std::unordered_map<const char*, Window> windows;
+    uint64_t dropped = 0;
+};
+
+// Tracks are never freed, so thread_local pointers stay valid across restarts
+struct State {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Track>> tracks;
+    std::string path;
+    size_t window = 1024;
+    Trace::Clock::time_point origin = Trace::Clock::now();
+};
+
+State &state() {
+    static State s;
+    return s;
+}
+
+Track &new_track(std::string name) {
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.tracks.push_back(std::make_unique<Track>());
+    Track &t = *s.tracks.back();
+    t.tid = static_cast<uint32_t>(s.tracks.size());
+    t.name = std::move(name);
+    return t;
+}
+
+Track &thread_track() {
+    thread_local Track *track = nullptr;
+    if (!track) track = &new_track("thread");
+    return *track;
+}
+
+Track &gpu_track(const char *queue) {
+    static std::mutex mutex;
+    static std::map<std::string, Track*> queues;
+    std::lock_guard<std::mutex> lock(mutex);
+    Track *&t = queues[queue];
+    if (!t) t = &new_track(std::string("gpu ") + queue);
+    return *t;
+}
+
+void append(Track &t, const char *name, const char *category, int64_t ts, int64_t dur) {
+    const size_t window = state().window;
+    std::lock_guard<std::mutex> lock(t.mutex);
+    if (t.events.size() < kMaxEvents) t.events.push_back(Event{name, category, ts, dur});
+    else ++t.dropped;
+    Window &w = t.windows[name];
+    if (w.samples.size() < window) w.samples.push_back(dur);
+    else w.samples[w.next] = dur;
+    w.next = (w.next + 1) % window;
+    ++w.count;
+}
+
+void write_escaped(std::ostream &out, const std::string &s) {
+    for (char c : s) {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+}
+
+} // namespace
+
+std::atomic<bool> Trace::enabled_{false};
+
+void Trace::start(const std::string &path, size_t window) {
+    State &s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.path = path;
+        s.window = std::max<size_t>(window, 1);
+        s.origin = Clock::now();
+        for (auto &t : s.tracks) {
+            std::lock_guard<std::mutex> track_lock(t->mutex);
+            t->events.clear();
+            t->windows.clear();
+            t->dropped = 0;
+        }
+    }
+    enabled_.store(true, std::memory_order_release);
+}
+
+void Trace::stop() {
+    if (!enabled_.exchange(false)) return;
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.path.empty()) return;
+
+    std::ofstream out(s.path);
+    if (!out) {
+        std::cerr << "Trace: cannot write " << s.path << std::endl;
+        return;
+    }
+    size_t events = 0;
+    uint64_t dropped = 0;
+    bool first = true;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (auto &t : s.tracks) {
+        std::lock_guard<std::mutex> track_lock(t->mutex);
+        if (t->events.empty()) continue;
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t->tid
+            << ",\"args\":{\"name\":\"";
+        write_escaped(out, t->name);
+        out << "\"}}";
+        first = false;
+        for (const Event &e : t->events) {
+            out << ",\n{\"name\":\"";
+            write_escaped(out, e.name);
+            out << "\",\"cat\":\"";
+            write_escaped(out, e.category);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->tid << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us
+                << "}";
+        }
+        events += t->events.size();
+        dropped += t->dropped;
+    }
+    out << "\n]}\n";
+    std::cout << "Trace: " << events << " spans written to " << s.path;
+    if (dropped > 0) std::cout << " (" << dropped << " dropped)";
+    std::cout << std::endl;
+}
+
+void Trace::set_thread_name(const char *name) {
+    Track &t = thread_track();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    t.name = name;
+}
+
+int64_t Trace::to_us(Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - state().origin).count();
+}
+
+void Trace::record(const char *name, const char *category, Clock::time_point begin, Clock::time_point end) {
+    append(thread_track(), name, category, to_us(begin),
+           std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count());
+}
+
+void Trace::record_gpu(const char *name, const char *queue, int64_t begin_us, int64_t duration_us) {
+    if (!enabled()) return;
+    append(gpu_track(queue), name, "gpu", begin_us, duration_us);
+}
+
+void Trace::print_summary(std::ostream &out) {
+    // Same name on several threads (e.g. one denoise thread per device) is merged
+    std::map<std::string, std::vector<int64_t>> samples;
+    std::map<std::string, uint64_t> counts;
+    State &s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto &t : s.tracks) {
+            std::lock_guard<std::mutex> track_lock(t->mutex);
+            const bool gpu = t->name.rfind("gpu ", 0) == 0;
+            for (const auto &[name, w] : t->windows) {
+                const std::string key = gpu ? std::string(name) + " (" + t->name + ")" : std::string(name);
+                auto &v = samples[key];
+                v.insert(v.end(), w.samples.begin(), w.samples.end());
+                counts[key] += w.count;
+            }
+        }
+    }
+    if (samples.empty()) return;
+
+    out << "Trace summary (ms over the latest " << s.window << " per span and thread):" << std::endl;
+    for (auto &[name, v] : samples) {
+        std::sort(v.begin(), v.end());
+        auto pct = [&](double p) {
+            return v[std::min(v.size() - 1, static_cast<size_t>(p * static_cast<double>(v.size())))] / 1000.0;
+        };
+        out << "  " << std::left << std::setw(28) << name << std::right << std::setw(8) << counts[name] << "  p50 "
+            << std::fixed << std::setprecision(2) << std::setw(8) << pct(0.50) << "  p99 " << std::setw(8) << pct(0.99)
+            << "  max " << std::setw(8) << v.back() / 1000.0 << std::endl;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// ------------------------- Tracing -------------------------------------------
+// Process-wide recorder for timed spans: CPU spans from TraceScope on any
+// thread, GPU spans from the Renderer's timestamp queries. Disabled it costs
+// one relaxed atomic load per span. Enabled, each thread appends to its own
+// buffer (no shared lock on the hot path) and keeps a rolling window of the
+// latest durations per span name for the p50/p99 summary.
+//
+// Span names and categories must be string literals (or otherwise outlive
+// the trace): only the pointer is stored.
+//
+// stop() writes everything as Chrome trace JSON (chrome://tracing, Perfetto):
+// one track per CPU thread and one per GPU queue.
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // path: Chrome trace output, empty = keep only the rolling summary.
+    // window: durations kept per span name and thread for the percentiles.
+    static void start(const std::string &path, size_t window = 1024);
+
+    // Stops recording and writes the JSON file
+    static void stop();
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Names the calling thread's track
+    static void set_thread_name(const char *name);
+
+    static void record(const char *name, const char *category, Clock::time_point begin, Clock::time_point end);
+
+    // GPU span on the track of `queue`, in Trace clock microseconds
+    static void record_gpu(const char *name, const char *queue, int64_t begin_us, int64_t duration_us);
+
+    // Microseconds since start() on the trace clock
+    static int64_t to_us(Clock::time_point t);
+
+    // count / p50 / p99 / max per span name over the rolling windows
+    static void print_summary(std::ostream &out);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records the enclosing scope as one span while tracing is enabled
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, const char *category = "cpu")
+    : name_(Trace::enabled() ? name : nullptr), category_(category) {
+        if (name_) begin_ = Trace::Clock::now();
+    }
+    ~TraceScope() {
+        if (name_) Trace::record(name_, category_, begin_, Trace::Clock::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char *name_;
+    const char *category_;
+    Trace::Clock::time_point begin_;
+};